@@ -127,6 +127,14 @@ SOURCE=.\src\audio.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\src\bvh.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\bvh.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\src\config.h
 # End Source File
 # Begin Source File
@@ -215,14 +223,6 @@ SOURCE=.\src\mtltex.h
 # End Source File
 # Begin Source File
 
-SOURCE=.\src\octree.c
-# End Source File
-# Begin Source File
-
-SOURCE=.\src\octree.h
-# End Source File
-# Begin Source File
-
 SOURCE=.\src\options.c
 # End Source File
 # Begin Source File
@@ -247,6 +247,14 @@ SOURCE=.\src\player.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\src\prof.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\prof.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\src\rbtree.c
 # End Source File
 # Begin Source File
@@ -263,6 +271,14 @@ SOURCE=.\src\rendlvl.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\src\replay.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\replay.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\src\scr_debug.c
 # End Source File
 # Begin Source File
@@ -283,6 +299,22 @@ SOURCE=.\src\scr_opt.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\src\sdf.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\sdf.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\tri4.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\tri4.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\src\util.c
 # End Source File
 # Begin Source File
@@ -0,0 +1,866 @@
+/*
+Deep Runner - 6dof shooter game for the SGI O2.
+Copyright (C) 2023  John Tsiombikas <nuclear@mutantstargoat.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+/* Headless renderer benchmark: a null platform layer, drawing the first level
+ * with the software renderer into a framebuffer in memory, along a camera path
+ * through the level. The path is either a spline through the centers of all
+ * the rooms, visited through their portals, or a list of points read from a
+ * file, one "x y z" per line.
+ *
+ * Animations advance by a fixed 60Hz timestep per frame, so that every run
+ * draws exactly the same frames.
+ *
+ * With -sdf, it instead bakes the collision distance fields of the level, and
+ * reports how far they are from the exact distances to the triangles. With
+ * -colcmp, it moves a sphere around the level at a few speeds, once with the
+ * old iterative push-out and once with swept spheres, and compares how many
+ * collision queries each takes. With -tri4test, it checks that the SSE
+ * collision triangle tests give exactly the same results as the scalar ones,
+ * on random triangles, rays and spheres.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <errno.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/time.h>
+#endif
+#include "game.h"
+#include "level.h"
+#include "rendlvl.h"
+#include "loading.h"
+#include "mtltex.h"
+#include "options.h"
+#include "darray.h"
+#include "util.h"
+#include "prof.h"
+#include "tri4.h"
+#include "gaw/gaw.h"
+#include "gaw/gaw_sw.h"
+
+#define FRAME_MSEC		(1000 / 60)
+#define DEF_SPEED		0.25f	/* camera path units per frame */
+#define SDF_TEST_POINTS	100000
+#define COLCMP_ITER		16		/* push-out iterations, as in the old player code */
+#define COLCMP_SLIDES	3
+#define TRI4_TEST_BLOCKS	1024
+
+static int init(void);
+static void cleanup(void);
+static void bench_frame(int frm);
+static int load_path(const char *fname);
+static void gen_path(void);
+static void add_waypoint(const cgm_vec3 *pos);
+static void visit_room(struct room *room);
+static int room_index(const struct room *room);
+static void path_eval(float dist, cgm_vec3 *pos, cgm_vec3 *dir);
+static void print_results(void);
+static long get_usec(void);
+static int cmp_long(const void *a, const void *b);
+static void sdf_report(void);
+static void colcmp_report(void);
+static int tri4_test(int count);
+
+static int fb_width = 640, fb_height = 480;
+static uint32_t *framebuf;
+static int num_frames = 1000;
+static float speed = DEF_SPEED;
+static const char *pathfile;
+static float sdf_voxsz;
+static int colcmp_ticks;
+static int tri4_tests;
+
+static struct level lvl;
+static float proj_mat[16];
+
+/* camera path waypoints, and the distance along the path at each one */
+static cgm_vec3 *wp;
+static float *wpdist;
+static int num_wp, max_wp;
+static unsigned char *visited;
+
+static long *frame_usec;
+static long total_usec;
+
+int main(int argc, char **argv)
+{
+	int i;
+	char *env;
+
+	for(i=1; i<argc; i++) {
+		if(strcmp(argv[i], "-size") == 0 && i < argc - 1) {
+			if(sscanf(argv[++i], "%dx%d", &fb_width, &fb_height) != 2 ||
+					fb_width <= 0 || fb_height <= 0) {
+				fprintf(stderr, "invalid size: %s\n", argv[i]);
+				return 1;
+			}
+		} else if(strcmp(argv[i], "-frames") == 0 && i < argc - 1) {
+			if((num_frames = atoi(argv[++i])) <= 0) {
+				fprintf(stderr, "invalid number of frames: %s\n", argv[i]);
+				return 1;
+			}
+		} else if(strcmp(argv[i], "-speed") == 0 && i < argc - 1) {
+			if((speed = atof(argv[++i])) <= 0.0f) {
+				fprintf(stderr, "invalid speed: %s\n", argv[i]);
+				return 1;
+			}
+		} else if(strcmp(argv[i], "-path") == 0 && i < argc - 1) {
+			pathfile = argv[++i];
+		} else if(strcmp(argv[i], "-sdf") == 0 && i < argc - 1) {
+			if((sdf_voxsz = atof(argv[++i])) <= 0.0f) {
+				fprintf(stderr, "invalid voxel size: %s\n", argv[i]);
+				return 1;
+			}
+		} else if(strcmp(argv[i], "-colcmp") == 0 && i < argc - 1) {
+			if((colcmp_ticks = atoi(argv[++i])) <= 0) {
+				fprintf(stderr, "invalid number of ticks: %s\n", argv[i]);
+				return 1;
+			}
+		} else if(strcmp(argv[i], "-tri4test") == 0 && i < argc - 1) {
+			if((tri4_tests = atoi(argv[++i])) <= 0) {
+				fprintf(stderr, "invalid number of tests: %s\n", argv[i]);
+				return 1;
+			}
+		} else {
+			printf("usage: %s [options]\n", argv[0]);
+			printf("options:\n");
+			printf("  -size <WxH>       framebuffer size (default: 640x480)\n");
+			printf("  -frames <n>       number of frames to draw (default: 1000)\n");
+			printf("  -speed <s>        camera speed in units per frame (default: %g)\n", DEF_SPEED);
+			printf("  -path <file>      camera path, one \"x y z\" point per line\n");
+			printf("  -sdf <size>       bake collision distance fields with this voxel size,\n");
+			printf("                    report their error, and exit\n");
+			printf("  -colcmp <ticks>   compare collision queries of push-out and swept\n");
+			printf("                    spheres over this many moves per speed, and exit\n");
+			printf("  -tri4test <n>     compare SSE and scalar collision triangle tests on\n");
+			printf("                    n random rays and spheres, and exit\n");
+			printf("renderer settings are taken from the same GAW_SW_* environment\n");
+			printf("variables as the SDL version\n");
+			return strcmp(argv[i], "-h") == 0 ? 0 : 1;
+		}
+	}
+
+	if(tri4_tests > 0) {
+		return tri4_test(tri4_tests) == -1 ? 1 : 0;
+	}
+
+	gaw_sw_init();
+	framebuf = malloc_nf(fb_width * fb_height * sizeof *framebuf);
+	gaw_sw_framebuffer(fb_width, fb_height, framebuf);
+	game_reshape(fb_width, fb_height);
+
+	printf("rasterizer threads: %d\n", gaw_sw_threads((env = getenv("GAW_SW_THREADS")) ? atoi(env) : 0));
+	if((env = getenv("GAW_SW_SIMD")) && !atoi(env)) {
+		gaw_sw_simd(0);
+	}
+	if((env = getenv("GAW_SW_ZEPOCH")) && !atoi(env)) {
+		gaw_sw_depth_epoch(0);
+	}
+	if((env = getenv("GAW_SW_HIZ")) && !atoi(env)) {
+		gaw_sw_hiz(0);
+	}
+	if((env = getenv("GAW_SW_GUARDBAND")) && !atoi(env)) {
+		gaw_sw_guard_band(0);
+	}
+	if((env = getenv("GAW_SW_SBUF")) && !atoi(env)) {
+		gaw_sw_span_buffer(0);
+	}
+	if((env = getenv("GAW_SW_SPECIALIZE")) && !atoi(env)) {
+		gaw_sw_specialize(0);
+	}
+	if((env = getenv("GAW_SW_PIPELINE")) && atoi(env)) {
+		gaw_sw_pipeline(1);
+	}
+
+	if(init() == -1) {
+		return 1;
+	}
+	if(sdf_voxsz > 0.0f || colcmp_ticks > 0) {
+		if(sdf_voxsz > 0.0f) {
+			sdf_report();
+		}
+		if(colcmp_ticks > 0) {
+			colcmp_report();
+		}
+		cleanup();
+		return 0;
+	}
+#ifdef DBG_PROFILE
+	if(prof_init() == -1) {
+		return 1;
+	}
+#endif
+
+	frame_usec = malloc_nf(num_frames * sizeof *frame_usec);
+	gaw_sw_reset_stats();
+
+	total_usec = get_usec();
+	for(i=0; i<num_frames; i++) {
+		bench_frame(i);
+	}
+	gaw_sw_flush();
+	total_usec = get_usec() - total_usec;
+
+	print_results();
+	cleanup();
+#ifdef DBG_PROFILE
+	prof_shutdown();
+#endif
+	return 0;
+}
+
+static int init(void)
+{
+	load_options(GAME_CFG_FILE);
+
+	if(iman_init() == -1) {
+		return -1;
+	}
+
+	/* the level loader draws the progress bar */
+	loading_start(2);
+
+	lvl_init(&lvl);
+	lvl.sdf_voxsz = sdf_voxsz;
+	if(lvl_load(&lvl, "data/level1.lvl") == -1) {
+		fprintf(stderr, "failed to load data/level1.lvl\n");
+		return -1;
+	}
+	if(rendlvl_init(&lvl) == -1) {
+		return -1;
+	}
+
+	if(pathfile) {
+		if(load_path(pathfile) == -1) {
+			return -1;
+		}
+	} else {
+		gen_path();
+	}
+	if(num_wp < 2) {
+		fprintf(stderr, "camera path needs at least two points\n");
+		return -1;
+	}
+	printf("camera path: %d points, %.1f units\n", num_wp, wpdist[num_wp - 1]);
+
+	/* same setup as the game screen */
+	gaw_lighting_fast();
+	gaw_fog_fast();
+
+	gaw_enable(GAW_DEPTH_TEST);
+	gaw_enable(GAW_CULL_FACE);
+	gaw_depth_func(GAW_LEQUAL);
+
+	gaw_enable(GAW_LIGHTING);
+	gaw_enable(GAW_LIGHT0);
+	gaw_enable(GAW_LIGHT1);
+	gaw_enable(GAW_LIGHT2);
+	gaw_light_color(0, 1, 1, 1, 1);
+	gaw_light_color(1, 1, 1, 1, 0.6);
+	gaw_light_color(2, 1, 1, 1, 0.5);
+
+	gaw_clear_color(0, 0, 0, 1);
+	gaw_fog_color(0, 0, 0);
+
+	cgm_mperspective(proj_mat, cgm_deg_to_rad(60), win_aspect, 0.1, opt.gfx.drawdist);
+	gaw_matrix_mode(GAW_PROJECTION);
+	gaw_load_matrix(proj_mat);
+	gaw_fog_linear(opt.gfx.drawdist * 0.75, opt.gfx.drawdist);
+
+	if(!lvl_room_at(&lvl, wp[0].x, wp[0].y, wp[0].z)) {
+		fprintf(stderr, "camera path starts outside of the level\n");
+		return -1;
+	}
+	return 0;
+}
+
+static void cleanup(void)
+{
+	rendlvl_destroy();
+	lvl_destroy(&lvl);
+	iman_destroy();
+	gaw_sw_destroy();
+
+	free(framebuf);
+	free(frame_usec);
+	free(wp);
+	free(wpdist);
+}
+
+static void bench_frame(int frm)
+{
+	static struct room *room;
+	struct room *r;
+	float view_mat[16], viewproj[16];
+	cgm_vec3 pos, dir, targ, up = {0, 1, 0};
+	long t0;
+
+	time_msec = frm * FRAME_MSEC;
+
+	/* wrap around at the end of the path */
+	path_eval(fmod(frm * speed, wpdist[num_wp - 1]), &pos, &dir);
+	if(fabs(dir.y) > 0.99f) {
+		cgm_vcons(&up, 0, 0, 1);
+	}
+	targ = pos;
+	cgm_vadd(&targ, &dir);
+	cgm_minv_lookat(view_mat, &pos, &targ, &up);
+
+	cgm_mcopy(viewproj, view_mat);
+	cgm_mmul(viewproj, proj_mat);
+
+	/* keep the last room if the spline cuts through a wall */
+	if((r = lvl_room_at(&lvl, pos.x, pos.y, pos.z))) {
+		room = r;
+	}
+
+	t0 = get_usec();
+
+	gaw_clear(GAW_COLORBUF | GAW_DEPTHBUF);
+
+	rendlvl_setup(room, &pos, viewproj);
+	PROF_BEGIN(PROF_VIS);
+	rendlvl_update();
+	PROF_END(PROF_VIS);
+
+	gaw_matrix_mode(GAW_MODELVIEW);
+	gaw_load_matrix(view_mat);
+
+	gaw_light_dir(0, -1, 1, 5);
+	gaw_light_dir(1, 5, 0, 3);
+	gaw_light_dir(2, -0.5, -2, -3);
+
+	gaw_enable(GAW_FOG);
+	PROF_BEGIN(PROF_RENDER);
+	render_level();
+	PROF_END(PROF_RENDER);
+	gaw_disable(GAW_FOG);
+
+	PROF_BEGIN(PROF_SWAP);
+	game_swap_buffers();
+	PROF_END(PROF_SWAP);
+
+	frame_usec[frm] = get_usec() - t0;
+#ifdef DBG_PROFILE
+	prof_end_frame();
+#endif
+}
+
+static int load_path(const char *fname)
+{
+	FILE *fp;
+	char buf[256];
+	cgm_vec3 pos;
+
+	if(!(fp = fopen(fname, "r"))) {
+		fprintf(stderr, "failed to open camera path: %s: %s\n", fname, strerror(errno));
+		return -1;
+	}
+	while(fgets(buf, sizeof buf, fp)) {
+		if(sscanf(buf, "%f %f %f", &pos.x, &pos.y, &pos.z) == 3) {
+			add_waypoint(&pos);
+		}
+	}
+	fclose(fp);
+	return 0;
+}
+
+/* depth-first tour of the rooms through their portals, starting from the
+ * player start position, going back the same way out of dead ends
+ */
+static void gen_path(void)
+{
+	struct room *start;
+
+	visited = calloc_nf(darr_size(lvl.rooms), 1);
+
+	if(!(start = lvl_room_at(&lvl, lvl.startpos.x, lvl.startpos.y, lvl.startpos.z))) {
+		start = lvl.rooms[0];
+	}
+	add_waypoint(&lvl.startpos);
+	visit_room(start);
+
+	free(visited);
+}
+
+static void visit_room(struct room *room)
+{
+	int i, nportals, idx;
+	cgm_vec3 center;
+	struct portal *p;
+
+	visited[room_index(room)] = 1;
+
+	cgm_vlerp(&center, &room->aabb.vmin, &room->aabb.vmax, 0.5f);
+	add_waypoint(&center);
+
+	nportals = darr_size(room->portals);
+	for(i=0; i<nportals; i++) {
+		p = room->portals + i;
+		if(!p->link || (idx = room_index(p->link)) == -1 || visited[idx]) {
+			continue;
+		}
+
+		add_waypoint(&p->pos);
+		visit_room(p->link);
+		add_waypoint(&p->pos);
+		add_waypoint(&center);
+	}
+}
+
+static int room_index(const struct room *room)
+{
+	int i, nrooms = darr_size(lvl.rooms);
+
+	for(i=0; i<nrooms; i++) {
+		if(lvl.rooms[i] == room) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+static void add_waypoint(const cgm_vec3 *pos)
+{
+	float d;
+
+	/* coincident points would make zero length segments */
+	if(num_wp && cgm_vdist(wp + num_wp - 1, pos) < 1e-3f) {
+		return;
+	}
+
+	if(num_wp >= max_wp) {
+		max_wp = max_wp ? max_wp * 2 : 64;
+		wp = realloc_nf(wp, max_wp * sizeof *wp);
+		wpdist = realloc_nf(wpdist, max_wp * sizeof *wpdist);
+	}
+	d = num_wp ? wpdist[num_wp - 1] + cgm_vdist(wp + num_wp - 1, pos) : 0.0f;
+	wp[num_wp] = *pos;
+	wpdist[num_wp++] = d;
+}
+
+/* Catmull-Rom spline through the waypoints, parameterized by the distance
+ * along the straight segments between them
+ */
+static void path_eval(float dist, cgm_vec3 *pos, cgm_vec3 *dir)
+{
+	int i, seg;
+	float t, tsq, tcub, w[4], dw[4];
+	const cgm_vec3 *p[4];
+
+	for(seg=0; seg<num_wp - 2; seg++) {
+		if(wpdist[seg + 1] > dist) break;
+	}
+	t = (dist - wpdist[seg]) / (wpdist[seg + 1] - wpdist[seg]);
+	tsq = t * t;
+	tcub = tsq * t;
+
+	for(i=0; i<4; i++) {
+		int idx = seg + i - 1;
+		p[i] = wp + (idx < 0 ? 0 : (idx >= num_wp ? num_wp - 1 : idx));
+	}
+
+	w[0] = 0.5f * (-tcub + 2.0f * tsq - t);
+	w[1] = 0.5f * (3.0f * tcub - 5.0f * tsq + 2.0f);
+	w[2] = 0.5f * (-3.0f * tcub + 4.0f * tsq + t);
+	w[3] = 0.5f * (tcub - tsq);
+	dw[0] = 0.5f * (-3.0f * tsq + 4.0f * t - 1.0f);
+	dw[1] = 0.5f * (9.0f * tsq - 10.0f * t);
+	dw[2] = 0.5f * (-9.0f * tsq + 8.0f * t + 1.0f);
+	dw[3] = 0.5f * (3.0f * tsq - 2.0f * t);
+
+	cgm_vcons(pos, 0, 0, 0);
+	cgm_vcons(dir, 0, 0, 0);
+	for(i=0; i<4; i++) {
+		pos->x += p[i]->x * w[i];
+		pos->y += p[i]->y * w[i];
+		pos->z += p[i]->z * w[i];
+		dir->x += p[i]->x * dw[i];
+		dir->y += p[i]->y * dw[i];
+		dir->z += p[i]->z * dw[i];
+	}
+	if(cgm_vlength_sq(dir) < 1e-8f) {
+		*dir = wp[seg + 1];
+		cgm_vsub(dir, wp + seg);
+	}
+	cgm_vnormalize(dir);
+}
+
+static void print_results(void)
+{
+	int i;
+	long *sorted;
+	double mean = 0.0, sec;
+	struct gaw_sw_stats st;
+
+	sorted = malloc_nf(num_frames * sizeof *sorted);
+	memcpy(sorted, frame_usec, num_frames * sizeof *sorted);
+	qsort(sorted, num_frames, sizeof *sorted, cmp_long);
+
+	for(i=0; i<num_frames; i++) {
+		mean += sorted[i];
+	}
+	mean /= num_frames;
+
+	gaw_sw_stats(&st);
+	sec = total_usec / 1000000.0;
+
+	printf("%d frames at %dx%d in %.3f sec (%.2f fps)\n", num_frames, fb_width,
+			fb_height, sec, num_frames / sec);
+	printf("ms/frame: mean %.3f, p50 %.3f, p95 %.3f, p99 %.3f, max %.3f\n",
+			mean / 1000.0, sorted[num_frames / 2] / 1000.0,
+			sorted[num_frames * 95 / 100] / 1000.0,
+			sorted[num_frames * 99 / 100] / 1000.0,
+			sorted[num_frames - 1] / 1000.0);
+	printf("polygons: %.1f/frame, %.3f M/sec\n", (double)st.polys / num_frames,
+			st.polys / sec / 1000000.0);
+	printf("pixels: %.1f/frame, %.3f M/sec\n", (double)st.pixels / num_frames,
+			st.pixels / sec / 1000000.0);
+	if(st.tris) {
+		printf("indexed triangles: %.1f/frame, %.3f M/sec\n", (double)st.tris / num_frames,
+				st.tris / sec / 1000000.0);
+	}
+
+	free(sorted);
+}
+
+static int cmp_long(const void *a, const void *b)
+{
+	long x = *(long*)a;
+	long y = *(long*)b;
+	return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+static long get_usec(void)
+{
+#ifdef _WIN32
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER cnt;
+
+	if(!freq.QuadPart) {
+		QueryPerformanceFrequency(&freq);
+	}
+	QueryPerformanceCounter(&cnt);
+	return (long)(cnt.QuadPart * 1000000 / freq.QuadPart);
+#else
+	static struct timeval tv0;
+	struct timeval tv;
+
+	if(!tv0.tv_sec) {
+		gettimeofday(&tv0, 0);
+	}
+	gettimeofday(&tv, 0);
+	return (tv.tv_sec - tv0.tv_sec) * 1000000 + tv.tv_usec - tv0.tv_usec;
+#endif
+}
+
+
+/* null platform layer */
+long game_getmsec(void)
+{
+	return time_msec;
+}
+
+void game_swap_buffers(void)
+{
+	gaw_sw_end_frame();
+}
+
+void game_quit(void)
+{
+}
+
+void game_resize(int x, int y)
+{
+}
+
+void game_fullscreen(int fs)
+{
+}
+
+void game_grabmouse(int grab)
+{
+}
+
+void game_vsync(int vsync)
+{
+}
+
+/* compare the distance fields to the exact distances from the triangles at
+ * random points, and check that sphere tests never get a wrong answer from
+ * them, only fall back to the triangles
+ */
+static void sdf_report(void)
+{
+	int i, j, num_rooms, res, hit, nerr, wrong, count[3];
+	struct room *room;
+	struct sdf *sdf;
+	struct trihit th;
+	cgm_vec3 pt, ext;
+	float d, dexact, err, maxerr;
+	double sumerr;
+
+	num_rooms = darr_size(lvl.rooms);
+	for(i=0; i<num_rooms; i++) {
+		room = lvl.rooms[i];
+		if(!(sdf = room->sdf)) continue;
+
+		cgm_vcons(&ext, sdf->size[0], sdf->size[1], sdf->size[2]);
+		cgm_vscale(&ext, sdf->voxsz * SDF_BRICK);
+
+		maxerr = 0.0f;
+		sumerr = 0.0;
+		nerr = wrong = 0;
+		count[0] = count[1] = count[2] = 0;
+
+		for(j=0; j<SDF_TEST_POINTS; j++) {
+			pt.x = sdf->org.x + ext.x * rand() / RAND_MAX;
+			pt.y = sdf->org.y + ext.y * rand() / RAND_MAX;
+			pt.z = sdf->org.z + ext.z * rand() / RAND_MAX;
+
+			if(bvh_sphtest(room->bvh, &pt, sdf->band, &th)) {
+				dexact = sqrt(th.t);
+				if((d = sdf_dist(sdf, &pt, 0)) >= 0.0f) {
+					err = fabs(d - dexact);
+					if(err > maxerr) maxerr = err;
+					sumerr += err;
+					nerr++;
+				}
+			}
+
+			res = sdf_sphtest(sdf, &pt, COL_RADIUS, 0);
+			hit = bvh_sphtest(room->bvh, &pt, COL_RADIUS, 0);
+			if((res == SDF_MISS && hit) || (res == SDF_HIT && !hit)) {
+				wrong++;
+			}
+			count[res]++;
+		}
+
+		printf("%s: %d bricks, error max %g mean %g (voxel %g)\n", room->name,
+				sdf->num_bricks, maxerr, nerr ? sumerr / nerr : 0.0, sdf->voxsz);
+		printf("  sphere tests: %.1f%% miss, %.1f%% hit, %.1f%% exact, %d wrong\n",
+				100.0f * count[SDF_MISS] / SDF_TEST_POINTS,
+				100.0f * count[SDF_HIT] / SDF_TEST_POINTS,
+				100.0f * count[SDF_UNSURE] / SDF_TEST_POINTS, wrong);
+	}
+}
+
+/* random walk through the level with the player collision radius: heads in a
+ * random direction for a while, then picks another, and starts over from the
+ * player start position if it gets lost. Both methods get the same sequence
+ * of directions. Collision calls are lvl_collision_rad calls for the push-out
+ * and sweeps for the swept spheres. Each of them may query more than one bvh,
+ * which the profiler counts, if enabled. Tunnels are moves whose center path
+ * crosses a triangle of the room it starts or ends in.
+ */
+static void colcmp_report(void)
+{
+	static const float speeds[] = {0.05f, 0.1f, 0.2f, 0.5f, 1.0f};
+	int i, j, mode, iter, ncalls, maxcalls, tunnels, lost;
+	long calls;
+	struct room *room, *start, *r;
+	struct collision col;
+	cgm_vec3 pos, prev, vel, dir;
+	cgm_ray ray;
+	float dist;
+#ifdef DBG_PROFILE
+	unsigned long q0, nodes0, tris0, queries, nodes, tris;
+#endif
+
+	if(!(start = lvl_room_at(&lvl, lvl.startpos.x, lvl.startpos.y, lvl.startpos.z))) {
+		fprintf(stderr, "colcmp: player start position is outside of the level\n");
+		return;
+	}
+
+	for(i=0; i<sizeof speeds / sizeof *speeds; i++) {
+		for(mode=0; mode<2; mode++) {
+			srand(1);
+			pos = lvl.startpos;
+			room = start;
+			calls = 0;
+			maxcalls = tunnels = lost = 0;
+			dist = 0.0f;
+#ifdef DBG_PROFILE
+			queries = nodes = tris = 0;
+#endif
+
+			for(j=0; j<colcmp_ticks; j++) {
+				if(j % 100 == 0) {
+					cgm_vcons(&dir, (float)rand() / RAND_MAX - 0.5f,
+							(float)rand() / RAND_MAX - 0.5f, (float)rand() / RAND_MAX - 0.5f);
+					cgm_vnormalize(&dir);
+				}
+				vel = dir;
+				cgm_vscale(&vel, speeds[i]);
+				prev = pos;
+
+#ifdef DBG_PROFILE
+				q0 = prof_count[PROF_COLQ];
+				nodes0 = prof_count[PROF_COLNODES];
+				tris0 = prof_count[PROF_COLTRIS];
+#endif
+				if(mode == 0) {
+					iter = ncalls = 0;
+					while(cgm_vlength_sq(&vel) > 1e-5 && iter++ < COLCMP_ITER) {
+						ncalls++;
+						if(!lvl_collision_rad(&lvl, room, &pos, &vel, COL_RADIUS, &col)) {
+							break;
+						}
+						cgm_vadd_scaled(&vel, &col.norm, -cgm_vdot(&vel, &col.norm));
+					}
+					if(iter < COLCMP_ITER) {
+						cgm_vadd(&pos, &vel);
+					}
+				} else {
+					ncalls = lvl_move_sphere(&lvl, room, &pos, &vel, COL_RADIUS, COLCMP_SLIDES);
+				}
+#ifdef DBG_PROFILE
+				queries += prof_count[PROF_COLQ] - q0;
+				nodes += prof_count[PROF_COLNODES] - nodes0;
+				tris += prof_count[PROF_COLTRIS] - tris0;
+#endif
+				calls += ncalls;
+				if(ncalls > maxcalls) maxcalls = ncalls;
+				dist += cgm_vdist(&prev, &pos);
+
+				if(!(r = lvl_track_room(&lvl, room, &prev, &pos))) {
+					lost++;
+					pos = lvl.startpos;
+					room = start;
+					continue;
+				}
+				ray.origin = prev;
+				ray.dir = pos;
+				cgm_vsub(&ray.dir, &prev);
+				if(bvh_raytest(room->bvh, &ray, 1.0f, 0) || (r != room &&
+							bvh_raytest(r->bvh, &ray, 1.0f, 0))) {
+					tunnels++;
+				}
+				room = r;
+			}
+
+			printf("%s speed %.2f: %.2f calls/move (max %d), moved %.1f, %d tunnels, %d lost\n",
+					mode ? "sweep  " : "pushout", speeds[i], (float)calls / colcmp_ticks,
+					maxcalls, dist, tunnels, lost);
+#ifdef DBG_PROFILE
+			printf("  %.2f bvh queries/move, %.1f nodes, %.1f tris\n",
+					(float)queries / colcmp_ticks, (float)nodes / colcmp_ticks,
+					(float)tris / colcmp_ticks);
+#endif
+		}
+	}
+}
+
+static float frand(float lo, float hi)
+{
+	return lo + (hi - lo) * rand() / (float)RAND_MAX;
+}
+
+static void rand_vec(cgm_vec3 *v, float range)
+{
+	v->x = frand(-range, range);
+	v->y = frand(-range, range);
+	v->z = frand(-range, range);
+}
+
+/* the scalar tests are the reference, and the SSE versions do the same
+ * arithmetic, so any difference at all is a bug. Blocks have 1 to 4 lanes
+ * used, and a few degenerate triangles. Returns -1 on mismatches.
+ */
+static int tri4_test(int count)
+{
+	int i, j, nlanes, lref, lsimd, wrong, hits[2];
+	struct tri4 *blocks, *blk;
+	struct triangle tri;
+	cgm_vec3 cent, v[3];
+	cgm_ray ray;
+	float rad, tref, tsimd;
+
+	if(!tri4_simd(1)) {
+		printf("tri4: no SSE version in this build, nothing to compare\n");
+		return 0;
+	}
+
+	srand(1);
+	blocks = malloc_nf(TRI4_TEST_BLOCKS * sizeof *blocks);
+	for(i=0; i<TRI4_TEST_BLOCKS; i++) {
+		tri4_init(blocks + i);
+		nlanes = 1 + rand() % TRI4_LANES;
+		for(j=0; j<nlanes; j++) {
+			rand_vec(&cent, 10.0f);
+			rand_vec(v, 3.0f);
+			rand_vec(v + 1, 3.0f);
+			rand_vec(v + 2, 3.0f);
+			switch(rand() % 50) {
+			case 0:
+				v[2] = v[0];	/* two coincident vertices */
+				break;
+			case 1:
+				v[1] = v[0];	/* all three on a line */
+				cgm_vscale(v + 1, 0.5f);
+				v[2] = v[0];
+				cgm_vscale(v + 2, 0.25f);
+				break;
+			default:
+				break;
+			}
+			cgm_vadd(v, &cent);
+			cgm_vadd(v + 1, &cent);
+			cgm_vadd(v + 2, &cent);
+			tri_cons(&tri, v, v + 1, v + 2);
+			tri4_set(blocks + i, j, &tri, i * TRI4_LANES + j);
+		}
+	}
+
+	wrong = hits[0] = hits[1] = 0;
+	for(i=0; i<count; i++) {
+		blk = blocks + rand() % TRI4_TEST_BLOCKS;
+
+		rand_vec(&ray.origin, 15.0f);
+		rand_vec(&ray.dir, 20.0f);
+		if(rand() % 20 == 0) ray.dir.x = 0.0f;
+		tref = tsimd = (i & 1) ? 1.0f : frand(0.1f, 3.0f);
+		lref = tri4_ray_ref(blk, &ray, &tref);
+		lsimd = tri4_ray(blk, &ray, &tsimd);
+		if(lref != lsimd || tref != tsimd) {
+			if(wrong++ < 10) {
+				printf("tri4 ray mismatch: lane %d/%d, t %g/%g\n", lref, lsimd, tref, tsimd);
+			}
+		}
+		if(lref >= 0) hits[0]++;
+
+		rad = frand(0.1f, 5.0f);
+		tref = tsimd = (i & 2) ? FLT_MAX : frand(0.0f, 10.0f);
+		lref = tri4_sphere_ref(blk, &ray.origin, rad, &tref);
+		lsimd = tri4_sphere(blk, &ray.origin, rad, &tsimd);
+		if(lref != lsimd || tref != tsimd) {
+			if(wrong++ < 10) {
+				printf("tri4 sphere mismatch: lane %d/%d, dsq %g/%g\n", lref, lsimd, tref, tsimd);
+			}
+		}
+		if(lref >= 0) hits[1]++;
+	}
+	free(blocks);
+
+	printf("tri4: %d rays (%d hits), %d spheres (%d hits), %d mismatches\n", count,
+			hits[0], count, hits[1], wrong);
+	return wrong ? -1 : 0;
+}
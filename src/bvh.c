@@ -0,0 +1,536 @@
+/*
+Deep Runner - 6dof shooter game for the SGI O2.
+Copyright (C) 2023  John Tsiombikas <nuclear@mutantstargoat.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <float.h>
+#include "bvh.h"
+#include "util.h"
+#include "darray.h"
+#include "prof.h"
+
+#define LEAF_TRIS		TRI4_LANES	/* never split nodes with this many triangles or less */
+#define MAX_LEAF_TRIS	65535	/* ... and always split nodes with more than this */
+#define NUM_BINS		16
+#define TRAV_COST		1.0f	/* cost of visiting a node, relative to a triangle test */
+#define MAX_SAH_DEPTH	32		/* below this, split at the median */
+#define MAX_STACK		64
+
+#define VELEM(v, i)		((&(v)->x)[i])
+
+struct bin {
+	struct aabox aabb;
+	int count;
+};
+
+static int build_node(struct bvh *bvh, unsigned int *idx, const struct aabox *tribox,
+		const cgm_vec3 *cent, int start, int count, int depth);
+static void build_blocks(struct bvh *bvh, const unsigned int *idx);
+static float box_area(const struct aabox *box);
+static int seg_box(const cgm_vec3 *org, const cgm_vec3 *dir, const cgm_vec3 *invdir,
+		const struct aabox *box, float rad, float tmax);
+
+
+struct bvh *bvh_create(void)
+{
+	struct bvh *bvh = calloc_nf(1, sizeof *bvh);
+	bvh->tris = darr_alloc(0, sizeof *bvh->tris);
+	return bvh;
+}
+
+void bvh_free(struct bvh *bvh)
+{
+	if(!bvh) return;
+
+	free(bvh->nodes);
+	free(bvh->blocks);
+	darr_free(bvh->tris);
+	free(bvh);
+}
+
+int bvh_addtri(struct bvh *bvh, const struct triangle *tri)
+{
+	if(bvh->nodes) {
+		fprintf(stderr, "bvh_addtri: trying to add triangles to a constructed bvh\n");
+		return -1;
+	}
+	darr_push(bvh->tris, (void*)tri);
+	return 0;
+}
+
+int bvh_build(struct bvh *bvh)
+{
+	int i, j, ntris;
+	unsigned int *idx;
+	struct aabox *tribox;
+	cgm_vec3 *cent;
+
+	if(bvh->nodes) {
+		fprintf(stderr, "bvh_build: already constructed\n");
+		return -1;
+	}
+	if(!(ntris = darr_size(bvh->tris))) {
+		return 0;
+	}
+
+	tribox = malloc_nf(ntris * sizeof *tribox);
+	cent = malloc_nf(ntris * sizeof *cent);
+	idx = malloc_nf(ntris * sizeof *idx);
+
+	for(i=0; i<ntris; i++) {
+		aabox_init(tribox + i);
+		for(j=0; j<3; j++) {
+			aabox_union_point(tribox + i, bvh->tris[i].v + j);
+		}
+		cent[i].x = (tribox[i].vmin.x + tribox[i].vmax.x) * 0.5f;
+		cent[i].y = (tribox[i].vmin.y + tribox[i].vmax.y) * 0.5f;
+		cent[i].z = (tribox[i].vmin.z + tribox[i].vmax.z) * 0.5f;
+		idx[i] = i;
+	}
+
+	/* a binary tree with single-triangle leaves has 2n - 1 nodes */
+	bvh->nodes = malloc_nf((2 * ntris - 1) * sizeof *bvh->nodes);
+	bvh->num_nodes = 0;
+	build_node(bvh, idx, tribox, cent, 0, ntris, 0);
+	bvh->nodes = realloc_nf(bvh->nodes, bvh->num_nodes * sizeof *bvh->nodes);
+
+	build_blocks(bvh, idx);
+
+	free(idx);
+	free(tribox);
+	free(cent);
+	return 0;
+}
+
+static void make_leaf(struct bvhnode *node, int start, int count)
+{
+	node->offs = start;
+	node->count = count;
+	node->axis = 0;
+}
+
+static int build_node(struct bvh *bvh, unsigned int *idx, const struct aabox *tribox,
+		const cgm_vec3 *cent, int start, int count, int depth)
+{
+	int i, j, b, axis, nodeidx, best_axis, best_split, nleft, cnt_left[NUM_BINS];
+	unsigned int tmp, *nidx = idx + start;
+	float ext, scale, cost, best_cost, area_left[NUM_BINS];
+	struct aabox cbox, box;
+	struct bin bins[NUM_BINS];
+	struct bvhnode *node;
+
+	nodeidx = bvh->num_nodes++;
+	node = bvh->nodes + nodeidx;
+
+	aabox_init(&node->aabb);
+	aabox_init(&cbox);
+	for(i=0; i<count; i++) {
+		aabox_union(&node->aabb, tribox + nidx[i]);
+		aabox_union_point(&cbox, cent + nidx[i]);
+	}
+
+	if(count <= LEAF_TRIS) {
+		make_leaf(node, start, count);
+		return nodeidx;
+	}
+
+	/* binned SAH: sort the triangle centroids into bins along each axis, and
+	 * evaluate the cost of splitting between every pair of bins.
+	 */
+	best_axis = -1;
+	best_split = 0;
+	best_cost = FLT_MAX;
+
+	for(axis=0; axis<3; axis++) {
+		ext = VELEM(&cbox.vmax, axis) - VELEM(&cbox.vmin, axis);
+		if(ext < 1e-6f) continue;
+		scale = (float)NUM_BINS / ext;
+
+		for(i=0; i<NUM_BINS; i++) {
+			aabox_init(&bins[i].aabb);
+			bins[i].count = 0;
+		}
+		for(i=0; i<count; i++) {
+			b = (int)((VELEM(cent + nidx[i], axis) - VELEM(&cbox.vmin, axis)) * scale);
+			if(b >= NUM_BINS) b = NUM_BINS - 1;
+			aabox_union(&bins[b].aabb, tribox + nidx[i]);
+			bins[b].count++;
+		}
+
+		/* area_left[i]/cnt_left[i]: everything left of split i (bins 0 to i-1) */
+		aabox_init(&box);
+		nleft = 0;
+		for(i=1; i<NUM_BINS; i++) {
+			aabox_union(&box, &bins[i - 1].aabb);
+			nleft += bins[i - 1].count;
+			area_left[i] = nleft ? box_area(&box) : 0.0f;
+			cnt_left[i] = nleft;
+		}
+
+		aabox_init(&box);
+		for(i=NUM_BINS-1; i>0; i--) {
+			aabox_union(&box, &bins[i].aabb);
+			if(!cnt_left[i] || cnt_left[i] == count) continue;
+
+			cost = area_left[i] * cnt_left[i] + box_area(&box) * (count - cnt_left[i]);
+			if(cost < best_cost) {
+				best_cost = cost;
+				best_axis = axis;
+				best_split = i;
+			}
+		}
+	}
+
+	if(best_axis >= 0 && depth < MAX_SAH_DEPTH) {
+		/* split only if it's cheaper than testing all the triangles */
+		best_cost = TRAV_COST + best_cost / box_area(&node->aabb);
+		if(best_cost >= (float)count && count <= MAX_LEAF_TRIS) {
+			make_leaf(node, start, count);
+			return nodeidx;
+		}
+
+		scale = (float)NUM_BINS / (VELEM(&cbox.vmax, best_axis) - VELEM(&cbox.vmin, best_axis));
+		i = 0;
+		j = count - 1;
+		while(i <= j) {
+			b = (int)((VELEM(cent + nidx[i], best_axis) - VELEM(&cbox.vmin, best_axis)) * scale);
+			if(b >= NUM_BINS) b = NUM_BINS - 1;
+			if(b < best_split) {
+				i++;
+			} else {
+				tmp = nidx[i];
+				nidx[i] = nidx[j];
+				nidx[j--] = tmp;
+			}
+		}
+		nleft = i;
+		axis = best_axis;
+	} else {
+		/* all centroids in the same spot, or too deep: nothing to gain from
+		 * splitting, except to keep the leaf size in range.
+		 */
+		if(count <= MAX_LEAF_TRIS && depth < MAX_SAH_DEPTH) {
+			make_leaf(node, start, count);
+			return nodeidx;
+		}
+		nleft = count / 2;
+		axis = 0;
+	}
+
+	if(nleft <= 0 || nleft >= count) {
+		nleft = count / 2;
+	}
+
+	build_node(bvh, idx, tribox, cent, start, nleft, depth + 1);
+	i = build_node(bvh, idx, tribox, cent, start + nleft, count - nleft, depth + 1);
+
+	node->offs = i;
+	node->count = 0;
+	node->axis = axis;
+	return nodeidx;
+}
+
+/* pack the triangles of each leaf into consecutive tri4 blocks, and point the
+ * leaf to the first one instead of its range in the index array.
+ */
+static void build_blocks(struct bvh *bvh, const unsigned int *idx)
+{
+	int i, j, lane;
+	struct bvhnode *node;
+	struct tri4 *blk;
+
+	bvh->num_blocks = 0;
+	for(i=0; i<bvh->num_nodes; i++) {
+		bvh->num_blocks += (bvh->nodes[i].count + TRI4_LANES - 1) / TRI4_LANES;
+	}
+	bvh->blocks = malloc_nf(bvh->num_blocks * sizeof *bvh->blocks);
+
+	blk = bvh->blocks;
+	for(i=0; i<bvh->num_nodes; i++) {
+		node = bvh->nodes + i;
+		if(!node->count) continue;
+
+		for(j=0; j<node->count; j++) {
+			if((lane = j % TRI4_LANES) == 0) {
+				tri4_init(blk + j / TRI4_LANES);
+			}
+			tri4_set(blk + j / TRI4_LANES, lane, bvh->tris + idx[node->offs + j],
+					idx[node->offs + j]);
+		}
+		node->offs = blk - bvh->blocks;
+		blk += (node->count + TRI4_LANES - 1) / TRI4_LANES;
+	}
+}
+
+static float box_area(const struct aabox *box)
+{
+	float dx = box->vmax.x - box->vmin.x;
+	float dy = box->vmax.y - box->vmin.y;
+	float dz = box->vmax.z - box->vmin.z;
+	return 2.0f * (dx * dy + dy * dz + dz * dx);
+}
+
+/* does the segment org + dir * [0, tmax] pass within rad of the box */
+static int seg_box(const cgm_vec3 *org, const cgm_vec3 *dir, const cgm_vec3 *invdir,
+		const struct aabox *box, float rad, float tmax)
+{
+	int i;
+	float t0, t1, tmp, tmin = 0.0f;
+
+	for(i=0; i<3; i++) {
+		if(VELEM(dir, i) == 0.0f) {
+			if(VELEM(org, i) < VELEM(&box->vmin, i) - rad || VELEM(org, i) > VELEM(&box->vmax, i) + rad) {
+				return 0;
+			}
+			continue;
+		}
+		t0 = (VELEM(&box->vmin, i) - rad - VELEM(org, i)) * VELEM(invdir, i);
+		t1 = (VELEM(&box->vmax, i) + rad - VELEM(org, i)) * VELEM(invdir, i);
+		if(t0 > t1) {
+			tmp = t0;
+			t0 = t1;
+			t1 = tmp;
+		}
+		if(t0 > tmin) tmin = t0;
+		if(t1 < tmax) tmax = t1;
+		if(tmax < tmin) return 0;
+	}
+	return 1;
+}
+
+static void calc_invdir(cgm_vec3 *invdir, const cgm_vec3 *dir)
+{
+	invdir->x = dir->x != 0.0f ? 1.0f / dir->x : 0.0f;
+	invdir->y = dir->y != 0.0f ? 1.0f / dir->y : 0.0f;
+	invdir->z = dir->z != 0.0f ? 1.0f / dir->z : 0.0f;
+}
+
+/* push the children of node on the stack, so that the one nearer to the start
+ * of dir is popped first
+ */
+#define PUSH_ORDERED(node, dir) \
+	do { \
+		unsigned int first = (node) - bvh->nodes + 1; \
+		if(VELEM(dir, (node)->axis) < 0.0f) { \
+			stack[top++] = first; \
+			stack[top++] = (node)->offs; \
+		} else { \
+			stack[top++] = (node)->offs; \
+			stack[top++] = first; \
+		} \
+	} while(0)
+
+int bvh_raytest(const struct bvh *bvh, const cgm_ray *ray, float tmax, struct trihit *hitptr)
+{
+	int i, top, lane, nblk;
+	unsigned int stack[MAX_STACK];
+	const struct bvhnode *node;
+	const struct tri4 *blk;
+	struct trihit hit0 = {FLT_MAX};
+	cgm_vec3 invdir;
+	float t;
+
+	if(!bvh || !bvh->num_nodes) return 0;
+	PROF_COUNT(PROF_COLQ, 1);
+
+	calc_invdir(&invdir, &ray->dir);
+
+	stack[0] = 0;
+	top = 1;
+	while(top > 0) {
+		node = bvh->nodes + stack[--top];
+		PROF_COUNT(PROF_COLNODES, 1);
+
+		/* tmax shrinks to the nearest hit so far, skipping everything behind it */
+		if(!seg_box(&ray->origin, &ray->dir, &invdir, &node->aabb, 0.0f, tmax)) {
+			continue;
+		}
+
+		if(node->count) {
+			PROF_COUNT(PROF_COLTRIS, node->count);
+			blk = bvh->blocks + node->offs;
+			nblk = (node->count + TRI4_LANES - 1) / TRI4_LANES;
+			for(i=0; i<nblk; i++) {
+				t = tmax;
+				if((lane = tri4_ray(blk + i, ray, &t)) >= 0 && t < hit0.t) {
+					if(!hitptr) return 1;
+					hit0.t = tmax = t;
+					hit0.tri = bvh->tris + blk[i].idx[lane];
+				}
+			}
+		} else {
+			PUSH_ORDERED(node, &ray->dir);
+		}
+	}
+
+	if(hit0.tri) {
+		if(hitptr) {
+			cgm_raypos(&hit0.pt, ray, hit0.t);
+			*hitptr = hit0;
+		}
+		return 1;
+	}
+	return 0;
+}
+
+int bvh_sphtest(const struct bvh *bvh, const cgm_vec3 *pt, float rad, struct trihit *hitptr)
+{
+	int i, top, lane, nblk;
+	unsigned int stack[MAX_STACK], first;
+	const struct bvhnode *node;
+	const struct tri4 *blk;
+	struct trihit hit0 = {FLT_MAX};
+	float dist0, dist1, maxdsq;
+
+	if(!bvh || !bvh->num_nodes) return 0;
+	PROF_COUNT(PROF_COLQ, 1);
+
+	maxdsq = rad * rad;
+
+	stack[0] = 0;
+	top = 1;
+	while(top > 0) {
+		node = bvh->nodes + stack[--top];
+		PROF_COUNT(PROF_COLNODES, 1);
+
+		/* skip nodes further than the nearest triangle so far */
+		if(aabox_distsq(&node->aabb, pt) > maxdsq) {
+			continue;
+		}
+
+		if(node->count) {
+			PROF_COUNT(PROF_COLTRIS, node->count);
+			blk = bvh->blocks + node->offs;
+			nblk = (node->count + TRI4_LANES - 1) / TRI4_LANES;
+			for(i=0; i<nblk; i++) {
+				/* only accepts triangles nearer than hit0.t, and updates it */
+				if((lane = tri4_sphere(blk + i, pt, rad, &hit0.t)) >= 0) {
+					if(!hitptr) return 1;
+					hit0.tri = bvh->tris + blk[i].idx[lane];
+					maxdsq = hit0.t;
+				}
+			}
+		} else {
+			first = node - bvh->nodes + 1;
+			dist0 = aabox_distsq(&bvh->nodes[first].aabb, pt);
+			dist1 = aabox_distsq(&bvh->nodes[node->offs].aabb, pt);
+			if(dist0 < dist1) {
+				stack[top++] = node->offs;
+				stack[top++] = first;
+			} else {
+				stack[top++] = first;
+				stack[top++] = node->offs;
+			}
+		}
+	}
+
+	if(hit0.tri) {
+		if(hitptr) {
+			tri_proj_pt(&hit0.pt, hit0.tri, pt);
+			*hitptr = hit0;
+		}
+		return 1;
+	}
+	return 0;
+}
+
+int bvh_sweeptest(const struct bvh *bvh, const cgm_vec3 *pos, const cgm_vec3 *vel,
+		float rad, struct trihit *hitptr)
+{
+	int i, top;
+	unsigned int stack[MAX_STACK];
+	const struct bvhnode *node;
+	const struct tri4 *blk;
+	const struct triangle *tri;
+	struct trihit hit, hit0 = {FLT_MAX};
+	cgm_vec3 invdir;
+	float tmax = 1.0f;
+
+	if(!bvh || !bvh->num_nodes) return 0;
+	PROF_COUNT(PROF_COLQ, 1);
+
+	calc_invdir(&invdir, vel);
+
+	stack[0] = 0;
+	top = 1;
+	while(top > 0) {
+		node = bvh->nodes + stack[--top];
+		PROF_COUNT(PROF_COLNODES, 1);
+
+		if(!seg_box(pos, vel, &invdir, &node->aabb, rad, tmax)) {
+			continue;
+		}
+
+		if(node->count) {
+			PROF_COUNT(PROF_COLTRIS, node->count);
+			blk = bvh->blocks + node->offs;
+			for(i=0; i<node->count; i++) {
+				tri = bvh->tris + blk[i / TRI4_LANES].idx[i % TRI4_LANES];
+				if(tri_sweep_sphere(tri, pos, vel, rad, tmax, &hit) && hit.t < hit0.t) {
+					if(!hitptr) return 1;
+					hit0 = hit;
+					tmax = hit.t;
+				}
+			}
+		} else {
+			PUSH_ORDERED(node, vel);
+		}
+	}
+
+	if(hit0.tri) {
+		if(hitptr) *hitptr = hit0;
+		return 1;
+	}
+	return 0;
+}
+
+int bvh_boxtest(const struct bvh *bvh, const struct aabox *box)
+{
+	int i, top, count;
+	unsigned int stack[MAX_STACK];
+	const struct bvhnode *node;
+	const struct tri4 *blk;
+
+	if(!bvh || !bvh->num_nodes) return 0;
+	PROF_COUNT(PROF_COLQ, 1);
+
+	stack[0] = 0;
+	top = 1;
+	while(top > 0) {
+		node = bvh->nodes + stack[--top];
+		PROF_COUNT(PROF_COLNODES, 1);
+
+		if(!aabox_aabox_test(&node->aabb, box)) {
+			continue;
+		}
+
+		if(node->count) {
+			PROF_COUNT(PROF_COLTRIS, node->count);
+			blk = bvh->blocks + node->offs;
+			count = node->count;
+			for(i=0; i<count; i++) {
+				if(aabox_tri_test(box, bvh->tris + blk[i / TRI4_LANES].idx[i % TRI4_LANES])) {
+					return 1;
+				}
+			}
+		} else {
+			stack[top++] = node->offs;
+			stack[top++] = node - bvh->nodes + 1;
+		}
+	}
+	return 0;
+}
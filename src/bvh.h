@@ -0,0 +1,77 @@
+/*
+Deep Runner - 6dof shooter game for the SGI O2.
+Copyright (C) 2023  John Tsiombikas <nuclear@mutantstargoat.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef BVH_H_
+#define BVH_H_
+
+#include "geom.h"
+#include "tri4.h"
+
+/* Bounding volume hierarchy for collision queries against static triangles.
+ *
+ * Triangles are added with bvh_addtri, and bvh_build sorts them into a binary
+ * tree using the surface area heuristic. The nodes are stored depth-first in
+ * a single array: the first child of an inner node follows it directly, and
+ * leaves refer to a range of tri4 blocks, which hold the precomputed data for
+ * the ray and sphere tests, and the indices of their triangles. The trihit
+ * triangle pointers returned by the queries point into the tris array, and
+ * stay valid for the life of the bvh.
+ */
+
+struct bvhnode {
+	struct aabox aabb;
+	unsigned int offs;		/* inner: index of the second child, leaf: first block */
+	unsigned short count;	/* number of triangles in leaves, 0 for inner nodes */
+	unsigned short axis;	/* split axis of inner nodes */
+};
+
+struct bvh {
+	struct bvhnode *nodes;
+	int num_nodes;
+
+	struct tri4 *blocks;	/* triangles of each leaf, in groups of 4 */
+	int num_blocks;
+
+	struct triangle *tris;	/* darr */
+};
+
+struct bvh *bvh_create(void);
+void bvh_free(struct bvh *bvh);
+
+int bvh_addtri(struct bvh *bvh, const struct triangle *tri);
+int bvh_build(struct bvh *bvh);
+
+/* nearest intersection of the ray up to tmax. Without a hit pointer it stops at
+ * the first triangle hit.
+ */
+int bvh_raytest(const struct bvh *bvh, const cgm_ray *ray, float tmax, struct trihit *hit);
+
+/* nearest triangle within rad of pt. hit->t is the squared distance, like
+ * tri_sphere_test.
+ */
+int bvh_sphtest(const struct bvh *bvh, const cgm_vec3 *pt, float rad, struct trihit *hit);
+
+/* first contact of a sphere moving from pos to pos + vel. hit->t is the
+ * fraction of vel travelled, and hit->pt the contact point on the triangle.
+ */
+int bvh_sweeptest(const struct bvh *bvh, const cgm_vec3 *pos, const cgm_vec3 *vel,
+		float rad, struct trihit *hit);
+
+/* any triangle intersecting the box */
+int bvh_boxtest(const struct bvh *bvh, const struct aabox *box);
+
+#endif	/* BVH_H_ */
@@ -8,6 +8,7 @@
 #define MISSILE_DAMAGE	64
 #define MISSILE_COOLDOWN	250
 #define MISSILE_SPEED	1.0f
+#define MISSILE_RAD		0.1f
 #define DMG_OVERLAY_DUR	128
 #define SHIELD_OVERLAY_DUR	80
 #define EXPL_FRAME_DUR	32
@@ -23,15 +24,16 @@
 #undef DBG_NOSEED
 #undef DBG_ESCQUIT
 #undef DBG_FPEXCEPT
+#undef DBG_PROFILE
 
 #define DBG_NOPSYS
-#define DBG_NO_OCTREE
 #undef DBG_SHOW_COLPOLY
 #define DBG_FREEZEVIS
 #undef DBG_SHOW_CUR_ROOM
 #undef DBG_ONLY_CUR_ROOM
 #undef DBG_ALL_ROOMS
 #undef DBG_SHOW_MAX_COL_ITER
+#undef DBG_ITER_COLLISION
 #define DBG_NO_IMAN
 #undef DBG_SHOW_PORTALS
 #undef DBG_SHOW_FRUST
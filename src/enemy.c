@@ -121,15 +121,19 @@ void enemy_shoot(struct enemy *mob, const cgm_vec3 *dir)
 void enemy_move(struct enemy *mob, const cgm_vec3 *dir, float speed)
 {
 	int i, count;
+#ifdef DBG_ITER_COLLISION
 	struct collision col;
+#endif
 	struct room *room = mob->room;
 
 	cgm_vec3 vel = *dir;
 	cgm_vscale(&vel, speed);
 
+#ifdef DBG_ITER_COLLISION
 	if(lvl_collision_rad(mob->lvl, room, &mob->pos, &vel, mob->rad, &col)) {
 		return;
 	}
+#endif
 
 	count = darr_size(room->enemies);
 	for(i=0; i<count; i++) {
@@ -143,7 +147,11 @@ void enemy_move(struct enemy *mob, const cgm_vec3 *dir, float speed)
 		}
 	}
 
+#ifdef DBG_ITER_COLLISION
 	cgm_vadd(&mob->pos, &vel);
+#else
+	lvl_move_sphere(mob->lvl, room, &mob->pos, &vel, mob->rad, 2);
+#endif
 }
 
 void enemy_ai_flying1(struct enemy *mob)
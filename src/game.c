@@ -29,6 +29,8 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include "options.h"
 #include "util.h"
 #include "mtltex.h"
+#include "replay.h"
+#include "prof.h"
 
 static void draw_volume_bar(void);
 static void txdraw(struct dtx_vertex *v, int vcount, struct dtx_pixmap *pixmap, void *cls);
@@ -71,6 +73,14 @@ int game_init(void)
 #endif
 
 	load_options(GAME_CFG_FILE);
+	if(replay_init() == -1) {
+		return -1;
+	}
+#ifdef DBG_PROFILE
+	if(prof_init() == -1) {
+		return -1;
+	}
+#endif
 	game_resize(opt.xres, opt.yres);
 	game_vsync(opt.vsync);
 	if(opt.fullscreen) {
@@ -103,7 +113,9 @@ int game_init(void)
 	screens[num_screens++] = &scr_debug;
 	screens[num_screens++] = &scr_opt;
 
-	start_scr_name = getenv("START_SCREEN");
+	if(!(start_scr_name = getenv("START_SCREEN")) && replay_mode == REPLAY_PLAY) {
+		start_scr_name = "game";
+	}
 
 	for(i=0; i<num_screens; i++) {
 		if(screens[i]->init() == -1) {
@@ -153,6 +165,10 @@ void game_shutdown(void)
 
 	putchar('\n');
 
+	replay_shutdown();
+#ifdef DBG_PROFILE
+	prof_shutdown();
+#endif
 	save_options(GAME_CFG_FILE);
 
 	for(i=0; i<num_screens; i++) {
@@ -169,9 +185,14 @@ void game_shutdown(void)
 
 void game_display(void)
 {
+#ifndef DBG_PROFILE
 	static long nframes, interv, prev_msec;
+	long msec;
 
+	time_msec = msec = game_getmsec();
+#else
 	time_msec = game_getmsec();
+#endif
 
 	au_update();
 
@@ -179,11 +200,21 @@ void game_display(void)
 
 	draw_volume_bar();
 
-	game_swap_buffers();
-
+	replay_end_frame();
+#ifdef DBG_PROFILE
+	prof_draw();
+#endif
 
-	interv += time_msec - prev_msec;
-	prev_msec = time_msec;
+	PROF_BEGIN(PROF_SWAP);
+	game_swap_buffers();
+	PROF_END(PROF_SWAP);
+
+#ifdef DBG_PROFILE
+	prof_end_frame();
+#else
+	/* time_msec follows the replay clock while replaying, use the real time */
+	interv += msec - prev_msec;
+	prev_msec = msec;
 	if(interv >= 1000) {
 		float fps = (float)(nframes * 1000) / interv;
 		printf("\rfps: %.2f    ", fps);
@@ -192,6 +223,7 @@ void game_display(void)
 		interv = 0;
 	}
 	nframes++;
+#endif
 }
 
 void game_reshape(int x, int y)
@@ -249,6 +281,12 @@ void game_keyboard(int key, int press)
 			printf("vsync %s\n", opt.vsync ? "on" : "off");
 			game_vsync(opt.vsync);
 			break;
+
+#ifdef DBG_PROFILE
+		case GKEY_F9:
+			prof_overlay(-1);
+			return;
+#endif
 		}
 	}
 
@@ -58,7 +58,16 @@ enum {
 	GAW_LIGHT2,
 	GAW_LIGHT3,
 	GAW_TEXTURE_1D,
-	GAW_TEXTURE_2D
+	GAW_TEXTURE_2D,
+	/* hint for opaque static geometry: the software renderer draws it front
+	 * to back through a span buffer, to skip hidden pixels without touching
+	 * them. Ignored by other backends.
+	 */
+	GAW_SPANBUF,
+	/* restrict drawing to the gaw_scissor rectangle. Clears are not affected
+	 * by it in the software backends, keep it disabled when clearing.
+	 */
+	GAW_SCISSOR_TEST
 };
 
 enum {
@@ -97,6 +106,8 @@ enum {
 };
 
 void gaw_viewport(int x, int y, int w, int h);
+/* window coordinates, with the origin at the bottom left like the viewport */
+void gaw_scissor(int x, int y, int w, int h);
 
 void gaw_matrix_mode(int mode);
 void gaw_load_identity(void);
@@ -125,6 +136,10 @@ void gaw_alpha_func(int func, float ref);
 
 void gaw_clear_color(float r, float g, float b, float a);
 void gaw_clear(unsigned int flags);
+/* read back the color buffer as RGB24, top row first. x/y in window
+ * coordinates like gaw_scissor. Waits for everything drawn so far.
+ */
+void gaw_read_pixels(int x, int y, int w, int h, void *pix);
 void gaw_depth_mask(int mask);
 
 void gaw_vertex_array(int nelem, int stride, const void *ptr);
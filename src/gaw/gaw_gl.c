@@ -34,6 +34,11 @@ void gaw_viewport(int x, int y, int w, int h)
 	glViewport(x, y, w, h);
 }
 
+void gaw_scissor(int x, int y, int w, int h)
+{
+	glScissor(x, y, w, h);
+}
+
 void gaw_matrix_mode(int mode)
 {
 	mode += GL_MODELVIEW;
@@ -157,6 +162,9 @@ void gaw_enable(int st)
 	case GAW_TEXTURE_2D:
 		glEnable(GL_TEXTURE_2D);
 		break;
+	case GAW_SCISSOR_TEST:
+		glEnable(GL_SCISSOR_TEST);
+		break;
 	default:
 		break;
 	}
@@ -204,6 +212,9 @@ void gaw_disable(int st)
 	case GAW_TEXTURE_2D:
 		glDisable(GL_TEXTURE_2D);
 		break;
+	case GAW_SCISSOR_TEST:
+		glDisable(GL_SCISSOR_TEST);
+		break;
 	default:
 		break;
 	}
@@ -245,6 +256,28 @@ void gaw_clear(unsigned int flags)
 	glClear(glflags);
 }
 
+void gaw_read_pixels(int x, int y, int w, int h, void *pix)
+{
+	int i, pitch = w * 3;
+	unsigned char *top, *bot, *tmp;
+
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(x, y, w, h, GL_RGB, GL_UNSIGNED_BYTE, pix);
+
+	/* GL returns the bottom row first */
+	tmp = malloc_nf(pitch);
+	top = pix;
+	bot = top + (h - 1) * pitch;
+	for(i=0; i<h/2; i++) {
+		memcpy(tmp, top, pitch);
+		memcpy(top, bot, pitch);
+		memcpy(bot, tmp, pitch);
+		top += pitch;
+		bot -= pitch;
+	}
+	free(tmp);
+}
+
 void gaw_depth_mask(int mask)
 {
 	glDepthMask(mask);
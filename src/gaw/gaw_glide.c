@@ -71,6 +71,9 @@ static int num_tmu;
 
 static struct teximg textures[MAX_TEXTURES];
 
+/* clip window last set with grClipWindow */
+static int clip_rect[4];
+
 
 void gaw_glide_reset(void)
 {
@@ -140,6 +143,12 @@ void gaw_glide_init(int xsz, int ysz)
 	ST->width = xsz;
 	ST->height = ysz;
 
+	gaw_scissor(0, 0, xsz, ysz);
+	clip_rect[0] = clip_rect[1] = 0;
+	clip_rect[2] = xsz;
+	clip_rect[3] = ysz;
+	grClipWindow(0, 0, xsz, ysz);
+
 	init_texman();
 }
 
@@ -198,6 +207,27 @@ void gaw_clear(unsigned int flags)
 	}
 }
 
+void gaw_read_pixels(int x, int y, int w, int h, void *pix)
+{
+	int i, j;
+	unsigned short *row;
+	unsigned char *dest = pix;
+
+	/* the framebuffer is RGB565, with the origin at the top left */
+	row = malloc(w * sizeof *row);
+	for(i=0; i<h; i++) {
+		grLfbReadRegion(GR_BUFFER_BACKBUFFER, x, ST->height - y - h + i, w, 1,
+				w * sizeof *row, row);
+		for(j=0; j<w; j++) {
+			unsigned int c = row[j];
+			*dest++ = ((c >> 11) << 3) | (c >> 13);
+			*dest++ = (((c >> 5) & 0x3f) << 2) | ((c >> 9) & 3);
+			*dest++ = ((c & 0x1f) << 3) | ((c >> 2) & 7);
+		}
+	}
+	free(row);
+}
+
 void gaw_color_mask(int rmask, int gmask, int bmask, int amask)
 {
 	int rgbmask = rmask | gmask | bmask;
@@ -449,11 +479,44 @@ void gaw_sw_dump_textures(void)
 }
 
 
+/* the scissor rectangle maps to the clip window, with the origin at the top */
+static void update_clip(void)
+{
+	int x0, y0, x1, y1;
+
+	if(ST->opt & (1 << GAW_SCISSOR_TEST)) {
+		x0 = ST->scissor[0];
+		x1 = x0 + ST->scissor[2];
+		y0 = ST->height - ST->scissor[1] - ST->scissor[3];
+		y1 = ST->height - ST->scissor[1];
+		if(x0 < 0) x0 = 0;
+		if(y0 < 0) y0 = 0;
+		if(x1 > ST->width) x1 = ST->width;
+		if(y1 > ST->height) y1 = ST->height;
+		if(x1 < x0) x1 = x0;
+		if(y1 < y0) y1 = y0;
+	} else {
+		x0 = y0 = 0;
+		x1 = ST->width;
+		y1 = ST->height;
+	}
+
+	if(x0 != clip_rect[0] || y0 != clip_rect[1] || x1 != clip_rect[2] || y1 != clip_rect[3]) {
+		clip_rect[0] = x0;
+		clip_rect[1] = y0;
+		clip_rect[2] = x1;
+		clip_rect[3] = y1;
+		grClipWindow(x0, y0, x1, y1);
+	}
+}
+
 void gaw_swtnl_drawprim(int prim, struct vertex *v, int vnum)
 {
 	int i;
 	GrVertex vert[16];
 
+	update_clip();
+
 	for(i=0; i<vnum; i++) {
 		/* viewport transformation */
 		vert[i].x = (v[i].x * 0.5f + 0.5f) * (float)ST->vport[2] + ST->vport[0];
@@ -17,14 +17,69 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 #include <string.h>
 #include "gaw.h"
+#include "gaw_sw.h"
 #include "gawswtnl.h"
 #include "polyfill.h"
 
 static struct pimage textures[MAX_TEXTURES];
+static unsigned char texfilter[MAX_TEXTURES];
+static int persp_span = 16;
+
+/* Depth clears by epoch: the top 8 bits of zbuffer values are a tag, counting
+ * down at every clear, so values left over from previous frames are always
+ * farther than anything drawn in the current one. The zbuffer only needs to be
+ * actually cleared when the tag wraps around. Only used when the clear depth
+ * is the far plane, since stale values behave as infinitely far.
+ */
+#define ZEPOCH_SHIFT	24
+static int zepoch_enable = 1;
+static uint32_t zepoch;		/* tag of the current epoch, shifted in place */
+static int zbuf_valid;		/* 0 if the zbuffer holds garbage until a full clear */
+
+/* guard band, in multiples of the viewport size. Keeps vertex coordinates
+ * within a few thousand pixels, safely inside the rasterizer's fixed point range
+ */
+#define GUARD_BAND		4.0f
+static int guard_enable = 1;
+
+static int sbuf_enable = 1;
+
+/* fill mode specializations, picked per polygon from the actual vertex colors
+ * and state, with a counter for each to see which ones pay off. Depth only
+ * fills for masked color writes are counted too, but aren't optional.
+ */
+enum { SPEC_FLAT, SPEC_REPLACE, SPEC_OPAQUE, SPEC_ZONLY, NUM_SPEC };
+static int spec_enable = 1;
+static unsigned long spec_polys, spec_hits[NUM_SPEC];
+
+static unsigned long num_polys;		/* polygons sent to the rasterizer */
+
+/* rasterizer clip rectangle last requested through polyfill_clip */
+static int clip_rect[4];
+
+/* pipelined rendering: frames alternate between the caller's framebuffer and
+ * a back buffer of our own, so that one can be drawn while the other is shown
+ */
+static int pipeline;
+static gaw_pixel *fbuf[2];
+static int cur_fb;
+
+#ifdef DBG_PROFILE
+/* rasterizer counters at the end of the last frame */
+static struct pfill_stats prof_prev;
+#endif
+
+static void build_mipmaps(struct pimage *img);
+static void free_mipmaps(struct pimage *img);
+static void calc_polygon_lod(struct pimage *tex, struct vertex *v, int vnum, int persp);
+static int specialize(int mode, struct pvertex *pv, int vnum);
+static void update_clip(void);
+static void alloc_back_buffer(void);
 
 void gaw_sw_reset(void)
 {
 	gaw_swtnl_reset();
+	ST->guard_band = guard_enable ? GUARD_BAND : 0.0f;
 
 	free(pfill_zbuf);
 }
@@ -32,12 +87,15 @@ void gaw_sw_reset(void)
 void gaw_sw_init(void)
 {
 	gaw_swtnl_init();
+	polyfill_simd(1);
 
 	gaw_sw_reset();
 }
 
 void gaw_sw_destroy(void)
 {
+	gaw_sw_pipeline(0);
+	polyfill_threads(1);
 	gaw_swtnl_destroy();
 
 	free(pfill_zbuf);
@@ -45,35 +103,215 @@ void gaw_sw_destroy(void)
 
 void gaw_sw_framebuffer(int width, int height, void *pixels)
 {
-	static int max_height;
 	static int max_npixels;
 	int npixels = width * height;
 
+	polyfill_flush();
+
 	if(npixels > max_npixels) {
 		free(pfill_zbuf);
 		pfill_zbuf = malloc_nf(npixels * sizeof *pfill_zbuf);
 		max_npixels = npixels;
 	}
 
-	if(height > max_height) {
-		polyfill_fbheight(height);
-		max_height = height;
-	}
+	polyfill_fbheight(height);
+	polyfill_hiz_size(width, height);
+	zbuf_valid = 0;
 
 	ST->width = width;
 	ST->height = height;
 
-	pfill_fb.pixels = pixels;
 	pfill_fb.width = width;
 	pfill_fb.height = height;
+	pfill_fb.pitch = width;
+
+	fbuf[0] = pixels;
+	cur_fb = 0;
+	if(pipeline) {
+		alloc_back_buffer();
+	}
+	polyfill_target(pixels);
 
 	gaw_viewport(0, 0, width, height);
+	gaw_scissor(0, 0, width, height);
+
+	clip_rect[0] = clip_rect[1] = 0;
+	clip_rect[2] = width;
+	clip_rect[3] = height;
+	polyfill_clip(0, 0, width, height);
 }
 
 /* set the framebuffer pointer, without resetting the size */
 void gaw_sw_framebuffer_addr(void *pixels)
 {
-	pfill_fb.pixels = pixels;
+	polyfill_flush();
+	fbuf[0] = pixels;
+	cur_fb = 0;
+	polyfill_target(pixels);
+}
+
+void gaw_sw_framebuffer_pitch(int pitch)
+{
+	polyfill_flush();
+
+	pfill_fb.pitch = pitch / sizeof *pfill_fb.pixels;
+	if(pfill_fb.pitch < pfill_fb.width) {
+		pfill_fb.pitch = pfill_fb.width;
+	}
+
+	cur_fb = 0;
+	if(pipeline) {
+		alloc_back_buffer();
+	}
+	polyfill_target(fbuf[0]);
+}
+
+void gaw_sw_pipeline(int enable)
+{
+	if(!enable == !pipeline) return;
+
+	polyfill_flush();
+
+	if(enable) {
+		alloc_back_buffer();
+		polyfill_pipeline(1);
+		pipeline = 1;
+	} else {
+		polyfill_pipeline(0);
+		pipeline = 0;
+		cur_fb = 0;
+		polyfill_target(fbuf[0]);
+		free(fbuf[1]);
+		fbuf[1] = 0;
+	}
+}
+
+void *gaw_sw_end_frame(void)
+{
+#ifdef DBG_PROFILE
+	struct pfill_stats pst, *prev = &prof_prev;
+
+	/* the rasterizer counters are only complete once the frame is drawn, so
+	 * profiling builds give up on overlapping frames
+	 */
+	polyfill_flush();
+	polyfill_stats(&pst);
+	PROF_COUNT(PROF_ZFAIL, pst.zfail - prev->zfail);
+	PROF_COUNT(PROF_PIXELS, (pst.pixels - prev->pixels) - (pst.hiz_pixels - prev->hiz_pixels) -
+			(pst.sbuf_pixels - prev->sbuf_pixels) - (pst.zfail - prev->zfail));
+	prof_prev = pst;
+#endif
+
+	if(!pipeline) {
+		polyfill_flush();
+		return fbuf[0];
+	}
+
+	/* submit this frame, and draw the next one in the other buffer, where
+	 * the previous frame has been drawn by the time the submit returns
+	 */
+	polyfill_target(fbuf[cur_fb ^ 1]);
+	cur_fb ^= 1;
+	return fbuf[cur_fb];
+}
+
+/* the back buffer has the same layout as the caller's framebuffer */
+static void alloc_back_buffer(void)
+{
+	free(fbuf[1]);
+	fbuf[1] = calloc_nf(pfill_fb.pitch * pfill_fb.height, sizeof *fbuf[1]);
+}
+
+int gaw_sw_threads(int nthr)
+{
+	return polyfill_threads(nthr);
+}
+
+/* perspective-correct texture mapping: the exact texture coordinates are
+ * computed every span pixels (8, 16, or 32 are reasonable), with linear
+ * interpolation in between. 0 disables perspective correction.
+ */
+void gaw_sw_perspective(int span)
+{
+	polyfill_flush();
+
+	persp_span = span > 0 ? span : 0;
+	if(persp_span) {
+		pfill_persp_span = persp_span;
+	}
+}
+
+int gaw_sw_simd(int enable)
+{
+	return polyfill_simd(enable);
+}
+
+void gaw_sw_hiz(int enable)
+{
+	polyfill_hiz(enable);
+}
+
+void gaw_sw_guard_band(int enable)
+{
+	guard_enable = enable;
+	ST->guard_band = enable ? GUARD_BAND : 0.0f;
+}
+
+void gaw_sw_span_buffer(int enable)
+{
+	polyfill_flush();
+	sbuf_enable = enable;
+}
+
+void gaw_sw_specialize(int enable)
+{
+	spec_enable = enable;
+}
+
+void gaw_sw_stats(struct gaw_sw_stats *st)
+{
+	struct pfill_stats pst;
+
+	/* the rasterizer counters are only complete once everything is drawn */
+	polyfill_flush();
+	polyfill_stats(&pst);
+	st->hiz_tested = pst.hiz_tested;
+	st->hiz_polys = pst.hiz_polys;
+	st->hiz_pixels = pst.hiz_pixels;
+	st->sbuf_pixels = pst.sbuf_pixels;
+	st->polys = num_polys;
+	st->pixels = pst.pixels;
+	st->zfail = pst.zfail;
+
+	st->vert_refs = ST->stat_vrefs;
+	st->vert_xform = ST->stat_vxform;
+	st->tris = ST->stat_tris;
+	st->culled = ST->stat_culled;
+
+	st->fill_polys = spec_polys;
+	st->fill_flat = spec_hits[SPEC_FLAT];
+	st->fill_replace = spec_hits[SPEC_REPLACE];
+	st->fill_opaque = spec_hits[SPEC_OPAQUE];
+	st->fill_zonly = spec_hits[SPEC_ZONLY];
+}
+
+void gaw_sw_reset_stats(void)
+{
+	polyfill_reset_stats();
+#ifdef DBG_PROFILE
+	memset(&prof_prev, 0, sizeof prof_prev);
+#endif
+	ST->stat_vrefs = ST->stat_vxform = ST->stat_tris = 0;
+	ST->stat_culled = 0;
+	spec_polys = 0;
+	memset(spec_hits, 0, sizeof spec_hits);
+	num_polys = 0;
+}
+
+/* wait for all queued polygons to be drawn */
+void gaw_sw_flush(void)
+{
+	polyfill_flush();
 }
 
 void gaw_enable(int what)
@@ -88,19 +326,67 @@ void gaw_disable(int what)
 
 void gaw_clear(unsigned int flags)
 {
-	int i, npix = pfill_fb.width * pfill_fb.height;
+	struct pfill_clear clr;
+
+	clr.flags = 0;
 
 	if(flags & GAW_COLORBUF) {
-		for(i=0; i<npix; i++) {
-			pfill_fb.pixels[i] = ST->clear_color;
-		}
+		clr.flags |= PFILL_CLEAR_COLOR;
+		clr.color = ST->clear_color;
 	}
 
 	if(flags & GAW_DEPTHBUF) {
-		for(i=0; i<npix; i++) {
-			pfill_zbuf[i] = ST->clear_depth;
+		clr.flags |= PFILL_CLEAR_DEPTH;
+
+		if(zepoch_enable && ST->clear_depth == 0xffffff) {
+			if(zbuf_valid && zepoch) {
+				zepoch -= 1 << ZEPOCH_SHIFT;
+			} else {
+				/* tag wrapped around, or the zbuffer has never been cleared */
+				clr.flags |= PFILL_CLEAR_ZBUF;
+				clr.depth = 0xffffffff;
+				zepoch = 0xffu << ZEPOCH_SHIFT;
+				zbuf_valid = 1;
+			}
+			clr.hiz_depth = 0xffffffff;
+		} else {
+			clr.flags |= PFILL_CLEAR_ZBUF;
+			clr.depth = clr.hiz_depth = ST->clear_depth;
+			zepoch = 0;
+			zbuf_valid = 1;
 		}
 	}
+
+	if(clr.flags) {
+		polyfill_clear(&clr);
+	}
+}
+
+void gaw_read_pixels(int x, int y, int w, int h, void *pix)
+{
+	int i, j;
+	gaw_pixel *src;
+	unsigned char *dest = pix;
+
+	polyfill_flush();
+
+	src = fbuf[cur_fb] + (pfill_fb.height - y - h) * pfill_fb.pitch + x;
+	for(i=0; i<h; i++) {
+		for(j=0; j<w; j++) {
+			*dest++ = (src[j] >> 16) & 0xff;
+			*dest++ = (src[j] >> 8) & 0xff;
+			*dest++ = src[j] & 0xff;
+		}
+		src += pfill_fb.pitch;
+	}
+}
+
+void gaw_sw_depth_epoch(int enable)
+{
+	polyfill_flush();
+	zepoch_enable = enable;
+	/* start from a full clear either way */
+	zepoch = 0;
 }
 
 void gaw_color_mask(int rmask, int gmask, int bmask, int amask)
@@ -124,7 +410,7 @@ static int alloc_tex(void)
 	return -1;
 }
 
-unsigned int gaw_create_tex1d(int texfilter)
+unsigned int gaw_create_tex1d(int filter)
 {
 	int idx;
 	if((idx = alloc_tex()) == -1) {
@@ -133,11 +419,12 @@ unsigned int gaw_create_tex1d(int texfilter)
 	ST->textypes[idx] = 1;
 
 	memset(textures + idx, 0, sizeof *textures);
+	texfilter[idx] = GAW_NEAREST;
 	ST->cur_tex = idx;
 	return idx + 1;
 }
 
-unsigned int gaw_create_tex2d(int texfilter)
+unsigned int gaw_create_tex2d(int filter)
 {
 	int idx;
 	if((idx = alloc_tex()) == -1) {
@@ -146,6 +433,7 @@ unsigned int gaw_create_tex2d(int texfilter)
 	ST->textypes[idx] = 2;
 
 	memset(textures + idx, 0, sizeof *textures);
+	texfilter[idx] = filter;
 	ST->cur_tex = idx;
 	return idx + 1;
 }
@@ -156,16 +444,37 @@ void gaw_destroy_tex(unsigned int texid)
 
 	if(!ST->textypes[idx]) return;
 
+	polyfill_flush();
+	free_mipmaps(textures + idx);
 	free(textures[idx].pixels);
 	ST->textypes[idx] = 0;
 }
 
-void gaw_texfilter1d(int texfilter)
+void gaw_texfilter1d(int filter)
 {
 }
 
-void gaw_texfilter2d(int texfilter)
+/* the rasterizer only does point sampling, but GAW_TRILINEAR enables
+ * mipmapping: the nearest mip level is picked per polygon, or per span for
+ * perspective-correct polygons.
+ */
+void gaw_texfilter2d(int filter)
 {
+	struct pimage *img;
+
+	if(ST->cur_tex < 0) return;
+	img = textures + ST->cur_tex;
+
+	if(filter == texfilter[ST->cur_tex]) return;
+	texfilter[ST->cur_tex] = filter;
+
+	polyfill_flush();
+	if(filter == GAW_TRILINEAR) {
+		if(img->pixels) build_mipmaps(img);
+	} else {
+		free_mipmaps(img);
+	}
+	pfill_tex = *img;
 }
 
 void gaw_texwrap1d(int wrap)
@@ -205,6 +514,8 @@ void gaw_tex2d(int ifmt, int xsz, int ysz, int fmt, void *pix)
 
 	npix = xsz * ysz;
 
+	polyfill_flush();
+	free_mipmaps(img);
 	free(img->pixels);
 	img->pixels = malloc_nf(npix * sizeof *img->pixels);
 	img->width = xsz;
@@ -220,7 +531,7 @@ void gaw_tex2d(int ifmt, int xsz, int ysz, int fmt, void *pix)
 
 void gaw_subtex2d(int lvl, int x, int y, int xsz, int ysz, int fmt, void *pix)
 {
-	int i, j, r, g, b, val;
+	int i, j, r, g, b, val, npix;
 	uint32_t *dest;
 	unsigned char *src;
 	struct pimage *img;
@@ -228,6 +539,8 @@ void gaw_subtex2d(int lvl, int x, int y, int xsz, int ysz, int fmt, void *pix)
 	if(ST->cur_tex < 0) return;
 	img = textures + ST->cur_tex;
 
+	polyfill_flush();
+
 	dest = img->pixels + (y << img->xshift) + x;
 	src = pix;
 
@@ -268,6 +581,106 @@ void gaw_subtex2d(int lvl, int x, int y, int xsz, int ysz, int fmt, void *pix)
 	default:
 		break;
 	}
+
+	npix = img->width * img->height;
+	img->opaque = 1;
+	for(i=0; i<npix; i++) {
+		if(UNPACK_A(img->pixels[i]) != 255) {
+			img->opaque = 0;
+			break;
+		}
+	}
+
+	if(texfilter[ST->cur_tex] == GAW_TRILINEAR) {
+		build_mipmaps(img);
+	}
+	pfill_tex = *img;
+}
+
+/* box filter each 2x2 block of src into a pixel of dest. Dimensions which are
+ * already down to 1 pixel aren't halved any further.
+ */
+static void halve_image(struct pimage *dest, struct pimage *src)
+{
+	int i, j, dx, dy;
+	gaw_pixel *sptr, *dptr, p0, p1, p2, p3;
+	uint32_t even, odd;
+
+	dx = src->width > 1 ? 1 : 0;
+	dy = src->height > 1 ? src->width : 0;
+
+	dptr = dest->pixels;
+	for(i=0; i<dest->height; i++) {
+		sptr = src->pixels + ((i * src->height / dest->height) << src->xshift);
+		for(j=0; j<dest->width; j++) {
+			p0 = sptr[0];
+			p1 = sptr[dx];
+			p2 = sptr[dy];
+			p3 = sptr[dy + dx];
+			/* sum the even and odd bytes in separate 16bit lanes */
+			even = (p0 & 0xff00ff) + (p1 & 0xff00ff) + (p2 & 0xff00ff) + (p3 & 0xff00ff);
+			odd = ((p0 >> 8) & 0xff00ff) + ((p1 >> 8) & 0xff00ff) +
+				((p2 >> 8) & 0xff00ff) + ((p3 >> 8) & 0xff00ff);
+			*dptr++ = ((even >> 2) & 0xff00ff) | (((odd >> 2) & 0xff00ff) << 8);
+			sptr += dx + 1;
+		}
+	}
+}
+
+static void build_mipmaps(struct pimage *img)
+{
+	int i, xsz, ysz, nlevels, npix;
+	gaw_pixel *pix;
+	struct pimage *lvl;
+
+	free_mipmaps(img);
+
+	xsz = img->width;
+	ysz = img->height;
+	nlevels = 1;
+	npix = 0;
+	while(xsz > 1 || ysz > 1) {
+		if(xsz > 1) xsz >>= 1;
+		if(ysz > 1) ysz >>= 1;
+		npix += xsz * ysz;
+		nlevels++;
+	}
+
+	img->levels = malloc_nf(nlevels * sizeof *img->levels);
+	img->num_levels = nlevels;
+	/* all levels past the first share a single pixel buffer */
+	pix = npix ? malloc_nf(npix * sizeof *pix) : 0;
+
+	img->levels[0] = *img;
+	img->levels[0].levels = 0;
+	img->levels[0].num_levels = 0;
+
+	for(i=1; i<nlevels; i++) {
+		lvl = img->levels + i;
+		*lvl = lvl[-1];
+		if(lvl->width > 1) lvl->width >>= 1;
+		if(lvl->height > 1) lvl->height >>= 1;
+		lvl->xmask = lvl->width - 1;
+		lvl->ymask = lvl->height - 1;
+		lvl->xshift = calc_shift(lvl->width);
+		lvl->yshift = calc_shift(lvl->height);
+		lvl->pixels = pix;
+		pix += lvl->width * lvl->height;
+
+		halve_image(lvl, lvl - 1);
+	}
+}
+
+static void free_mipmaps(struct pimage *img)
+{
+	if(!img->levels) return;
+
+	if(img->num_levels > 1) {
+		free(img->levels[1].pixels);
+	}
+	free(img->levels);
+	img->levels = 0;
+	img->num_levels = 0;
 }
 
 void gaw_bind_tex1d(int tex)
@@ -316,8 +729,21 @@ void gaw_sw_dump_textures(void)
 
 void gaw_swtnl_drawprim(int prim, struct vertex *v, int vnum)
 {
-	int i, fill_mode;
+	int i, fill_mode, persp = 0;
 	struct pvertex pv[16];
+	float rw;
+
+	if(persp_span && (ST->opt & ((1 << GAW_TEXTURE_2D) | (1 << GAW_TEXTURE_1D)))) {
+		/* no need for perspective correction if w is constant (orthographic
+		 * projection, or polygons parallel to the view plane)
+		 */
+		for(i=1; i<vnum; i++) {
+			if(v[i].w != v[0].w) {
+				persp = 1;
+				break;
+			}
+		}
+	}
 
 	for(i=0; i<vnum; i++) {
 		/* viewport transformation */
@@ -332,11 +758,21 @@ void gaw_swtnl_drawprim(int prim, struct vertex *v, int vnum)
 		if(ST->opt & (1 << GAW_DEPTH_TEST)) {
 			/* after div/w z is in [-1, 1], remap it to [0, 0xffffff] */
 			pv[i].z = cround64(v[i].z * 8388607.5f + 8388607.5f);
+			/* keep rounding errors from spilling into the epoch tag */
+			if(pv[i].z < 0) pv[i].z = 0;
+			if(pv[i].z > 0xffffff) pv[i].z = 0xffffff;
+			pv[i].z |= zepoch;
 		}
 
 		/* convert tex coords to 16.16 fixed point */
 		pv[i].u = cround64(v[i].u * 65536.0f);
 		pv[i].v = cround64(v[i].v * 65536.0f);
+		if(persp) {
+			rw = v[i].w != 0.0f ? 1.0f / v[i].w : 1.0f;
+			pv[i].iw = rw;
+			pv[i].iu = v[i].u * 65536.0f * rw;
+			pv[i].iv = v[i].v * 65536.0f * rw;
+		}
 		/* pass the color through as is */
 		pv[i].r = v[i].r;
 		pv[i].g = v[i].g;
@@ -344,22 +780,6 @@ void gaw_swtnl_drawprim(int prim, struct vertex *v, int vnum)
 		pv[i].a = v[i].a;
 	}
 
-	/* backface culling */
-#if 0	/* TODO fix culling */
-	if(vnum > 2 && (ST->opt & (1 << GAW_CULL_FACE))) {
-		int32_t ax = pv[1].x - pv[0].x;
-		int32_t ay = pv[1].y - pv[0].y;
-		int32_t bx = pv[2].x - pv[0].x;
-		int32_t by = pv[2].y - pv[0].y;
-		int32_t cross_z = (ax >> 4) * (by >> 4) - (ay >> 4) * (bx >> 4);
-		int sign = (cross_z >> 31) & 1;
-
-		if(!(sign ^ ST->frontface)) {
-			continue;	/* back-facing */
-		}
-	}
-#endif
-
 	switch(prim) {
 	case GAW_POINTS:
 		break;
@@ -368,6 +788,8 @@ void gaw_swtnl_drawprim(int prim, struct vertex *v, int vnum)
 		break;
 
 	default:
+		update_clip();
+
 		fill_mode = ST->polymode;
 		if(ST->opt & ((1 << GAW_TEXTURE_2D) | (1 << GAW_TEXTURE_1D))) {
 			fill_mode |= POLYFILL_TEX_BIT;
@@ -380,7 +802,152 @@ void gaw_swtnl_drawprim(int prim, struct vertex *v, int vnum)
 		if(ST->opt & (1 << GAW_DEPTH_TEST)) {
 			fill_mode |= POLYFILL_ZBUF_BIT;
 		}
+		if(persp) {
+			fill_mode |= POLYFILL_PERSP_BIT;
+		}
+		if(!(ST->colormask & 7)) {
+			/* color writes masked, only depth is written */
+			spec_hits[SPEC_ZONLY]++;
+			if(!(fill_mode & POLYFILL_ZBUF_BIT)) break;
+			fill_mode = POLYFILL_ZONLY;
+		} else if(spec_enable && ST->polymode != POLYFILL_WIRE) {
+			fill_mode = specialize(fill_mode, pv, vnum);
+		}
+		if(sbuf_enable && (ST->opt & (1 << GAW_SPANBUF)) && (fill_mode & POLYFILL_ZBUF_BIT)) {
+			fill_mode |= POLYFILL_SBUF_BIT;
+		}
+		if((fill_mode & POLYFILL_TEX_BIT) && ST->cur_tex >= 0 && textures[ST->cur_tex].levels) {
+			calc_polygon_lod(textures + ST->cur_tex, v, vnum, persp);
+		}
+		num_polys++;
 		polyfill(fill_mode, pv, vnum);
 	}
 }
 
+/* clip polygons to the scissor rectangle if enabled, or the framebuffer. The
+ * rectangle goes along with each polygon queued for the rasterizer threads, so
+ * changing it doesn't need a flush.
+ */
+static void update_clip(void)
+{
+	int x0, y0, x1, y1;
+
+	if(ST->opt & (1 << GAW_SCISSOR_TEST)) {
+		/* flip to scanlines from the top, like the viewport transformation */
+		x0 = ST->scissor[0];
+		x1 = x0 + ST->scissor[2];
+		y0 = pfill_fb.height - ST->scissor[1] - ST->scissor[3];
+		y1 = pfill_fb.height - ST->scissor[1];
+	} else {
+		x0 = y0 = 0;
+		x1 = pfill_fb.width;
+		y1 = pfill_fb.height;
+	}
+
+	if(x0 != clip_rect[0] || y0 != clip_rect[1] || x1 != clip_rect[2] || y1 != clip_rect[3]) {
+		clip_rect[0] = x0;
+		clip_rect[1] = y0;
+		clip_rect[2] = x1;
+		clip_rect[3] = y1;
+		polyfill_clip(x0, y0, x1, y1);
+	}
+}
+
+/* pick a cheaper fill mode for a polygon, if its vertex colors or the state
+ * make part of the work of the one requested pointless:
+ *  - alpha blending with all vertices (and texels) opaque: no blending. Not
+ *    exactly the same, blending by 255 keeps 1/256 of the background.
+ *  - gouraud with the same color at every vertex: flat shading
+ *  - textured with white vertex colors: the texels are drawn as they are,
+ *    instead of multiplied by 255/256
+ */
+static int specialize(int mode, struct pvertex *pv, int vnum)
+{
+	int i;
+
+	spec_polys++;
+
+	if(mode & POLYFILL_ALPHA_BIT) {
+		if(!(mode & POLYFILL_TEX_BIT) || pfill_tex.opaque) {
+			for(i=0; i<vnum; i++) {
+				if(pv[i].a != 255) break;
+			}
+			if(i >= vnum) {
+				mode &= ~POLYFILL_ALPHA_BIT;
+				spec_hits[SPEC_OPAQUE]++;
+			}
+		}
+	}
+
+	if((mode & POLYFILL_MODE_MASK) == POLYFILL_GOURAUD) {
+		for(i=1; i<vnum; i++) {
+			if(pv[i].r != pv[0].r || pv[i].g != pv[0].g || pv[i].b != pv[0].b) break;
+			if((mode & POLYFILL_ALPHA_BIT) && pv[i].a != pv[0].a) break;
+		}
+		if(i < vnum) return mode;
+		mode = (mode & ~POLYFILL_MODE_MASK) | POLYFILL_FLAT;
+	}
+
+	/* flat shading uses the color of the first vertex */
+	if((mode & POLYFILL_TEX_BIT) && pv[0].r == 255 && pv[0].g == 255 && pv[0].b == 255 &&
+			(!(mode & POLYFILL_ALPHA_BIT) || pv[0].a == 255)) {
+		spec_hits[SPEC_REPLACE]++;
+		return (mode & ~POLYFILL_MODE_MASK) | POLYFILL_NOCOLOR;
+	}
+	if(ST->polymode == POLYFILL_GOURAUD) {
+		spec_hits[SPEC_FLAT]++;
+	}
+	return mode;
+}
+
+/* The mip level is half the log2 of the ratio of the polygon area in texel
+ * space to its area on screen. With perspective that ratio goes as w^3 across
+ * the polygon, and for a triangle it's exactly: (texel area / screen area) *
+ * w^3 / (w0 * w1 * w2). So perspective-correct polygons get the level at w = 1,
+ * and the span fillers pick a level at each span from its 1/w.
+ */
+static void calc_polygon_lod(struct pimage *tex, struct vertex *v, int vnum, int persp)
+{
+	int i, tri = 1, level;
+	float ax, ay, bx, by, area, scr_area = 0.0f, tex_area, lod, wprod;
+
+	/* use the largest triangle of the fan, to stay clear of degenerate ones */
+	for(i=1; i<vnum-1; i++) {
+		ax = v[i].x - v[0].x;
+		ay = v[i].y - v[0].y;
+		bx = v[i + 1].x - v[0].x;
+		by = v[i + 1].y - v[0].y;
+		area = ax * by - ay * bx;
+		if(area < 0.0f) area = -area;
+		if(area > scr_area) {
+			scr_area = area;
+			tri = i;
+		}
+	}
+
+	ax = (v[tri].u - v[0].u) * (float)tex->width;
+	ay = (v[tri].v - v[0].v) * (float)tex->height;
+	bx = (v[tri + 1].u - v[0].u) * (float)tex->width;
+	by = (v[tri + 1].v - v[0].v) * (float)tex->height;
+	tex_area = ax * by - ay * bx;
+	if(tex_area < 0.0f) tex_area = -tex_area;
+
+	if(scr_area < 1e-4f || tex_area < 1e-4f) {
+		pfill_tex = tex->levels[0];
+		return;
+	}
+	lod = 0.5f * pfill_log2(tex_area / scr_area);
+
+	if(persp) {
+		wprod = v[0].w * v[tri].w * v[tri + 1].w;
+		pfill_tex = *tex;
+		pfill_tex_lod = wprod > 0.0f ? lod - 0.5f * pfill_log2(wprod) : 0.0f;
+		return;
+	}
+
+	level = (int)(lod + 0.5f);
+	if(level < 0) level = 0;
+	if(level >= tex->num_levels) level = tex->num_levels - 1;
+	pfill_tex = tex->levels[level];
+}
+
@@ -23,5 +23,93 @@ void gaw_sw_destroy(void);
 void gaw_sw_reset(void);
 void gaw_sw_framebuffer(int width, int height, void *pixels);
 void gaw_sw_framebuffer_addr(void *pixels);
+/* bytes from one scanline to the next, for framebuffers with padded rows,
+ * like locked video surfaces. gaw_sw_framebuffer resets it to the width.
+ */
+void gaw_sw_framebuffer_pitch(int pitch);
+
+/* number of rasterizer threads (0: one per processor). Returns the number of
+ * threads actually started. With more than one, drawing is deferred until
+ * gaw_sw_flush, or anything else which needs the framebuffer to be complete.
+ */
+int gaw_sw_threads(int nthr);
+void gaw_sw_flush(void);
+
+/* pipelined rendering (off by default): frames are rasterized by a render
+ * thread while the next one is set up and transformed, alternating between
+ * the framebuffer passed to gaw_sw_framebuffer and a back buffer.
+ */
+void gaw_sw_pipeline(int enable);
+/* finish a frame, and return the pixels of the last complete one, valid until
+ * the next frame is drawn. That's the current one without the pipeline, and
+ * the previous one with it. Frames not clearing the color buffer draw over the
+ * one before the previous.
+ */
+void *gaw_sw_end_frame(void);
+
+/* perspective-correct texturing, re-corrected every span pixels (0: off) */
+void gaw_sw_perspective(int span);
+
+/* SIMD span fillers for the common fill modes, if the CPU supports them (on
+ * by default). Returns whether they're in use.
+ */
+int gaw_sw_simd(int enable);
+
+/* hierarchical z buffer rejection of hidden polygons and spans (on by default) */
+void gaw_sw_hiz(int enable);
+
+/* leave polygons crossing the sides of the screen to the rasterizer, and only
+ * clip those extending past the guard band, or the near and far planes (on by
+ * default)
+ */
+void gaw_sw_guard_band(int enable);
+
+/* draw geometry flagged with GAW_SPANBUF front to back through a span buffer,
+ * which skips runs of pixels hidden behind what it has already covered (on by
+ * default)
+ */
+void gaw_sw_span_buffer(int enable);
+
+/* pick cheaper fill variants per polygon, from the actual vertex colors and
+ * state: flat shading for constant colors, unmodulated texturing for white
+ * ones, and no blending when everything is opaque (on by default)
+ */
+void gaw_sw_specialize(int enable);
+
+/* clear the depth buffer by bumping an epoch tag stored in the top bits of
+ * depth values, instead of writing every pixel (on by default)
+ */
+void gaw_sw_depth_epoch(int enable);
+
+/* rasterizer counters, accumulated since the last gaw_sw_reset_stats */
+struct gaw_sw_stats {
+	unsigned long hiz_tested;	/* zbuffered polygons tested against the hi-z buffer */
+	unsigned long hiz_polys;	/* polygons it rejected entirely */
+	unsigned long hiz_pixels;	/* pixels it skipped, in tile-sized span runs */
+	unsigned long sbuf_pixels;	/* pixels skipped by the span buffer */
+
+	unsigned long polys;		/* polygons rasterized, after culling and clipping */
+	unsigned long pixels;		/* pixels they covered, before depth testing */
+	unsigned long zfail;		/* pixels failing the depth test (DBG_PROFILE only) */
+
+	/* indexed drawing: vertices transformed / tris is the ACMR achieved by
+	 * the post-transform vertex cache
+	 */
+	unsigned long vert_refs;	/* vertex indices submitted */
+	unsigned long vert_xform;	/* vertices transformed and lit */
+	unsigned long tris;			/* triangles submitted */
+
+	unsigned long culled;		/* back-facing primitives culled before lighting */
+
+	/* fill mode specializations (see gaw_sw_specialize) */
+	unsigned long fill_polys;	/* polygons checked */
+	unsigned long fill_flat;	/* constant color, drawn flat shaded */
+	unsigned long fill_replace;	/* textured with white colors, not modulated */
+	unsigned long fill_opaque;	/* alpha blended but opaque, not blended */
+	unsigned long fill_zonly;	/* color writes masked, depth only */
+};
+
+void gaw_sw_stats(struct gaw_sw_stats *st);
+void gaw_sw_reset_stats(void);
 
 #endif	/* GAW_SW_H_ */
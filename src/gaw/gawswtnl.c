@@ -16,6 +16,7 @@ You should have received a copy of the GNU General Public License
 along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <math.h>
 #include "cgmath/cgmath.h"
@@ -24,6 +25,7 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include "polyfill.h"
 #include "polyclip.h"
 #include "../darray.h"
+#include "../prof.h"
 
 #define NORMALIZE(v) \
 	do { \
@@ -40,7 +42,7 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 static void imm_flush(void);
 static __inline void xform4_vec3(const float *mat, float *vec);
 static __inline void xform3_vec3(const float *mat, float *vec);
-static void shade(struct vertex *v);
+static void shade(struct vertex *v, const float *pos);
 
 static struct gaw_state st;
 struct gaw_state *gaw_state;
@@ -74,6 +76,7 @@ void gaw_swtnl_reset(void)
 	gaw_mtl_diffuse(1, 1, 1, 1);
 
 	st.clear_depth = 0xffffff;
+	st.colormask = 0xf;
 
 	st.cur_comp = -1;
 	st.cur_tex = -1;
@@ -100,6 +103,14 @@ void gaw_viewport(int x, int y, int w, int h)
 	st.vport[3] = h;
 }
 
+void gaw_scissor(int x, int y, int w, int h)
+{
+	st.scissor[0] = x;
+	st.scissor[1] = y;
+	st.scissor[2] = w;
+	st.scissor[3] = h;
+}
+
 void gaw_matrix_mode(int mode)
 {
 	st.mmode = mode;
@@ -339,7 +350,7 @@ void gaw_clear_depth(float z)
 
 void gaw_swtnl_color_mask(int rmask, int gmask, int bmask, int amask)
 {
-	/* TODO */
+	st.colormask = (rmask ? 1 : 0) | (gmask ? 2 : 0) | (bmask ? 4 : 0) | (amask ? 8 : 0);
 }
 
 void gaw_swtnl_depth_mask(int mask)
@@ -397,139 +408,407 @@ void gaw_draw(int prim, int nverts)
 
 static int prim_vcount[] = {1, 2, 3, 4, 0};
 
-void gaw_draw_indexed(int prim, const unsigned int *idxarr, int nidx)
+/* post-transform vertex cache for indexed drawing: direct-mapped by index,
+ * valid only within the draw call which filled it (gen)
+ */
+#define VCACHE_SIZE		512
+struct vcache_entry {
+	struct vertex v;
+	float eye[3];		/* eye space position, for lighting */
+	unsigned int oc;	/* clip outcode */
+	int lit;			/* lighting and texture matrix done */
+	int idx;
+	unsigned int gen;
+};
+static struct vcache_entry vcache[VCACHE_SIZE];
+static unsigned int cur_vcache_gen;
+
+/* face drawing order, for drawing front to back through the span buffer */
+#define FSORT_BUCKETS	256
+static float *fsort_dist;
+static int *fsort;
+static int fsort_size;
+
+static void fetch_vertex(struct vertex *v, int vidx)
 {
-	int i, j, vidx, vnum, nfaces;
-	struct vertex v[16];
-	int mvtop = st.mtop[GAW_MODELVIEW];
-	int ptop = st.mtop[GAW_PROJECTION];
-	struct vertex *tmpv;
 	const float *vptr;
 
+	vptr = (const float*)((char*)st.vertex_ptr + vidx * st.vertex_stride);
+	v->x = vptr[0];
+	v->y = vptr[1];
+	v->z = st.vertex_nelem > 2 ? vptr[2] : 0.0f;
+	v->w = st.vertex_nelem > 3 ? vptr[3] : 1.0f;
+
+	if(st.normal_ptr) {
+		vptr = (const float*)((char*)st.normal_ptr + vidx * st.normal_stride);
+	} else {
+		vptr = &st.imm_curv.nx;
+	}
+	v->nx = vptr[0];
+	v->ny = vptr[1];
+	v->nz = vptr[2];
+
+	if(st.texcoord_ptr) {
+		vptr = (const float*)((char*)st.texcoord_ptr + vidx * st.texcoord_stride);
+	} else {
+		vptr = &st.imm_curv.u;
+	}
+	v->u = vptr[0];
+	v->v = vptr[1];
+
+	if(st.color_ptr) {
+		vptr = (const float*)((char*)st.color_ptr + vidx * st.color_stride);
+	} else {
+		vptr = st.imm_curcol;
+	}
+	v->r = (int)(vptr[0] * 255.0f);
+	v->g = (int)(vptr[1] * 255.0f);
+	v->b = (int)(vptr[2] * 255.0f);
+	v->a = st.color_nelem > 3 ? (int)(vptr[3] * 255.0f) : 255;
+}
+
+/* transform to clip space, keeping the eye space position for lighting */
+static void xform_vertex(struct vertex *v, float *eye)
+{
+	xform4_vec3(st.mat[GAW_MODELVIEW][st.mtop[GAW_MODELVIEW]], &v->x);
+	eye[0] = v->x;
+	eye[1] = v->y;
+	eye[2] = v->z;
+	xform4_vec3(st.mat[GAW_PROJECTION][st.mtop[GAW_PROJECTION]], &v->x);
+}
+
+/* light, and apply the texture matrix. Done only for vertices of primitives
+ * which survive culling.
+ */
+static void light_vertex(struct vertex *v, const float *eye)
+{
+	float *mat;
+	float x, y, w;
+
+	if(NEED_NORMALS) {
+		xform3_vec3(st.norm_mat, &v->nx);
+		if(st.opt & (1 << GAW_LIGHTING)) {
+			shade(v, eye);
+		}
+		if(st.opt & (1 << GAW_SPHEREMAP)) {
+			v->u = v->nx * 0.5 + 0.5;
+			v->v = 0.5 - v->ny * 0.5;
+		}
+	}
+
+	mat = st.mat[GAW_TEXTURE][st.mtop[GAW_TEXTURE]];
+	x = mat[0] * v->u + mat[4] * v->v + mat[12];
+	y = mat[1] * v->u + mat[5] * v->v + mat[13];
+	w = mat[3] * v->u + mat[7] * v->v + mat[15];
+	v->u = x / w;
+	v->v = y / w;
+}
+
+/* twice the signed area of the projection of a polygon, positive if it's
+ * counter-clockwise. Calculated from the homogeneous clip coordinates, so it
+ * holds even for vertices behind the viewer.
+ */
+static float clip_area(const struct vertex *v, int vnum)
+{
+	int i;
+	float area = 0.0f;
+
+	for(i=1; i<vnum-1; i++) {
+		area += v[0].x * (v[i].y * v[i + 1].w - v[i + 1].y * v[i].w) -
+			v[0].y * (v[i].x * v[i + 1].w - v[i + 1].x * v[i].w) +
+			v[0].w * (v[i].x * v[i + 1].y - v[i + 1].x * v[i].y);
+	}
+	return area;
+}
+
+/* sort the faces of a draw call roughly front to back, by the eye space
+ * distance of their nearest vertex. A counting sort into depth buckets: it
+ * only needs to be approximate, and being stable it keeps neighbouring faces
+ * of the mesh together, for the vertex cache.
+ */
+static void sort_faces(const unsigned int *idxarr, int nfaces, int vcount,
+		const struct vertex *vsrc)
+{
+	int i, j, vidx, bucket;
+	int count[FSORT_BUCKETS + 1];
+	float d, dmin, fmin, fmax, scale;
+	float *mat = st.mat[GAW_MODELVIEW][st.mtop[GAW_MODELVIEW]];
+	struct vertex tmp;
+	const struct vertex *v;
+
+	if(nfaces > fsort_size) {
+		free(fsort);
+		free(fsort_dist);
+		fsort = malloc_nf(nfaces * sizeof *fsort);
+		fsort_dist = malloc_nf(nfaces * sizeof *fsort_dist);
+		fsort_size = nfaces;
+	}
+
+	fmin = 1e30f;
+	fmax = -1e30f;
+	for(i=0; i<nfaces; i++) {
+		dmin = 1e30f;
+		for(j=0; j<vcount; j++) {
+			vidx = idxarr ? idxarr[i * vcount + j] : i * vcount + j;
+			if(vsrc) {
+				v = vsrc + vidx;
+			} else {
+				fetch_vertex(&tmp, vidx);
+				v = &tmp;
+			}
+			d = -(mat[2] * v->x + mat[6] * v->y + mat[10] * v->z + mat[14]);
+			if(d < dmin) dmin = d;
+		}
+		fsort_dist[i] = dmin;
+		if(dmin < fmin) fmin = dmin;
+		if(dmin > fmax) fmax = dmin;
+	}
+
+	scale = fmax > fmin ? (float)(FSORT_BUCKETS - 1) / (fmax - fmin) : 0.0f;
+
+	memset(count, 0, sizeof count);
+	for(i=0; i<nfaces; i++) {
+		bucket = (int)((fsort_dist[i] - fmin) * scale);
+		count[bucket + 1]++;
+	}
+	for(i=1; i<=FSORT_BUCKETS; i++) {
+		count[i] += count[i - 1];
+	}
+	for(i=0; i<nfaces; i++) {
+		bucket = (int)((fsort_dist[i] - fmin) * scale);
+		fsort[count[bucket]++] = i;
+	}
+}
+
+/* record a draw call into the compiled geometry being built, as untransformed
+ * vertices and indices into them
+ */
+static void compile_draw(int prim, const unsigned int *idxarr, int nidx)
+{
+	int i, vmin, vmax, nverts, vbase, ibase;
+	struct comp_geom *cg = st.comp + st.cur_comp;
+
+	nidx -= nidx % prim_vcount[prim];
+	if(nidx <= 0) return;
+
+	if(idxarr) {
+		vmin = vmax = idxarr[0];
+		for(i=1; i<nidx; i++) {
+			if((int)idxarr[i] < vmin) vmin = idxarr[i];
+			if((int)idxarr[i] > vmax) vmax = idxarr[i];
+		}
+	} else {
+		vmin = 0;
+		vmax = nidx - 1;
+	}
+	nverts = vmax - vmin + 1;
+
+	vbase = darr_size(cg->varr);
+	darr_resize(cg->varr, vbase + nverts);
+	for(i=0; i<nverts; i++) {
+		fetch_vertex(cg->varr + vbase + i, vmin + i);
+	}
+
+	ibase = darr_size(cg->iarr);
+	darr_resize(cg->iarr, ibase + nidx);
+	for(i=0; i<nidx; i++) {
+		cg->iarr[ibase + i] = vbase + (idxarr ? idxarr[i] - vmin : i);
+	}
+}
+
+/* vsrc: pre-packed vertices of compiled geometry, instead of the vertex arrays */
+static void draw_indexed(int prim, const unsigned int *idxarr, int nidx,
+		const struct vertex *vsrc)
+{
+	int i, j, vidx, vnum, nfaces, face, sorted;
+	struct vertex v[16], tmp;
+	struct vertex *tmpv;
+	struct vcache_entry *vc;
+	float eye[4][3];
+	int vi[4], lit[4];
+	unsigned int oc[4], ocand, ocor, clipmask;
+	float guard, area;
+	float scissor[4] = {-1.0f, 1.0f, -1.0f, 1.0f};
+	int use_scissor;
+
 	if(prim == GAW_QUAD_STRIP) return;	/* TODO */
 
 	if(st.cur_comp >= 0) {
+		/* currently compiling geometry, don't transform or draw */
 		st.comp[st.cur_comp].prim = prim;
+		compile_draw(prim, idxarr, nidx);
+		return;
 	}
 
 	tmpv = alloca(prim * 6 * sizeof *tmpv);
 
+	PROF_BEGIN(PROF_TNL);
+
 	/* calc the normal matrix */
 	if(NEED_NORMALS) {
-		memcpy(st.norm_mat, st.mat[GAW_MODELVIEW][mvtop], 16 * sizeof(float));
+		memcpy(st.norm_mat, st.mat[GAW_MODELVIEW][st.mtop[GAW_MODELVIEW]], 16 * sizeof(float));
 		st.norm_mat[12] = st.norm_mat[13] = st.norm_mat[14] = 0.0f;
 	}
 
-	vidx = 0;
+	/* polygons within the guard band are left for the rasterizer to clip, as
+	 * long as everything it can draw is inside the viewport
+	 */
+	guard = st.guard_band;
+	if(st.vport[0] > 0 || st.vport[1] > 0 || st.vport[0] + st.vport[2] < st.width ||
+			st.vport[1] + st.vport[3] < st.height) {
+		guard = 0.0f;
+	}
+	clipmask = guard > 0.0f ? CLIP_GUARD_BITS | (1 << CLIP_NEAR) | (1 << CLIP_FAR) :
+		CLIP_FRUSTUM_BITS;
+
+	/* the backend clips pixels to the scissor rectangle, but polygons entirely
+	 * outside of it can be dropped here, before lighting and clipping. Find
+	 * its edges in normalized device coordinates.
+	 */
+	if((use_scissor = (st.opt & (1 << GAW_SCISSOR_TEST)) && st.vport[2] > 0 && st.vport[3] > 0)) {
+		scissor[0] = 2.0f * (float)(st.scissor[0] - st.vport[0]) / (float)st.vport[2] - 1.0f;
+		scissor[1] = 2.0f * (float)(st.scissor[0] + st.scissor[2] - st.vport[0]) / (float)st.vport[2] - 1.0f;
+		scissor[2] = 2.0f * (float)(st.scissor[1] - st.vport[1]) / (float)st.vport[3] - 1.0f;
+		scissor[3] = 2.0f * (float)(st.scissor[1] + st.scissor[3] - st.vport[1]) / (float)st.vport[3] - 1.0f;
+	}
+
+	/* invalidate the vertex cache, state might have changed since the last call */
+	if(++cur_vcache_gen == 0) {
+		for(i=0; i<VCACHE_SIZE; i++) {
+			vcache[i].gen = 0;
+		}
+		cur_vcache_gen = 1;
+	}
+
 	nfaces = nidx / prim_vcount[prim];
+	PROF_COUNT(PROF_PRIMS, nfaces);
+
+	if(idxarr) {
+		st.stat_vrefs += nfaces * prim_vcount[prim];
+		if(prim >= GAW_TRIANGLES) {
+			st.stat_tris += nfaces * (prim_vcount[prim] - 2);
+		}
+	}
+
+	/* the span buffer only rejects anything if polygons come front to back */
+	sorted = (st.opt & (1 << GAW_SPANBUF)) && (st.opt & (1 << GAW_DEPTH_TEST)) &&
+		prim >= GAW_TRIANGLES && nfaces > 1;
+	if(sorted) {
+		sort_faces(idxarr, nfaces, prim_vcount[prim], vsrc);
+	}
 
 	for(j=0; j<nfaces; j++) {
 		vnum = prim_vcount[prim];	/* reset vnum for each iteration */
+		face = sorted ? fsort[j] : j;
 
 		for(i=0; i<vnum; i++) {
-			if(idxarr) {
-				vidx = *idxarr++;
-			}
-			vptr = (const float*)((char*)st.vertex_ptr + vidx * st.vertex_stride);
-			v[i].x = vptr[0];
-			v[i].y = vptr[1];
-			v[i].z = st.vertex_nelem > 2 ? vptr[2] : 0.0f;
-			v[i].w = st.vertex_nelem > 3 ? vptr[3] : 1.0f;
-
-			if(st.normal_ptr) {
-				vptr = (const float*)((char*)st.normal_ptr + vidx * st.normal_stride);
-			} else {
-				vptr = &st.imm_curv.nx;
+			if(!idxarr) {
+				/* no vertex is referenced twice, don't bother with the cache */
+				vidx = face * vnum + i;
+				if(vsrc) {
+					v[i] = vsrc[vidx];
+				} else {
+					fetch_vertex(v + i, vidx);
+				}
+				xform_vertex(v + i, eye[i]);
+				oc[i] = clip_outcode(v + i, guard);
+				if(use_scissor) {
+					oc[i] |= clip_outcode_scissor(v + i, scissor);
+				}
+				lit[i] = 0;
+				continue;
 			}
-			v[i].nx = vptr[0];
-			v[i].ny = vptr[1];
-			v[i].nz = vptr[2];
 
-			if(st.texcoord_ptr) {
-				vptr = (const float*)((char*)st.texcoord_ptr + vidx * st.texcoord_stride);
+			vi[i] = vidx = idxarr[face * vnum + i];
+			vc = vcache + (vidx & (VCACHE_SIZE - 1));
+			if(vc->gen == cur_vcache_gen && vc->idx == vidx) {
+				v[i] = vc->v;
+				if(!(lit[i] = vc->lit)) {
+					memcpy(eye[i], vc->eye, sizeof *eye);
+				}
 			} else {
-				vptr = &st.imm_curv.u;
+				if(vsrc) {
+					v[i] = vsrc[vidx];
+				} else {
+					fetch_vertex(v + i, vidx);
+				}
+				xform_vertex(v + i, eye[i]);
+				vc->v = v[i];
+				memcpy(vc->eye, eye[i], sizeof *eye);
+				vc->oc = clip_outcode(v + i, guard);
+				if(use_scissor) {
+					vc->oc |= clip_outcode_scissor(v + i, scissor);
+				}
+				vc->lit = lit[i] = 0;
+				vc->idx = vidx;
+				vc->gen = cur_vcache_gen;
+				st.stat_vxform++;
 			}
-			v[i].u = vptr[0];
-			v[i].v = vptr[1];
+			oc[i] = vc->oc;
+		}
 
-			if(st.color_ptr) {
-				vptr = (const float*)((char*)st.color_ptr + vidx * st.color_stride);
-			} else {
-				vptr = st.imm_curcol;
-			}
-			v[i].r = (int)(vptr[0] * 255.0f);
-			v[i].g = (int)(vptr[1] * 255.0f);
-			v[i].b = (int)(vptr[2] * 255.0f);
-			v[i].a = st.color_nelem > 3 ? (int)(vptr[3] * 255.0f) : 255;
-
-			vidx++;
-
-			if(st.cur_comp >= 0) {
-				/* currently compiling geometry */
-				struct comp_geom *cg = st.comp + st.cur_comp;
-				float col[4];
-
-				col[0] = v[i].r / 255.0f;
-				col[1] = v[i].g / 255.0f;
-				col[2] = v[i].b / 255.0f;
-				col[3] = v[i].a / 255.0f;
-
-				darr_push(cg->varr, &v[i].x);
-				darr_push(cg->varr, &v[i].y);
-				darr_push(cg->varr, &v[i].z);
-				darr_push(cg->narr, &v[i].nx);
-				darr_push(cg->narr, &v[i].ny);
-				darr_push(cg->narr, &v[i].nz);
-				darr_push(cg->uvarr, &v[i].u);
-				darr_push(cg->uvarr, &v[i].v);
-				darr_push(cg->carr, col);
-				darr_push(cg->carr, col + 1);
-				darr_push(cg->carr, col + 2);
-				darr_push(cg->carr, col + 3);
-				continue;	/* don't transform, just skip to the next vertex */
+		ocand = ~0u;
+		ocor = 0;
+		for(i=0; i<vnum; i++) {
+			ocand &= oc[i];
+			ocor |= oc[i];
+		}
+		if(ocand & (CLIP_FRUSTUM_BITS | CLIP_SCISSOR_BITS)) {
+			/* all vertices outside the same plane, discard */
+			PROF_COUNT(PROF_CULLED, 1);
+			continue;
+		}
+
+		area = clip_area(v, vnum);
+		if(vnum > 2 && (st.opt & (1 << GAW_CULL_FACE))) {
+			if(st.frontface ? area >= 0.0f : area <= 0.0f) {
+				st.stat_culled++;
+				PROF_COUNT(PROF_CULLED, 1);
+				continue;
 			}
+		}
 
-			xform4_vec3(st.mat[GAW_MODELVIEW][mvtop], &v[i].x);
+		for(i=0; i<vnum; i++) {
+			if(lit[i]) continue;
 
-			if(NEED_NORMALS) {
-				xform3_vec3(st.norm_mat, &v[i].nx);
-				if(st.opt & (1 << GAW_LIGHTING)) {
-					shade(v + i);
-				}
-				if(st.opt & (1 << GAW_SPHEREMAP)) {
-					v[i].u = v[i].nx * 0.5 + 0.5;
-					v[i].v = 0.5 - v[i].ny * 0.5;
+			light_vertex(v + i, eye[i]);
+			if(idxarr) {
+				vc = vcache + (vi[i] & (VCACHE_SIZE - 1));
+				if(vc->gen == cur_vcache_gen && vc->idx == vi[i]) {
+					vc->v = v[i];
+					vc->lit = 1;
 				}
 			}
-			{
-				float *mat = st.mat[GAW_TEXTURE][st.mtop[GAW_TEXTURE]];
-				float x = mat[0] * v[i].u + mat[4] * v[i].v + mat[12];
-				float y = mat[1] * v[i].u + mat[5] * v[i].v + mat[13];
-				float w = mat[3] * v[i].u + mat[7] * v[i].v + mat[15];
-				v[i].u = x / w;
-				v[i].v = y / w;
-			}
-			xform4_vec3(st.mat[GAW_PROJECTION][ptop], &v[i].x);
 		}
 
-		if(st.cur_comp >= 0) {
-			/* compiling geometry, don't draw, skip to the next primitive */
-			continue;
+		if(area < 0.0f) {
+			/* the rasterizer only fills counter-clockwise polygons */
+			for(i=0; i<vnum / 2; i++) {
+				tmp = v[i];
+				v[i] = v[vnum - i - 1];
+				v[vnum - i - 1] = tmp;
+			}
 		}
 
-		/* clipping */
-		for(i=0; i<6; i++) {
-			memcpy(tmpv, v, vnum * sizeof *v);
+		if(ocor & clipmask) {
+			PROF_BEGIN(PROF_CLIP);
+			PROF_COUNT(PROF_CLIPPED, 1);
+			/* clip against the planes crossed by any vertex */
+			for(i=0; i<6; i++) {
+				if(!(ocor & (1 << i))) continue;
+
+				memcpy(tmpv, v, vnum * sizeof *v);
 
-			if(clip_frustum(v, &vnum, tmpv, vnum, i) < 0) {
-				/* polygon completely outside of view volume. discard */
-				vnum = 0;
-				break;
+				if(clip_frustum(v, &vnum, tmpv, vnum, i) < 0) {
+					/* polygon completely outside of view volume. discard */
+					vnum = 0;
+					break;
+				}
 			}
-		}
+			PROF_END(PROF_CLIP);
 
-		if(!vnum) continue;
+			if(!vnum) continue;
+		}
 
 		for(i=0; i<vnum; i++) {
 			if(v[i].w != 0.0f) {
@@ -541,8 +820,17 @@ void gaw_draw_indexed(int prim, const unsigned int *idxarr, int nidx)
 			}
 		}
 
+		PROF_BEGIN(PROF_RAST);
 		gaw_swtnl_drawprim(prim, v, vnum);
+		PROF_END(PROF_RAST);
 	}
+
+	PROF_END(PROF_TNL);
+}
+
+void gaw_draw_indexed(int prim, const unsigned int *idxarr, int nidx)
+{
+	draw_indexed(prim, idxarr, nidx, 0);
 }
 
 void gaw_begin(int prim)
@@ -680,10 +968,8 @@ int gaw_compile_begin(void)
 	}
 
 	st.comp[i].prim = -1;
-	st.comp[i].varr = darr_alloc(0, sizeof(float));
-	st.comp[i].narr = darr_alloc(0, sizeof(float));
-	st.comp[i].uvarr = darr_alloc(0, sizeof(float));
-	st.comp[i].carr = darr_alloc(0, sizeof(float));
+	st.comp[i].varr = darr_alloc(0, sizeof(struct vertex));
+	st.comp[i].iarr = darr_alloc(0, sizeof(unsigned int));
 
 	return st.cur_comp + 1;
 }
@@ -701,17 +987,8 @@ void gaw_draw_compiled(int id)
 		return;
 	}
 
-	gaw_vertex_array(3, 0, st.comp[idx].varr);
-	gaw_normal_array(0, st.comp[idx].narr);
-	gaw_texcoord_array(2, 0, st.comp[idx].uvarr);
-	gaw_color_array(4, 0, st.comp[idx].carr);
-
-	gaw_draw(st.comp[idx].prim, darr_size(st.comp[idx].varr) / 3);
-
-	gaw_vertex_array(0, 0, 0);
-	gaw_normal_array(0, 0);
-	gaw_texcoord_array(0, 0, 0);
-	gaw_color_array(0, 0, 0);
+	draw_indexed(st.comp[idx].prim, st.comp[idx].iarr, darr_size(st.comp[idx].iarr),
+			st.comp[idx].varr);
 }
 
 void gaw_free_compiled(int id)
@@ -719,9 +996,7 @@ void gaw_free_compiled(int id)
 	int idx = id - 1;
 
 	darr_free(st.comp[idx].varr);
-	darr_free(st.comp[idx].narr);
-	darr_free(st.comp[idx].uvarr);
-	darr_free(st.comp[idx].carr);
+	darr_free(st.comp[idx].iarr);
 	memset(st.comp + idx, 0, sizeof *st.comp);
 }
 
@@ -876,7 +1151,8 @@ static __inline void xform3_vec3(const float *mat, float *vec)
 	vec[0] = x;
 }
 
-static void shade(struct vertex *v)
+/* pos: eye space position of the vertex */
+static void shade(struct vertex *v, const float *pos)
 {
 	int i, r, g, b;
 	float color[3];
@@ -898,9 +1174,9 @@ static void shade(struct vertex *v)
 		ldir[2] = st.lt[i].z;
 
 		if(st.lt[i].type != LT_DIR) {
-			ldir[0] -= v->x;
-			ldir[1] -= v->y;
-			ldir[2] -= v->z;
+			ldir[0] -= pos[0];
+			ldir[1] -= pos[1];
+			ldir[2] -= pos[2];
 			NORMALIZE(ldir);
 		}
 
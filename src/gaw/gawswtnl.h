@@ -49,9 +49,13 @@ struct material {
 	float shin;
 };
 
+/* compiled geometry: untransformed vertices with pre-quantized colors, and
+ * indices into them, drawn through the same path as gaw_draw_indexed
+ */
 struct comp_geom {
 	int prim;
-	float *varr, *narr, *uvarr, *carr;	/* darr */
+	struct vertex *varr;	/* darr */
+	unsigned int *iarr;		/* darr */
 };
 
 
@@ -60,7 +64,7 @@ struct gaw_state {
 	uint32_t savopt[STACK_SIZE];
 	int savopt_top;
 
-	int frontface;
+	int frontface;	/* 0: counter-clockwise polygons are front-facing */
 	int polymode;
 
 	const float *varr, *narr, *uvarr;
@@ -76,11 +80,21 @@ struct gaw_state {
 	struct material mtl;
 
 	int bsrc, bdst;
+	/* color writes enabled, bits 0-3: r, g, b, a. The software rasterizer
+	 * only distinguishes between all rgb channels masked and not.
+	 */
+	unsigned int colormask;
 
 	int width, height;
 	gaw_pixel *pixels;
 
 	int vport[4];
+	/* guard band size as a multiple of the viewport, for backends which can
+	 * draw polygons extending past the framebuffer edges (0: none)
+	 */
+	float guard_band;
+	/* scissor rectangle, same coordinates as the viewport */
+	int scissor[4];
 
 	uint32_t clear_color;
 	uint32_t clear_depth;
@@ -104,6 +118,12 @@ struct gaw_state {
 	/* compiled geometries */
 	int cur_comp;
 	struct comp_geom comp[MAX_COMPILED];
+
+	/* indexed drawing counters: vertex references, vertices actually
+	 * transformed (post-transform cache misses), and triangles
+	 */
+	unsigned long stat_vrefs, stat_vxform, stat_tris;
+	unsigned long stat_culled;	/* back-facing primitives culled */
 };
 
 extern struct gaw_state *gaw_state;
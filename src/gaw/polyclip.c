@@ -101,6 +101,7 @@ int clip_frustum(struct vertex *vout, int *voutnum,
 		(res)->r = (v0)->r + ((v1)->r - (v0)->r) * (t); \
 		(res)->g = (v0)->g + ((v1)->g - (v0)->g) * (t); \
 		(res)->b = (v0)->b + ((v1)->b - (v0)->b) * (t); \
+		(res)->a = (v0)->a + ((v1)->a - (v0)->a) * (t); \
 	} while(0)
 
 
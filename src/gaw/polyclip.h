@@ -14,6 +14,56 @@ enum {
 	CLIP_NEAR, CLIP_FAR
 };
 
+/* clip outcodes: (1 << CLIP_xxx) for every frustum plane a vertex is outside
+ * of, and (CLIP_GUARD << CLIP_xxx) when it's also outside the left, right,
+ * bottom, or top plane pushed out by the guard band factor.
+ * (CLIP_SCISSOR << CLIP_xxx) are for the edges of the scissor rectangle, and
+ * only used for rejecting polygons; the rasterizer clips pixels to it.
+ */
+#define CLIP_FRUSTUM_BITS	0x3f
+#define CLIP_GUARD			0x100
+#define CLIP_GUARD_BITS		0xf00
+#define CLIP_SCISSOR		0x1000
+#define CLIP_SCISSOR_BITS	0xf000
+
+static __inline unsigned int clip_outcode(const struct vertex *v, float guard)
+{
+	unsigned int oc = 0;
+	float gw = v->w * guard;
+
+	if(v->x < -v->w) {
+		oc |= 1 << CLIP_LEFT;
+		if(v->x < -gw) oc |= CLIP_GUARD << CLIP_LEFT;
+	}
+	if(v->x > v->w) {
+		oc |= 1 << CLIP_RIGHT;
+		if(v->x > gw) oc |= CLIP_GUARD << CLIP_RIGHT;
+	}
+	if(v->y < -v->w) {
+		oc |= 1 << CLIP_BOTTOM;
+		if(v->y < -gw) oc |= CLIP_GUARD << CLIP_BOTTOM;
+	}
+	if(v->y > v->w) {
+		oc |= 1 << CLIP_TOP;
+		if(v->y > gw) oc |= CLIP_GUARD << CLIP_TOP;
+	}
+	if(v->z < -v->w) oc |= 1 << CLIP_NEAR;
+	if(v->z > v->w) oc |= 1 << CLIP_FAR;
+	return oc;
+}
+
+/* rect: left, right, bottom, top edges in normalized device coordinates */
+static __inline unsigned int clip_outcode_scissor(const struct vertex *v, const float *rect)
+{
+	unsigned int oc = 0;
+
+	if(v->x < rect[0] * v->w) oc |= CLIP_SCISSOR << CLIP_LEFT;
+	if(v->x > rect[1] * v->w) oc |= CLIP_SCISSOR << CLIP_RIGHT;
+	if(v->y < rect[2] * v->w) oc |= CLIP_SCISSOR << CLIP_BOTTOM;
+	if(v->y > rect[3] * v->w) oc |= CLIP_SCISSOR << CLIP_TOP;
+	return oc;
+}
+
 /* Generic polygon clipper
  * returns:
  *  1 -> fully inside, not clipped
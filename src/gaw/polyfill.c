@@ -6,15 +6,21 @@
 
 /*#define DEBUG_OVERDRAW	PACK_RGB(10, 10, 10)*/
 
+/* the SIMD span fillers don't do overdraw visualization */
+#if defined(PFILL_SSE2) && !defined(DEBUG_OVERDRAW)
+#define USE_SIMD_SPANS
+#endif
+
 #define FILL_POLY_BITS	0x03
 
 
-/* mode bits: 00-wire 01-flat 10-gouraud 11-reserved
+/* mode bits: 00-wire 01-flat 10-gouraud 11-no vertex color (see polyfill.h)
  *     bit 2: texture
  *     bit 3-4: blend mode: 00-none 01-alpha 10-additive 11-reserved
  *     bit 5: zbuffering
+ *     bit 6: perspective-correct texture mapping (ignored without bit 2)
  */
-void (*fillfunc[])(struct pvertex*, int) = {
+void (*fillfunc[])(struct pfill_ctx*, struct pvertex*, int) = {
 	polyfill_wire,
 	polyfill_flat,
 	polyfill_gouraud,
@@ -22,7 +28,7 @@ void (*fillfunc[])(struct pvertex*, int) = {
 	polyfill_tex_wire,
 	polyfill_tex_flat,
 	polyfill_tex_gouraud,
-	0,
+	polyfill_tex_replace,
 	polyfill_alpha_wire,
 	polyfill_alpha_flat,
 	polyfill_alpha_gouraud,
@@ -30,7 +36,7 @@ void (*fillfunc[])(struct pvertex*, int) = {
 	polyfill_alpha_tex_wire,
 	polyfill_alpha_tex_flat,
 	polyfill_alpha_tex_gouraud,
-	0,
+	polyfill_alpha_tex_replace,
 	polyfill_add_wire,
 	polyfill_add_flat,
 	polyfill_add_gouraud,
@@ -38,89 +44,537 @@ void (*fillfunc[])(struct pvertex*, int) = {
 	polyfill_add_tex_wire,
 	polyfill_add_tex_flat,
 	polyfill_add_tex_gouraud,
-	0, 0, 0, 0, 0, 0, 0, 0, 0,
+	polyfill_add_tex_replace,
+	0, 0, 0, 0, 0, 0, 0, 0,
 	polyfill_wire,
 	polyfill_flat_zbuf,
 	polyfill_gouraud_zbuf,
-	0,
+	polyfill_zonly,
 	polyfill_tex_wire,
 	polyfill_tex_flat_zbuf,
 	polyfill_tex_gouraud_zbuf,
-	0,
+	polyfill_tex_replace_zbuf,
 	polyfill_alpha_wire,
 	polyfill_alpha_flat_zbuf,
 	polyfill_alpha_gouraud_zbuf,
-	0,
+	polyfill_zonly,
 	polyfill_alpha_tex_wire,
 	polyfill_alpha_tex_flat_zbuf,
 	polyfill_alpha_tex_gouraud_zbuf,
-	0,
+	polyfill_alpha_tex_replace_zbuf,
 	polyfill_add_wire,
 	polyfill_add_flat_zbuf,
 	polyfill_add_gouraud_zbuf,
-	0,
+	polyfill_zonly,
 	polyfill_add_tex_wire,
 	polyfill_add_tex_flat_zbuf,
 	polyfill_add_tex_gouraud_zbuf,
-	0, 0, 0, 0, 0, 0, 0, 0, 0
+	polyfill_add_tex_replace_zbuf,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	/* perspective-correct texture mapping */
+	polyfill_wire,
+	polyfill_flat,
+	polyfill_gouraud,
+	0,
+	polyfill_tex_wire,
+	polyfill_persp_tex_flat,
+	polyfill_persp_tex_gouraud,
+	polyfill_persp_tex_replace,
+	polyfill_alpha_wire,
+	polyfill_alpha_flat,
+	polyfill_alpha_gouraud,
+	0,
+	polyfill_alpha_tex_wire,
+	polyfill_alpha_persp_tex_flat,
+	polyfill_alpha_persp_tex_gouraud,
+	polyfill_alpha_persp_tex_replace,
+	polyfill_add_wire,
+	polyfill_add_flat,
+	polyfill_add_gouraud,
+	0,
+	polyfill_add_tex_wire,
+	polyfill_add_persp_tex_flat,
+	polyfill_add_persp_tex_gouraud,
+	polyfill_add_persp_tex_replace,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	polyfill_wire,
+	polyfill_flat_zbuf,
+	polyfill_gouraud_zbuf,
+	polyfill_zonly,
+	polyfill_tex_wire,
+	polyfill_persp_tex_flat_zbuf,
+	polyfill_persp_tex_gouraud_zbuf,
+	polyfill_persp_tex_replace_zbuf,
+	polyfill_alpha_wire,
+	polyfill_alpha_flat_zbuf,
+	polyfill_alpha_gouraud_zbuf,
+	polyfill_zonly,
+	polyfill_alpha_tex_wire,
+	polyfill_alpha_persp_tex_flat_zbuf,
+	polyfill_alpha_persp_tex_gouraud_zbuf,
+	polyfill_alpha_persp_tex_replace_zbuf,
+	polyfill_add_wire,
+	polyfill_add_flat_zbuf,
+	polyfill_add_gouraud_zbuf,
+	polyfill_zonly,
+	polyfill_add_tex_wire,
+	polyfill_add_persp_tex_flat_zbuf,
+	polyfill_add_persp_tex_gouraud_zbuf,
+	polyfill_add_persp_tex_replace_zbuf,
+	0, 0, 0, 0, 0, 0, 0, 0
 };
 
 struct pimage pfill_fb, pfill_tex;
+struct pfill_rect pfill_clip;
 uint32_t *pfill_zbuf;
+int pfill_persp_span = 16;
+float pfill_tex_lod;
+int pfill_simd;
+
+uint32_t *pfill_hiz;
+unsigned char *pfill_hiz_dirty;
+int pfill_hiz_cols;
+int pfill_hiz_enable = 1;
+static int hiz_rows, hiz_max_tiles;
+
+struct pfill_sspan *pfill_sbuf;
+unsigned char *pfill_sbuf_num;
+static int sbuf_rows, sbuf_max_rows;
 
 #define EDGEPAD	8
-static struct pvertex *edgebuf, *left, *right;
-static int edgebuf_size;
-static int fbheight;
 
-/*
-#define CHECKEDGE(x) \
-	do { \
-		assert(x >= 0); \
-		assert(x < fbheight); \
-	} while(0)
-*/
-#define CHECKEDGE(x)
+/* context used when drawing directly from the calling thread */
+static struct pfill_ctx ctx0;
 
 
 void polyfill_fbheight(int height)
 {
-	int newsz = (height * 2 + EDGEPAD * 3) * sizeof *edgebuf;
+	polyfill_ctx_height(&ctx0, height);
+	ctx0.ytop = 0;
+	ctx0.ybot = height - 1;
+
+	polyfill_mt_fbheight(height);
+
+	if(height > sbuf_max_rows) {
+		free(pfill_sbuf);
+		free(pfill_sbuf_num);
+		pfill_sbuf = malloc_nf(height * SBUF_MAX_SPANS * sizeof *pfill_sbuf);
+		pfill_sbuf_num = malloc_nf(height);
+		sbuf_max_rows = height;
+	}
+	sbuf_rows = height;
+	polyfill_sbuf_clear();
+}
+
+void polyfill_clip(int x0, int y0, int x1, int y1)
+{
+	if(x0 < 0) x0 = 0;
+	if(y0 < 0) y0 = 0;
+	if(x1 > pfill_fb.width) x1 = pfill_fb.width;
+	if(y1 > pfill_fb.height) y1 = pfill_fb.height;
+	if(x1 < x0) x1 = x0;
+	if(y1 < y0) y1 = y0;
+
+	pfill_clip.x0 = x0;
+	pfill_clip.y0 = y0;
+	pfill_clip.x1 = x1;
+	pfill_clip.y1 = y1;
+
+	ctx0.xmin = x0;
+	ctx0.xmax = x1;
+	ctx0.ytop = y0;
+	ctx0.ybot = y1 - 1;
+}
+
+void polyfill_sbuf_clear(void)
+{
+	memset(pfill_sbuf_num, 0, sbuf_rows);
+}
+
+void polyfill_clear(const struct pfill_clear *clr)
+{
+	if(pfill_mt_active) {
+		polyfill_mt_clear(clr);
+		return;
+	}
+	polyfill_clear_rows(clr, 0, pfill_fb.height - 1);
+}
+
+void polyfill_clear_rows(const struct pfill_clear *clr, int y0, int y1)
+{
+	int i, j, npix, ty0, ty1, ntiles;
+	gaw_pixel *pptr;
+	uint32_t *zptr;
+
+	npix = (y1 - y0 + 1) * pfill_fb.width;
+
+	if(clr->flags & PFILL_CLEAR_COLOR) {
+		pptr = pfill_fb.pixels + y0 * pfill_fb.pitch;
+		for(i=y0; i<=y1; i++) {
+			for(j=0; j<pfill_fb.width; j++) {
+				pptr[j] = clr->color;
+			}
+			pptr += pfill_fb.pitch;
+		}
+	}
+
+	if(clr->flags & PFILL_CLEAR_ZBUF) {
+		zptr = pfill_zbuf + y0 * pfill_fb.width;
+		if(clr->depth == 0xffffffff) {
+			memset(zptr, 0xff, npix * sizeof *zptr);
+		} else {
+			for(i=0; i<npix; i++) {
+				*zptr++ = clr->depth;
+			}
+		}
+	}
+
+	if(clr->flags & PFILL_CLEAR_DEPTH) {
+		memset(pfill_sbuf_num + y0, 0, y1 - y0 + 1);
+
+		/* callers split the framebuffer on tile boundaries */
+		ty0 = y0 >> HIZ_SHIFT;
+		ty1 = y1 >> HIZ_SHIFT;
+		ntiles = (ty1 - ty0 + 1) * pfill_hiz_cols;
+		for(i=0; i<ntiles; i++) {
+			pfill_hiz[ty0 * pfill_hiz_cols + i] = clr->hiz_depth;
+		}
+		memset(pfill_hiz_dirty + ty0 * pfill_hiz_cols, 0, ntiles);
+	}
+}
+
+void polyfill_ctx_height(struct pfill_ctx *ctx, int height)
+{
+	int newsz = (height * 2 + EDGEPAD * 3) * sizeof *ctx->edgebuf;
 
-	if(newsz > edgebuf_size) {
-		free(edgebuf);
-		if(!(edgebuf = malloc(newsz))) {
+	if(newsz > ctx->edgebuf_size) {
+		free(ctx->edgebuf);
+		if(!(ctx->edgebuf = malloc(newsz))) {
 			fprintf(stderr, "failed to allocate edge table buffer (%d bytes)\n", newsz);
 			abort();
 		}
-		edgebuf_size = newsz;
+		ctx->edgebuf_size = newsz;
 
-		left = edgebuf + EDGEPAD;
-		right = edgebuf + height + EDGEPAD * 2;
+		ctx->left = ctx->edgebuf + EDGEPAD;
+		ctx->right = ctx->edgebuf + height + EDGEPAD * 2;
 
 #ifndef NDEBUG
-		memset(edgebuf, 0xaa, EDGEPAD * sizeof *edgebuf);
-		memset(edgebuf + height + EDGEPAD, 0xaa, EDGEPAD * sizeof *edgebuf);
-		memset(edgebuf + height * 2 + EDGEPAD * 2, 0xaa, EDGEPAD * sizeof *edgebuf);
+		memset(ctx->edgebuf, 0xaa, EDGEPAD * sizeof *ctx->edgebuf);
+		memset(ctx->edgebuf + height + EDGEPAD, 0xaa, EDGEPAD * sizeof *ctx->edgebuf);
+		memset(ctx->edgebuf + height * 2 + EDGEPAD * 2, 0xaa, EDGEPAD * sizeof *ctx->edgebuf);
 #endif
 	}
+}
+
+void polyfill_ctx_destroy(struct pfill_ctx *ctx)
+{
+	free(ctx->edgebuf);
+	ctx->edgebuf = ctx->left = ctx->right = 0;
+	ctx->edgebuf_size = 0;
+}
+
+void polyfill_hiz_size(int width, int height)
+{
+	int ntiles;
+
+	pfill_hiz_cols = (width + HIZ_SIZE - 1) >> HIZ_SHIFT;
+	hiz_rows = (height + HIZ_SIZE - 1) >> HIZ_SHIFT;
+	ntiles = pfill_hiz_cols * hiz_rows;
+
+	if(ntiles > hiz_max_tiles) {
+		free(pfill_hiz);
+		free(pfill_hiz_dirty);
+		pfill_hiz = malloc_nf(ntiles * sizeof *pfill_hiz);
+		pfill_hiz_dirty = malloc_nf(ntiles);
+		hiz_max_tiles = ntiles;
+	}
+
+	/* we don't know what's in the zbuffer, recompute everything on demand */
+	memset(pfill_hiz_dirty, 1, ntiles);
+}
+
+void polyfill_hiz_clear(uint32_t depth)
+{
+	int i, ntiles = pfill_hiz_cols * hiz_rows;
+
+	for(i=0; i<ntiles; i++) {
+		pfill_hiz[i] = depth;
+	}
+	memset(pfill_hiz_dirty, 0, ntiles);
+}
+
+void polyfill_hiz(int enable)
+{
+	polyfill_flush();
+
+	if(enable && !pfill_hiz_enable) {
+		/* the fillers didn't mark the tiles they touched while disabled */
+		memset(pfill_hiz_dirty, 1, pfill_hiz_cols * hiz_rows);
+	}
+	pfill_hiz_enable = enable;
+}
+
+/* recalculate the farthest depth in a tile from the zbuffer */
+static uint32_t hiz_update(int tx, int ty)
+{
+	int i, j, x0, y0, xsz, ysz;
+	uint32_t *zptr, zmax = 0;
+
+	x0 = tx << HIZ_SHIFT;
+	y0 = ty << HIZ_SHIFT;
+	xsz = pfill_fb.width - x0 < HIZ_SIZE ? pfill_fb.width - x0 : HIZ_SIZE;
+	ysz = pfill_fb.height - y0 < HIZ_SIZE ? pfill_fb.height - y0 : HIZ_SIZE;
+
+	zptr = pfill_zbuf + y0 * pfill_fb.width + x0;
+	for(i=0; i<ysz; i++) {
+		for(j=0; j<xsz; j++) {
+			if(zptr[j] > zmax) zmax = zptr[j];
+		}
+		zptr += pfill_fb.width;
+	}
+
+	i = ty * pfill_hiz_cols + tx;
+	pfill_hiz[i] = zmax;
+	pfill_hiz_dirty[i] = 0;
+	return zmax;
+}
+
+/* test a polygon against the tiles covered by its bounding box, within the
+ * scanlines of the context. Returns 1 if the nearest vertex is behind all of
+ * them. The dirty tiles are brought up to date in the process, so that the
+ * span runs of the polygon can be tested against accurate values.
+ */
+int pfill_hiz_reject(struct pfill_ctx *ctx, struct pvertex *varr, int vnum)
+{
+	int i, j, x0, y0, x1, y1, idx, reject = 1;
+	uint32_t zmin, zmax;
+
+	x0 = x1 = varr[0].x;
+	y0 = y1 = varr[0].y;
+	zmin = varr[0].z;
+	for(i=1; i<vnum; i++) {
+		if(varr[i].x < x0) x0 = varr[i].x;
+		if(varr[i].x > x1) x1 = varr[i].x;
+		if(varr[i].y < y0) y0 = varr[i].y;
+		if(varr[i].y > y1) y1 = varr[i].y;
+		if((uint32_t)varr[i].z < zmin) zmin = varr[i].z;
+	}
+	x0 = x0 < 0 ? 0 : x0 >> 8;
+	y0 = y0 < 0 ? 0 : y0 >> 8;
+	x1 = (x1 >> 8) + 1;
+	y1 = (y1 >> 8) + 1;
+	if(x0 < ctx->xmin) x0 = ctx->xmin;
+	if(x1 >= ctx->xmax) x1 = ctx->xmax - 1;
+	if(y0 < ctx->ytop) y0 = ctx->ytop;
+	if(y1 > ctx->ybot) y1 = ctx->ybot;
+	if(x0 > x1 || y0 > y1) return 0;
+
+	ctx->stats.hiz_tested++;
+
+	y0 >>= HIZ_SHIFT;
+	y1 >>= HIZ_SHIFT;
+	x0 >>= HIZ_SHIFT;
+	x1 >>= HIZ_SHIFT;
+	for(i=y0; i<=y1; i++) {
+		idx = i * pfill_hiz_cols + x0;
+		for(j=x0; j<=x1; j++) {
+			zmax = pfill_hiz_dirty[idx] ? hiz_update(j, i) : pfill_hiz[idx];
+			if(zmin <= zmax) reject = 0;
+			idx++;
+		}
+	}
+
+	if(reject) ctx->stats.hiz_polys++;
+	return reject;
+}
+
+/* starting at pixel x of scanline y, find how many of the next len pixels
+ * (with depth z, stepping by zslope) fall in a run of tiles where they're all
+ * hidden (returns -count), or in a run where they might not be (returns
+ * count). Tiles of the latter are marked dirty, since they're about to be
+ * drawn to.
+ */
+int pfill_hiz_run(int x, int y, int len, int32_t z, int32_t zslope)
+{
+	int n, count = 0, hidden = -1, tile_hidden;
+	uint32_t z0, z1, *hiz;
+	unsigned char *dirty;
+
+	n = (y >> HIZ_SHIFT) * pfill_hiz_cols + (x >> HIZ_SHIFT);
+	hiz = pfill_hiz + n;
+	dirty = pfill_hiz_dirty + n;
+
+	while(count < len) {
+		n = HIZ_SIZE - ((x + count) & (HIZ_SIZE - 1));
+		if(n > len - count) n = len - count;
+
+		/* depth is linear along the run, the nearest is at one of its ends */
+		z0 = (uint32_t)z + (uint32_t)count * (uint32_t)zslope;
+		z1 = z0 + (uint32_t)(n - 1) * (uint32_t)zslope;
+		tile_hidden = (z0 < z1 ? z0 : z1) > *hiz;
+
+		if(hidden == -1) {
+			hidden = tile_hidden;
+		} else if(tile_hidden != hidden) {
+			break;
+		}
+		if(!tile_hidden) *dirty = 1;
+
+		count += n;
+		hiz++;
+		dirty++;
+	}
+	return hidden ? -count : count;
+}
+
+/* starting at pixel x of scanline y, find how many of the next len pixels
+ * fall in the same span buffer interval, or in the same gap between them.
+ * Returns -count if they're all behind the farthest depth drawn in the
+ * interval. A run in a gap is about to be drawn, so it's added to the span
+ * buffer right away, merged with any intervals it touches.
+ */
+int pfill_sbuf_run(int x, int y, int len, int32_t z, int32_t zslope)
+{
+	int i, lo, hi, n, num;
+	uint32_t z0, z1;
+	struct pfill_sspan *sp;
+
+	sp = pfill_sbuf + y * SBUF_MAX_SPANS;
+	num = pfill_sbuf_num[y];
+
+	/* binary search for the first interval ending past x */
+	lo = 0;
+	hi = num;
+	while(lo < hi) {
+		i = (lo + hi) >> 1;
+		if(sp[i].x1 <= x) {
+			lo = i + 1;
+		} else {
+			hi = i;
+		}
+	}
+	i = lo;
+
+	if(i < num && sp[i].x0 <= x) {
+		n = sp[i].x1 - x;
+		if(n > len) n = len;
+
+		/* depth is linear along the run, the nearest is at one of its ends */
+		z0 = z;
+		z1 = z0 + (uint32_t)(n - 1) * (uint32_t)zslope;
+		return (z0 < z1 ? z0 : z1) > sp[i].zmax ? -n : n;
+	}
+
+	n = i < num ? sp[i].x0 - x : len;
+	if(n > len) n = len;
+
+	z0 = z;
+	z1 = z0 + (uint32_t)(n - 1) * (uint32_t)zslope;
+	if(z0 < z1) z0 = z1;
+
+	if(i > 0 && sp[i - 1].x1 == x) {
+		/* extend the interval to the left */
+		sp[i - 1].x1 = x + n;
+		if(z0 > sp[i - 1].zmax) sp[i - 1].zmax = z0;
+		if(i < num && sp[i].x0 == x + n) {
+			/* ... and join it with the one to the right */
+			sp[i - 1].x1 = sp[i].x1;
+			if(sp[i].zmax > sp[i - 1].zmax) sp[i - 1].zmax = sp[i].zmax;
+			memmove(sp + i, sp + i + 1, (num - i - 1) * sizeof *sp);
+			pfill_sbuf_num[y]--;
+		}
+	} else if(i < num && sp[i].x0 == x + n) {
+		/* extend the interval to the right */
+		sp[i].x0 = x;
+		if(z0 > sp[i].zmax) sp[i].zmax = z0;
+	} else if(num < SBUF_MAX_SPANS) {
+		memmove(sp + i + 1, sp + i, (num - i) * sizeof *sp);
+		sp[i].x0 = x;
+		sp[i].x1 = x + n;
+		sp[i].zmax = z0;
+		pfill_sbuf_num[y]++;
+	}
+	/* if the scanline is full, it's just not recorded. The zbuffer test still
+	 * applies, so this only means the pixels won't be rejected early.
+	 */
+	return n;
+}
+
+int pfill_zrun(struct pfill_ctx *ctx, int x, int y, int len, int32_t z, int32_t zslope)
+{
+	int n = len;
+
+	if(ctx->sbuf) {
+		if((n = pfill_sbuf_run(x, y, len, z, zslope)) < 0) {
+			ctx->stats.sbuf_pixels -= n;
+			return n;
+		}
+	}
+	if(pfill_hiz_enable) {
+		if((n = pfill_hiz_run(x, y, n, z, zslope)) < 0) {
+			ctx->stats.hiz_pixels -= n;
+		}
+	}
+	return n;
+}
+
+void pfill_span_skip(struct pfill_span *span, int n)
+{
+	span->pptr += n;
+	span->zptr += n;
+	span->r += n * span->rslope;
+	span->g += n * span->gslope;
+	span->b += n * span->bslope;
+	span->a += n * span->aslope;
+	span->u += n * span->uslope;
+	span->v += n * span->vslope;
+	span->z += n * span->zslope;
+}
+
+void polyfill_stats(struct pfill_stats *st)
+{
+	memcpy(st, &ctx0.stats, sizeof *st);
+	polyfill_mt_stats(st, 0);
+}
+
+void polyfill_reset_stats(void)
+{
+	memset(&ctx0.stats, 0, sizeof ctx0.stats);
+	polyfill_mt_stats(0, 1);
+}
 
-	fbheight = height;
+int polyfill_simd(int enable)
+{
+	polyfill_flush();
+#ifdef USE_SIMD_SPANS
+	pfill_simd = enable && pfill_cpu_sse2();
+#else
+	pfill_simd = 0;
+#endif
+	return pfill_simd;
 }
 
 void polyfill(int mode, struct pvertex *verts, int nverts)
 {
 #ifndef NDEBUG
-	if(!fillfunc[mode]) {
+	if(!fillfunc[mode & ~POLYFILL_SBUF_BIT]) {
 		fprintf(stderr, "polyfill mode %d not implemented\n", mode);
 		abort();
 	}
 #endif
 
-	fillfunc[mode](verts, nverts);
+	if(pfill_mt_active) {
+		polyfill_mt_add(mode, verts, nverts);
+		return;
+	}
+
+	ctx0.tex = &pfill_tex;
+	ctx0.tex_lod = pfill_tex_lod;
+	ctx0.sbuf = mode & POLYFILL_SBUF_BIT;
+	fillfunc[mode & ~POLYFILL_SBUF_BIT](&ctx0, verts, nverts);
 }
 
-void polyfill_wire(struct pvertex *verts, int nverts)
+void polyfill_wire(struct pfill_ctx *ctx, struct pvertex *verts, int nverts)
 {
 	/*
 	int i, x0, y0, x1, y1;
@@ -145,40 +599,35 @@ void polyfill_wire(struct pvertex *verts, int nverts)
 	*/
 }
 
-void polyfill_tex_wire(struct pvertex *verts, int nverts)
+void polyfill_tex_wire(struct pfill_ctx *ctx, struct pvertex *verts, int nverts)
 {
-	polyfill_wire(verts, nverts);	/* TODO */
+	polyfill_wire(ctx, verts, nverts);	/* TODO */
 }
 
-void polyfill_alpha_wire(struct pvertex *verts, int nverts)
+void polyfill_alpha_wire(struct pfill_ctx *ctx, struct pvertex *verts, int nverts)
 {
-	polyfill_wire(verts, nverts);	/* TODO */
+	polyfill_wire(ctx, verts, nverts);	/* TODO */
 }
 
-void polyfill_alpha_tex_wire(struct pvertex *verts, int nverts)
+void polyfill_alpha_tex_wire(struct pfill_ctx *ctx, struct pvertex *verts, int nverts)
 {
-	polyfill_wire(verts, nverts);	/* TODO */
+	polyfill_wire(ctx, verts, nverts);	/* TODO */
 }
 
-void polyfill_add_wire(struct pvertex *verts, int nverts)
+void polyfill_add_wire(struct pfill_ctx *ctx, struct pvertex *verts, int nverts)
 {
-	polyfill_wire(verts, nverts);	/* TODO */
+	polyfill_wire(ctx, verts, nverts);	/* TODO */
 }
 
-void polyfill_add_tex_wire(struct pvertex *verts, int nverts)
+void polyfill_add_tex_wire(struct pfill_ctx *ctx, struct pvertex *verts, int nverts)
 {
-	polyfill_wire(verts, nverts);	/* TODO */
+	polyfill_wire(ctx, verts, nverts);	/* TODO */
 }
 
 #define VNEXT(p)	(((p) == vlast) ? varr : (p) + 1)
 #define VPREV(p)	((p) == varr ? vlast : (p) - 1)
 #define VSUCC(p, side)	((side) == 0 ? VNEXT(p) : VPREV(p))
 
-/* extra bits of precision to use when interpolating colors.
- * try tweaking this if you notice strange quantization artifacts.
- */
-#define COLOR_SHIFT	12
-
 
 #define POLYFILL polyfill_flat
 #undef GOURAUD
@@ -288,6 +737,40 @@ void polyfill_add_tex_wire(struct pvertex *verts, int nverts)
 #include "polytmpl.h"
 #undef POLYFILL
 
+/* replace: textured, ignoring the vertex colors */
+#define POLYFILL polyfill_tex_replace
+#undef GOURAUD
+#define TEXMAP
+#undef BLEND_ALPHA
+#undef BLEND_ADD
+#undef ZBUF
+#define TEX_REPLACE
+#include "polytmpl.h"
+#undef TEX_REPLACE
+#undef POLYFILL
+
+#define POLYFILL polyfill_alpha_tex_replace
+#undef GOURAUD
+#define TEXMAP
+#define BLEND_ALPHA
+#undef BLEND_ADD
+#undef ZBUF
+#define TEX_REPLACE
+#include "polytmpl.h"
+#undef TEX_REPLACE
+#undef POLYFILL
+
+#define POLYFILL polyfill_add_tex_replace
+#undef GOURAUD
+#define TEXMAP
+#undef BLEND_ALPHA
+#define BLEND_ADD
+#undef ZBUF
+#define TEX_REPLACE
+#include "polytmpl.h"
+#undef TEX_REPLACE
+#undef POLYFILL
+
 /* ---- zbuffer variants ----- */
 
 #define POLYFILL polyfill_flat_zbuf
@@ -296,7 +779,11 @@ void polyfill_add_tex_wire(struct pvertex *verts, int nverts)
 #undef BLEND_ALPHA
 #undef BLEND_ADD
 #define ZBUF
+#ifdef USE_SIMD_SPANS
+#define SPAN_SIMD	pfill_span_gouraud_zbuf_sse2
+#endif
 #include "polytmpl.h"
+#undef SPAN_SIMD
 #undef POLYFILL
 
 #define POLYFILL polyfill_gouraud_zbuf
@@ -305,7 +792,11 @@ void polyfill_add_tex_wire(struct pvertex *verts, int nverts)
 #undef BLEND_ALPHA
 #undef BLEND_ADD
 #define ZBUF
+#ifdef USE_SIMD_SPANS
+#define SPAN_SIMD	pfill_span_gouraud_zbuf_sse2
+#endif
 #include "polytmpl.h"
+#undef SPAN_SIMD
 #undef POLYFILL
 
 #define POLYFILL polyfill_tex_flat_zbuf
@@ -314,7 +805,11 @@ void polyfill_add_tex_wire(struct pvertex *verts, int nverts)
 #undef BLEND_ALPHA
 #undef BLEND_ADD
 #define ZBUF
+#ifdef USE_SIMD_SPANS
+#define SPAN_SIMD	pfill_span_tex_gouraud_zbuf_sse2
+#endif
 #include "polytmpl.h"
+#undef SPAN_SIMD
 #undef POLYFILL
 
 #define POLYFILL polyfill_tex_gouraud_zbuf
@@ -323,7 +818,11 @@ void polyfill_add_tex_wire(struct pvertex *verts, int nverts)
 #undef BLEND_ALPHA
 #undef BLEND_ADD
 #define ZBUF
+#ifdef USE_SIMD_SPANS
+#define SPAN_SIMD	pfill_span_tex_gouraud_zbuf_sse2
+#endif
 #include "polytmpl.h"
+#undef SPAN_SIMD
 #undef POLYFILL
 
 #define POLYFILL polyfill_alpha_flat_zbuf
@@ -350,7 +849,11 @@ void polyfill_add_tex_wire(struct pvertex *verts, int nverts)
 #define BLEND_ALPHA
 #undef BLEND_ADD
 #define ZBUF
+#ifdef USE_SIMD_SPANS
+#define SPAN_SIMD	pfill_span_alpha_tex_gouraud_zbuf_sse2
+#endif
 #include "polytmpl.h"
+#undef SPAN_SIMD
 #undef POLYFILL
 
 #define POLYFILL polyfill_alpha_tex_gouraud_zbuf
@@ -359,7 +862,11 @@ void polyfill_add_tex_wire(struct pvertex *verts, int nverts)
 #define BLEND_ALPHA
 #undef BLEND_ADD
 #define ZBUF
+#ifdef USE_SIMD_SPANS
+#define SPAN_SIMD	pfill_span_alpha_tex_gouraud_zbuf_sse2
+#endif
 #include "polytmpl.h"
+#undef SPAN_SIMD
 #undef POLYFILL
 
 #define POLYFILL polyfill_add_flat_zbuf
@@ -398,3 +905,258 @@ void polyfill_add_tex_wire(struct pvertex *verts, int nverts)
 #include "polytmpl.h"
 #undef POLYFILL
 
+#define POLYFILL polyfill_tex_replace_zbuf
+#undef GOURAUD
+#define TEXMAP
+#undef BLEND_ALPHA
+#undef BLEND_ADD
+#define ZBUF
+#define TEX_REPLACE
+#ifdef USE_SIMD_SPANS
+#define SPAN_SIMD	pfill_span_tex_replace_zbuf_sse2
+#endif
+#include "polytmpl.h"
+#undef SPAN_SIMD
+#undef TEX_REPLACE
+#undef POLYFILL
+
+#define POLYFILL polyfill_alpha_tex_replace_zbuf
+#undef GOURAUD
+#define TEXMAP
+#define BLEND_ALPHA
+#undef BLEND_ADD
+#define ZBUF
+#define TEX_REPLACE
+#ifdef USE_SIMD_SPANS
+#define SPAN_SIMD	pfill_span_alpha_tex_replace_zbuf_sse2
+#endif
+#include "polytmpl.h"
+#undef SPAN_SIMD
+#undef TEX_REPLACE
+#undef POLYFILL
+
+#define POLYFILL polyfill_add_tex_replace_zbuf
+#undef GOURAUD
+#define TEXMAP
+#undef BLEND_ALPHA
+#define BLEND_ADD
+#define ZBUF
+#define TEX_REPLACE
+#include "polytmpl.h"
+#undef TEX_REPLACE
+#undef POLYFILL
+
+/* depth only, for when color writes are masked */
+#define POLYFILL polyfill_zonly
+#undef GOURAUD
+#undef TEXMAP
+#undef BLEND_ALPHA
+#undef BLEND_ADD
+#define ZBUF
+#define ZONLY
+#include "polytmpl.h"
+#undef ZONLY
+#undef POLYFILL
+
+/* ---- perspective-correct texture mapping variants ---- */
+#define PERSPECTIVE
+
+#define POLYFILL polyfill_persp_tex_flat
+#undef GOURAUD
+#define TEXMAP
+#undef BLEND_ALPHA
+#undef BLEND_ADD
+#undef ZBUF
+#include "polytmpl.h"
+#undef POLYFILL
+
+#define POLYFILL polyfill_persp_tex_gouraud
+#define GOURAUD
+#define TEXMAP
+#undef BLEND_ALPHA
+#undef BLEND_ADD
+#undef ZBUF
+#include "polytmpl.h"
+#undef POLYFILL
+
+#define POLYFILL polyfill_alpha_persp_tex_flat
+#undef GOURAUD
+#define TEXMAP
+#define BLEND_ALPHA
+#undef BLEND_ADD
+#undef ZBUF
+#include "polytmpl.h"
+#undef POLYFILL
+
+#define POLYFILL polyfill_alpha_persp_tex_gouraud
+#define GOURAUD
+#define TEXMAP
+#define BLEND_ALPHA
+#undef BLEND_ADD
+#undef ZBUF
+#include "polytmpl.h"
+#undef POLYFILL
+
+#define POLYFILL polyfill_add_persp_tex_flat
+#undef GOURAUD
+#define TEXMAP
+#undef BLEND_ALPHA
+#define BLEND_ADD
+#undef ZBUF
+#include "polytmpl.h"
+#undef POLYFILL
+
+#define POLYFILL polyfill_add_persp_tex_gouraud
+#define GOURAUD
+#define TEXMAP
+#undef BLEND_ALPHA
+#define BLEND_ADD
+#undef ZBUF
+#include "polytmpl.h"
+#undef POLYFILL
+
+#define POLYFILL polyfill_persp_tex_flat_zbuf
+#undef GOURAUD
+#define TEXMAP
+#undef BLEND_ALPHA
+#undef BLEND_ADD
+#define ZBUF
+#ifdef USE_SIMD_SPANS
+#define SPAN_SIMD	pfill_span_tex_gouraud_zbuf_sse2
+#endif
+#include "polytmpl.h"
+#undef SPAN_SIMD
+#undef POLYFILL
+
+#define POLYFILL polyfill_persp_tex_gouraud_zbuf
+#define GOURAUD
+#define TEXMAP
+#undef BLEND_ALPHA
+#undef BLEND_ADD
+#define ZBUF
+#ifdef USE_SIMD_SPANS
+#define SPAN_SIMD	pfill_span_tex_gouraud_zbuf_sse2
+#endif
+#include "polytmpl.h"
+#undef SPAN_SIMD
+#undef POLYFILL
+
+#define POLYFILL polyfill_alpha_persp_tex_flat_zbuf
+#undef GOURAUD
+#define TEXMAP
+#define BLEND_ALPHA
+#undef BLEND_ADD
+#define ZBUF
+#ifdef USE_SIMD_SPANS
+#define SPAN_SIMD	pfill_span_alpha_tex_gouraud_zbuf_sse2
+#endif
+#include "polytmpl.h"
+#undef SPAN_SIMD
+#undef POLYFILL
+
+#define POLYFILL polyfill_alpha_persp_tex_gouraud_zbuf
+#define GOURAUD
+#define TEXMAP
+#define BLEND_ALPHA
+#undef BLEND_ADD
+#define ZBUF
+#ifdef USE_SIMD_SPANS
+#define SPAN_SIMD	pfill_span_alpha_tex_gouraud_zbuf_sse2
+#endif
+#include "polytmpl.h"
+#undef SPAN_SIMD
+#undef POLYFILL
+
+#define POLYFILL polyfill_add_persp_tex_flat_zbuf
+#undef GOURAUD
+#define TEXMAP
+#undef BLEND_ALPHA
+#define BLEND_ADD
+#define ZBUF
+#include "polytmpl.h"
+#undef POLYFILL
+
+#define POLYFILL polyfill_add_persp_tex_gouraud_zbuf
+#define GOURAUD
+#define TEXMAP
+#undef BLEND_ALPHA
+#define BLEND_ADD
+#define ZBUF
+#include "polytmpl.h"
+#undef POLYFILL
+
+#define POLYFILL polyfill_persp_tex_replace
+#undef GOURAUD
+#define TEXMAP
+#undef BLEND_ALPHA
+#undef BLEND_ADD
+#undef ZBUF
+#define TEX_REPLACE
+#include "polytmpl.h"
+#undef TEX_REPLACE
+#undef POLYFILL
+
+#define POLYFILL polyfill_alpha_persp_tex_replace
+#undef GOURAUD
+#define TEXMAP
+#define BLEND_ALPHA
+#undef BLEND_ADD
+#undef ZBUF
+#define TEX_REPLACE
+#include "polytmpl.h"
+#undef TEX_REPLACE
+#undef POLYFILL
+
+#define POLYFILL polyfill_add_persp_tex_replace
+#undef GOURAUD
+#define TEXMAP
+#undef BLEND_ALPHA
+#define BLEND_ADD
+#undef ZBUF
+#define TEX_REPLACE
+#include "polytmpl.h"
+#undef TEX_REPLACE
+#undef POLYFILL
+
+#define POLYFILL polyfill_persp_tex_replace_zbuf
+#undef GOURAUD
+#define TEXMAP
+#undef BLEND_ALPHA
+#undef BLEND_ADD
+#define ZBUF
+#define TEX_REPLACE
+#ifdef USE_SIMD_SPANS
+#define SPAN_SIMD	pfill_span_tex_replace_zbuf_sse2
+#endif
+#include "polytmpl.h"
+#undef SPAN_SIMD
+#undef TEX_REPLACE
+#undef POLYFILL
+
+#define POLYFILL polyfill_alpha_persp_tex_replace_zbuf
+#undef GOURAUD
+#define TEXMAP
+#define BLEND_ALPHA
+#undef BLEND_ADD
+#define ZBUF
+#define TEX_REPLACE
+#ifdef USE_SIMD_SPANS
+#define SPAN_SIMD	pfill_span_alpha_tex_replace_zbuf_sse2
+#endif
+#include "polytmpl.h"
+#undef SPAN_SIMD
+#undef TEX_REPLACE
+#undef POLYFILL
+
+#define POLYFILL polyfill_add_persp_tex_replace_zbuf
+#undef GOURAUD
+#define TEXMAP
+#undef BLEND_ALPHA
+#define BLEND_ADD
+#define ZBUF
+#define TEX_REPLACE
+#include "polytmpl.h"
+#undef TEX_REPLACE
+#undef POLYFILL
+
+#undef PERSPECTIVE
@@ -2,6 +2,7 @@
 #define POLYFILL_H_
 
 #include "../util.h"
+#include "../prof.h"
 #include "gaw.h"
 
 #define POLYFILL_MODE_MASK	0x03
@@ -9,15 +10,24 @@
 #define POLYFILL_ALPHA_BIT	0x08
 #define POLYFILL_ADD_BIT	0x10
 #define POLYFILL_ZBUF_BIT	0x20
+#define POLYFILL_PERSP_BIT	0x40
+/* not part of the fill function index: draw through the span buffer */
+#define POLYFILL_SBUF_BIT	0x80
 
+/* fill mode 3 ignores the vertex colors: textured polygons are drawn with the
+ * texels as they are (replace instead of modulate), and untextured zbuffered
+ * polygons only write depth.
+ */
 enum {
 	POLYFILL_WIRE			= 0,
 	POLYFILL_FLAT,
 	POLYFILL_GOURAUD,
+	POLYFILL_NOCOLOR,
 
 	POLYFILL_TEX_WIRE		= 4,
 	POLYFILL_TEX_FLAT,
 	POLYFILL_TEX_GOURAUD,
+	POLYFILL_TEX_REPLACE,
 
 	POLYFILL_ALPHA_WIRE		= 8,
 	POLYFILL_ALPHA_FLAT,
@@ -26,6 +36,7 @@ enum {
 	POLYFILL_ALPHA_TEX_WIRE	= 12,
 	POLYFILL_ALPHA_TEX_FLAT,
 	POLYFILL_ALPHA_TEX_GOURAUD,
+	POLYFILL_ALPHA_TEX_REPLACE,
 
 	POLYFILL_ADD_WIRE		= 16,
 	POLYFILL_ADD_FLAT,
@@ -34,15 +45,18 @@ enum {
 	POLYFILL_ADD_TEX_WIRE	= 20,
 	POLYFILL_ADD_TEX_FLAT,
 	POLYFILL_ADD_TEX_GOURAUD,
+	POLYFILL_ADD_TEX_REPLACE,
 
 
 	POLYFILL_WIRE_ZBUF			= 32,
 	POLYFILL_FLAT_ZBUF,
 	POLYFILL_GOURAUD_ZBUF,
+	POLYFILL_ZONLY,
 
 	POLYFILL_TEX_WIRE_ZBUF		= 36,
 	POLYFILL_TEX_FLAT_ZBUF,
 	POLYFILL_TEX_GOURAUD_ZBUF,
+	POLYFILL_TEX_REPLACE_ZBUF,
 
 	POLYFILL_ALPHA_WIRE_ZBUF	= 40,
 	POLYFILL_ALPHA_FLAT_ZBUF,
@@ -51,6 +65,7 @@ enum {
 	POLYFILL_ALPHA_TEX_WIRE_ZBUF = 44,
 	POLYFILL_ALPHA_TEX_FLAT_ZBUF,
 	POLYFILL_ALPHA_TEX_GOURAUD_ZBUF,
+	POLYFILL_ALPHA_TEX_REPLACE_ZBUF,
 
 	POLYFILL_ADD_WIRE_ZBUF		= 48,
 	POLYFILL_ADD_FLAT_ZBUF,
@@ -58,7 +73,29 @@ enum {
 
 	POLYFILL_ADD_TEX_WIRE_ZBUF	= 52,
 	POLYFILL_ADD_TEX_FLAT_ZBUF,
-	POLYFILL_ADD_TEX_GOURAUD_ZBUF
+	POLYFILL_ADD_TEX_GOURAUD_ZBUF,
+	POLYFILL_ADD_TEX_REPLACE_ZBUF,
+
+	/* perspective-correct texture mapping */
+	POLYFILL_PERSP_TEX_FLAT			= 69,
+	POLYFILL_PERSP_TEX_GOURAUD,
+	POLYFILL_PERSP_TEX_REPLACE,
+	POLYFILL_ALPHA_PERSP_TEX_FLAT	= 77,
+	POLYFILL_ALPHA_PERSP_TEX_GOURAUD,
+	POLYFILL_ALPHA_PERSP_TEX_REPLACE,
+	POLYFILL_ADD_PERSP_TEX_FLAT		= 85,
+	POLYFILL_ADD_PERSP_TEX_GOURAUD,
+	POLYFILL_ADD_PERSP_TEX_REPLACE,
+
+	POLYFILL_PERSP_TEX_FLAT_ZBUF		= 101,
+	POLYFILL_PERSP_TEX_GOURAUD_ZBUF,
+	POLYFILL_PERSP_TEX_REPLACE_ZBUF,
+	POLYFILL_ALPHA_PERSP_TEX_FLAT_ZBUF	= 109,
+	POLYFILL_ALPHA_PERSP_TEX_GOURAUD_ZBUF,
+	POLYFILL_ALPHA_PERSP_TEX_REPLACE_ZBUF,
+	POLYFILL_ADD_PERSP_TEX_FLAT_ZBUF	= 117,
+	POLYFILL_ADD_PERSP_TEX_GOURAUD_ZBUF,
+	POLYFILL_ADD_PERSP_TEX_REPLACE_ZBUF
 };
 
 typedef uint32_t gaw_pixel;
@@ -84,54 +121,308 @@ struct pvertex {
 	int32_t x, y; /* 24.8 fixed point */
 	int32_t u, v; /* 16.16 fixed point */
 	int32_t r, g, b, a;  /* int 0-255 */
-	int32_t z;	/* 0-65535 */
+	int32_t z;	/* 0-0xffffff, and the depth epoch tag in the top 8 bits */
+	float iw, iu, iv;	/* 1/w, u/w, v/w (u,v in 16.16) for perspective correction */
 };
 
 struct pimage {
 	gaw_pixel *pixels;
 	int width, height;
+	int pitch;		/* framebuffer only: pixels from one scanline to the next */
 
 	int xshift, yshift;
 	unsigned int xmask, ymask;
+
+	/* mipmapped textures only: the image pyramid, levels[0] is full size */
+	struct pimage *levels;
+	int num_levels;
+
+	int opaque;		/* textures only: all texels have alpha 255 */
+};
+
+/* rasterizer counters, summed over all threads by polyfill_stats */
+struct pfill_stats {
+	unsigned long hiz_tested;	/* zbuffered polygons tested against the hi-z buffer */
+	unsigned long hiz_polys;	/* ... and rejected without drawing anything */
+	unsigned long hiz_pixels;	/* pixels of tile-sized span runs it rejected */
+	unsigned long sbuf_pixels;	/* pixels rejected by the span buffer */
+	unsigned long pixels;		/* pixels covered by the spans of polygons drawn */
+	unsigned long zfail;		/* pixels failing the depth test (DBG_PROFILE only) */
+};
+
+/* rasterizer context: edge tables, and the range of scanlines (inclusive)
+ * the fill functions are allowed to touch. The single-threaded path uses one
+ * context spanning the whole framebuffer, each rasterizer thread has its own
+ * covering the band it's currently drawing (see polymt.c).
+ */
+struct pfill_ctx {
+	struct pvertex *edgebuf, *left, *right;
+	int edgebuf_size;
+	int ytop, ybot;
+	int xmin, xmax;	/* columns to draw: [xmin, xmax) */
+	const struct pimage *tex;
+	float tex_lod;	/* mip level at w = 1, for per-span mip selection */
+	int sbuf;		/* current polygon is drawn through the span buffer */
+
+	struct pfill_stats stats;
 };
 
 extern struct pimage pfill_fb;
 extern struct pimage pfill_tex;
 extern uint32_t *pfill_zbuf;
 
+/* rectangle of the framebuffer polygons are clipped to, [x0, x1) columns and
+ * [y0, y1) scanlines from the top. Set with polyfill_clip.
+ */
+struct pfill_rect {
+	int x0, y0, x1, y1;
+};
+
+extern struct pfill_rect pfill_clip;
+
+/* perspective-correct fillers compute the exact texture coordinates every
+ * pfill_persp_span pixels, and interpolate linearly in between (default 16)
+ */
+extern int pfill_persp_span;
+
+/* area mip level (half the log2 of texels per pixel) of the current polygon
+ * at w = 1. It goes as 1.5 * log2(w) across a plane, and the perspective-correct
+ * fillers use it to pick a mip level per span, if pfill_tex has mipmaps.
+ */
+extern float pfill_tex_lod;
+
+/* hierarchical z buffer: the farthest depth in each HIZ_SIZE x HIZ_SIZE tile of
+ * pfill_zbuf, or something farther if the tile has been marked dirty since
+ * that was computed. Maintained by the zbuffered fillers, which use it to
+ * skip polygons and span runs entirely behind what's already drawn.
+ */
+#define HIZ_SHIFT	3
+#define HIZ_SIZE	(1 << HIZ_SHIFT)
+
+extern uint32_t *pfill_hiz;
+extern unsigned char *pfill_hiz_dirty;
+extern int pfill_hiz_cols;
+
+/* span buffer: for each scanline, a sorted list of the intervals covered by
+ * polygons drawn with POLYFILL_SBUF_BIT since the last depth clear, each with
+ * the farthest depth drawn in it. Zbuffer values only ever decrease, so that
+ * stays an upper bound of the zbuffer over the interval even after other
+ * polygons are drawn, and runs of pixels behind it are skipped without
+ * touching the zbuffer. Drawing polygons front to back, the uncovered parts of
+ * each span are the only ones which get drawn at all.
+ */
+#define SBUF_MAX_SPANS	64
+
+struct pfill_sspan {
+	int16_t x0, x1;		/* covered interval [x0, x1) */
+	uint32_t zmax;
+};
+
+extern struct pfill_sspan *pfill_sbuf;
+extern unsigned char *pfill_sbuf_num;
+
+extern void (*fillfunc[])(struct pfill_ctx*, struct pvertex*, int);
+
 void polyfill_fbheight(int height);
 
+/* clip all subsequent polygons to a rectangle, within the framebuffer which
+ * must have been set up already. Reset it to the whole framebuffer whenever
+ * that changes.
+ */
+void polyfill_clip(int x0, int y0, int x1, int y1);
+
+/* (re)allocate the hi-z buffer for a framebuffer size, and reset it to match
+ * the zbuffer after clearing to depth
+ */
+void polyfill_hiz_size(int width, int height);
+void polyfill_hiz_clear(uint32_t depth);
+/* enable/disable hi-z rejection (on by default) */
+void polyfill_hiz(int enable);
+
+/* forget everything covered in the span buffer, on depth clears */
+void polyfill_sbuf_clear(void);
+
+/* clearing the whole framebuffer, ordered with polygons: with rasterizer
+ * threads it's queued like them, and each thread clears the bands it draws.
+ * PFILL_CLEAR_DEPTH resets the span buffer and sets the hi-z buffer to
+ * hiz_depth, which may be farther than the zbuffer contents if those are
+ * known to be.
+ */
+#define PFILL_CLEAR_COLOR	1	/* fill the color buffer with color */
+#define PFILL_CLEAR_ZBUF	2	/* fill the zbuffer with depth */
+#define PFILL_CLEAR_DEPTH	4	/* reset span buffer and hi-z */
+
+struct pfill_clear {
+	unsigned int flags;
+	uint32_t color, depth, hiz_depth;
+};
+
+void polyfill_clear(const struct pfill_clear *clr);
+/* do the clear for scanlines y0 to y1 (inclusive) only */
+void polyfill_clear_rows(const struct pfill_clear *clr, int y0, int y1);
+
+/* read the counters accumulated since the last reset */
+void polyfill_stats(struct pfill_stats *st);
+void polyfill_reset_stats(void);
+
+/* (re)allocate the edge tables of a context to fit height scanlines */
+void polyfill_ctx_height(struct pfill_ctx *ctx, int height);
+void polyfill_ctx_destroy(struct pfill_ctx *ctx);
+
 void polyfill(int mode, struct pvertex *verts, int nverts);
 
-void polyfill_wire(struct pvertex *verts, int nverts);
-void polyfill_flat(struct pvertex *verts, int nverts);
-void polyfill_gouraud(struct pvertex *verts, int nverts);
-void polyfill_tex_wire(struct pvertex *verts, int nverts);
-void polyfill_tex_flat(struct pvertex *verts, int nverts);
-void polyfill_tex_gouraud(struct pvertex *verts, int nverts);
-void polyfill_alpha_wire(struct pvertex *verts, int nverts);
-void polyfill_alpha_flat(struct pvertex *verts, int nverts);
-void polyfill_alpha_gouraud(struct pvertex *verts, int nverts);
-void polyfill_alpha_tex_wire(struct pvertex *verts, int nverts);
-void polyfill_alpha_tex_flat(struct pvertex *verts, int nverts);
-void polyfill_alpha_tex_gouraud(struct pvertex *verts, int nverts);
-void polyfill_add_wire(struct pvertex *verts, int nverts);
-void polyfill_add_flat(struct pvertex *verts, int nverts);
-void polyfill_add_gouraud(struct pvertex *verts, int nverts);
-void polyfill_add_tex_wire(struct pvertex *verts, int nverts);
-void polyfill_add_tex_flat(struct pvertex *verts, int nverts);
-void polyfill_add_tex_gouraud(struct pvertex *verts, int nverts);
-void polyfill_flat_zbuf(struct pvertex *verts, int nverts);
-void polyfill_gouraud_zbuf(struct pvertex *verts, int nverts);
-void polyfill_tex_flat_zbuf(struct pvertex *verts, int nverts);
-void polyfill_tex_gouraud_zbuf(struct pvertex *verts, int nverts);
-void polyfill_alpha_flat_zbuf(struct pvertex *verts, int nverts);
-void polyfill_alpha_gouraud_zbuf(struct pvertex *verts, int nverts);
-void polyfill_alpha_tex_flat_zbuf(struct pvertex *verts, int nverts);
-void polyfill_alpha_tex_gouraud_zbuf(struct pvertex *verts, int nverts);
-void polyfill_add_flat_zbuf(struct pvertex *verts, int nverts);
-void polyfill_add_gouraud_zbuf(struct pvertex *verts, int nverts);
-void polyfill_add_tex_flat_zbuf(struct pvertex *verts, int nverts);
-void polyfill_add_tex_gouraud_zbuf(struct pvertex *verts, int nverts);
+/* set the number of rasterizer threads (0: one per processor). With more than
+ * one thread, polyfill only records polygons, which are drawn at the next
+ * polyfill_flush. Returns the number of threads actually used.
+ */
+int polyfill_threads(int nthr);
+void polyfill_flush(void);
+
+/* asynchronous rasterization: polygons are always queued, and polyfill_submit
+ * hands the queue over to a dedicated render thread (driving the rasterizer
+ * threads if any) and returns immediately, after waiting for the previous one
+ * to be drawn. Recording then continues in a second queue. polyfill_flush
+ * submits and waits for everything to be drawn.
+ */
+void polyfill_pipeline(int enable);
+void polyfill_submit(void);
+
+/* framebuffer pixels everything recorded from now on is drawn into. Submits
+ * what's been queued so far, to be drawn into the previous target.
+ */
+void polyfill_target(gaw_pixel *pixels);
+
+/* cheap approximation of log2, good enough for picking mip levels */
+static __inline float pfill_log2(float x)
+{
+	union {
+		float f;
+		int32_t i;
+	} u;
+	u.f = x;
+	/* exponent, plus the mantissa as a linear approximation of the rest */
+	return (float)((u.i >> 23) & 0xff) - 127.0f +
+		(float)(u.i & 0x7fffff) * (1.0f / 8388608.0f);
+}
+
+/* SSE2 span fillers (see spansse.c), for the most common fill modes. They're
+ * built on x86 with compilers which provide SSE2 intrinsics, and used if the
+ * CPU supports SSE2 and polyfill_simd is enabled.
+ */
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__) || \
+	(defined(__GNUC__) && defined(__i386__) && \
+	 (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))) || \
+	(defined(_MSC_VER) && _MSC_VER >= 1400 && defined(_M_IX86))
+#define PFILL_SSE2
+#endif
+
+/* enable/disable the SIMD span fillers, the scalar ones are the reference.
+ * Returns whether they're actually enabled.
+ */
+int polyfill_simd(int enable);
+
+/* used internally by polyfill, see polymt.c */
+extern int pfill_mt_active;
+void polyfill_mt_add(int mode, struct pvertex *verts, int nverts);
+void polyfill_mt_clear(const struct pfill_clear *clr);
+void polyfill_mt_fbheight(int height);
+void polyfill_mt_stats(struct pfill_stats *st, int reset);
+
+/* hi-z tests used by the zbuffered fillers */
+extern int pfill_hiz_enable;
+int pfill_hiz_reject(struct pfill_ctx *ctx, struct pvertex *varr, int vnum);
+int pfill_hiz_run(int x, int y, int len, int32_t z, int32_t zslope);
+int pfill_sbuf_run(int x, int y, int len, int32_t z, int32_t zslope);
+/* the above combined, as they apply to the current polygon of a context */
+int pfill_zrun(struct pfill_ctx *ctx, int x, int y, int len, int32_t z, int32_t zslope);
+
+/* used internally by polyfill, see spansse.c */
+extern int pfill_simd;
+
+/* extra bits of precision to use when interpolating colors.
+ * try tweaking this if you notice strange quantization artifacts.
+ */
+#define COLOR_SHIFT	12
+
+/* a horizontal run of pixels with everything interpolating linearly along it.
+ * Span fillers advance it past the pixels they draw.
+ */
+struct pfill_span {
+	gaw_pixel *pptr;
+	uint32_t *zptr;
+	int32_t r, g, b, a, rslope, gslope, bslope, aslope;
+	int32_t u, v, uslope, vslope;
+	int32_t z, zslope;
+	const struct pimage *tex;
+	unsigned long zfail;	/* counted with DBG_PROFILE */
+};
+
+/* advance a span past n pixels without drawing them */
+void pfill_span_skip(struct pfill_span *span, int n);
+
+#ifdef PFILL_SSE2
+int pfill_cpu_sse2(void);
+void pfill_span_gouraud_zbuf_sse2(struct pfill_span *span, int len);
+void pfill_span_tex_gouraud_zbuf_sse2(struct pfill_span *span, int len);
+void pfill_span_alpha_tex_gouraud_zbuf_sse2(struct pfill_span *span, int len);
+void pfill_span_tex_replace_zbuf_sse2(struct pfill_span *span, int len);
+void pfill_span_alpha_tex_replace_zbuf_sse2(struct pfill_span *span, int len);
+#endif
+
+void polyfill_wire(struct pfill_ctx *ctx, struct pvertex *verts, int nverts);
+void polyfill_flat(struct pfill_ctx *ctx, struct pvertex *verts, int nverts);
+void polyfill_gouraud(struct pfill_ctx *ctx, struct pvertex *verts, int nverts);
+void polyfill_tex_wire(struct pfill_ctx *ctx, struct pvertex *verts, int nverts);
+void polyfill_tex_flat(struct pfill_ctx *ctx, struct pvertex *verts, int nverts);
+void polyfill_tex_gouraud(struct pfill_ctx *ctx, struct pvertex *verts, int nverts);
+void polyfill_alpha_wire(struct pfill_ctx *ctx, struct pvertex *verts, int nverts);
+void polyfill_alpha_flat(struct pfill_ctx *ctx, struct pvertex *verts, int nverts);
+void polyfill_alpha_gouraud(struct pfill_ctx *ctx, struct pvertex *verts, int nverts);
+void polyfill_alpha_tex_wire(struct pfill_ctx *ctx, struct pvertex *verts, int nverts);
+void polyfill_alpha_tex_flat(struct pfill_ctx *ctx, struct pvertex *verts, int nverts);
+void polyfill_alpha_tex_gouraud(struct pfill_ctx *ctx, struct pvertex *verts, int nverts);
+void polyfill_add_wire(struct pfill_ctx *ctx, struct pvertex *verts, int nverts);
+void polyfill_add_flat(struct pfill_ctx *ctx, struct pvertex *verts, int nverts);
+void polyfill_add_gouraud(struct pfill_ctx *ctx, struct pvertex *verts, int nverts);
+void polyfill_add_tex_wire(struct pfill_ctx *ctx, struct pvertex *verts, int nverts);
+void polyfill_add_tex_flat(struct pfill_ctx *ctx, struct pvertex *verts, int nverts);
+void polyfill_add_tex_gouraud(struct pfill_ctx *ctx, struct pvertex *verts, int nverts);
+void polyfill_flat_zbuf(struct pfill_ctx *ctx, struct pvertex *verts, int nverts);
+void polyfill_gouraud_zbuf(struct pfill_ctx *ctx, struct pvertex *verts, int nverts);
+void polyfill_tex_flat_zbuf(struct pfill_ctx *ctx, struct pvertex *verts, int nverts);
+void polyfill_tex_gouraud_zbuf(struct pfill_ctx *ctx, struct pvertex *verts, int nverts);
+void polyfill_alpha_flat_zbuf(struct pfill_ctx *ctx, struct pvertex *verts, int nverts);
+void polyfill_alpha_gouraud_zbuf(struct pfill_ctx *ctx, struct pvertex *verts, int nverts);
+void polyfill_alpha_tex_flat_zbuf(struct pfill_ctx *ctx, struct pvertex *verts, int nverts);
+void polyfill_alpha_tex_gouraud_zbuf(struct pfill_ctx *ctx, struct pvertex *verts, int nverts);
+void polyfill_add_flat_zbuf(struct pfill_ctx *ctx, struct pvertex *verts, int nverts);
+void polyfill_add_gouraud_zbuf(struct pfill_ctx *ctx, struct pvertex *verts, int nverts);
+void polyfill_add_tex_flat_zbuf(struct pfill_ctx *ctx, struct pvertex *verts, int nverts);
+void polyfill_add_tex_gouraud_zbuf(struct pfill_ctx *ctx, struct pvertex *verts, int nverts);
+void polyfill_persp_tex_flat(struct pfill_ctx *ctx, struct pvertex *verts, int nverts);
+void polyfill_persp_tex_gouraud(struct pfill_ctx *ctx, struct pvertex *verts, int nverts);
+void polyfill_alpha_persp_tex_flat(struct pfill_ctx *ctx, struct pvertex *verts, int nverts);
+void polyfill_alpha_persp_tex_gouraud(struct pfill_ctx *ctx, struct pvertex *verts, int nverts);
+void polyfill_add_persp_tex_flat(struct pfill_ctx *ctx, struct pvertex *verts, int nverts);
+void polyfill_add_persp_tex_gouraud(struct pfill_ctx *ctx, struct pvertex *verts, int nverts);
+void polyfill_persp_tex_flat_zbuf(struct pfill_ctx *ctx, struct pvertex *verts, int nverts);
+void polyfill_persp_tex_gouraud_zbuf(struct pfill_ctx *ctx, struct pvertex *verts, int nverts);
+void polyfill_alpha_persp_tex_flat_zbuf(struct pfill_ctx *ctx, struct pvertex *verts, int nverts);
+void polyfill_alpha_persp_tex_gouraud_zbuf(struct pfill_ctx *ctx, struct pvertex *verts, int nverts);
+void polyfill_add_persp_tex_flat_zbuf(struct pfill_ctx *ctx, struct pvertex *verts, int nverts);
+void polyfill_add_persp_tex_gouraud_zbuf(struct pfill_ctx *ctx, struct pvertex *verts, int nverts);
+void polyfill_tex_replace(struct pfill_ctx *ctx, struct pvertex *verts, int nverts);
+void polyfill_alpha_tex_replace(struct pfill_ctx *ctx, struct pvertex *verts, int nverts);
+void polyfill_add_tex_replace(struct pfill_ctx *ctx, struct pvertex *verts, int nverts);
+void polyfill_zonly(struct pfill_ctx *ctx, struct pvertex *verts, int nverts);
+void polyfill_tex_replace_zbuf(struct pfill_ctx *ctx, struct pvertex *verts, int nverts);
+void polyfill_alpha_tex_replace_zbuf(struct pfill_ctx *ctx, struct pvertex *verts, int nverts);
+void polyfill_add_tex_replace_zbuf(struct pfill_ctx *ctx, struct pvertex *verts, int nverts);
+void polyfill_persp_tex_replace(struct pfill_ctx *ctx, struct pvertex *verts, int nverts);
+void polyfill_alpha_persp_tex_replace(struct pfill_ctx *ctx, struct pvertex *verts, int nverts);
+void polyfill_add_persp_tex_replace(struct pfill_ctx *ctx, struct pvertex *verts, int nverts);
+void polyfill_persp_tex_replace_zbuf(struct pfill_ctx *ctx, struct pvertex *verts, int nverts);
+void polyfill_alpha_persp_tex_replace_zbuf(struct pfill_ctx *ctx, struct pvertex *verts, int nverts);
+void polyfill_add_persp_tex_replace_zbuf(struct pfill_ctx *ctx, struct pvertex *verts, int nverts);
 
 #endif	/* POLYFILL_H_ */
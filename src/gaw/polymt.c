@@ -0,0 +1,696 @@
+/*
+Deep Runner - 6dof shooter game for the SGI O2.
+Copyright (C) 2023  John Tsiombikas <nuclear@mutantstargoat.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+/* Band-parallel rasterization.
+ *
+ * With more than one rasterizer thread, polyfill doesn't draw immediately.
+ * Polygons are recorded along with the texture they use, and binned into
+ * horizontal bands of the framebuffer. At polyfill_flush, the threads grab
+ * bands one at a time and draw all the polygons touching each band, clipped
+ * to its scanlines. Every band is drawn by a single thread, in submission
+ * order, so the result is identical to drawing everything on one thread.
+ * Clears are recorded too, and each band clears its own scanlines.
+ *
+ * With polyfill_pipeline, there are two queues: a render thread takes the
+ * place of the caller in drawing a submitted queue, while the next one is
+ * recorded. Everything the queued commands read (textures, the framebuffer
+ * and rasterizer settings) must only change after a polyfill_flush.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "polyfill.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#define MAX_THREADS		16
+/* more bands than threads, to even out the load when some parts of the
+ * screen are much busier than others
+ */
+#define BANDS_PER_THREAD	4
+/* keep bands aligned to this many scanlines. Must be a multiple of HIZ_SIZE,
+ * so that each hi-z tile is only ever touched by one thread at a time.
+ */
+#define BAND_ALIGN		8
+/* flush automatically if this many polygons have been queued */
+#define MAX_QUEUED		65536
+
+/* prim mode of clears, which keep their parameters in clr */
+#define PRIM_CLEAR	(-1)
+
+struct prim {
+	int mode;
+	int vidx, nverts;
+	struct pimage tex;
+	float tex_lod;
+	struct pfill_rect clip;
+	struct pfill_clear clr;
+};
+
+struct band {
+	int ytop, ybot;
+};
+
+/* indices of the prims touching a band, in submission order */
+struct bin {
+	int *prims;
+	int num_prims, max_prims;
+};
+
+struct queue {
+	struct prim *prims;
+	int num_prims, max_prims;
+	struct pvertex *vpool;
+	int num_verts, max_verts;
+	struct bin *bins;
+	gaw_pixel *pixels;		/* framebuffer it's drawn into, when pipelined */
+};
+
+int pfill_mt_active;
+
+static int num_thr = 1;
+static int fbheight;
+static int pipeline;
+
+static struct pfill_ctx thr_ctx[MAX_THREADS];
+
+/* recq is recorded by the caller, drawq is drawn by the rasterizer threads.
+ * Without the pipeline they're the same queue.
+ */
+static struct queue queues[2];
+static struct queue *recq = queues, *drawq = queues;
+static gaw_pixel *rec_pixels;
+
+static struct band *bands;
+static int num_bands, band_height;
+
+static int next_band;
+
+static void setup_bands(void);
+static struct prim *add_prim(int ymin, int ymax);
+static void draw_queue(struct queue *q);
+static void draw_bands(struct pfill_ctx *ctx);
+static void start_render_thread(void);
+static void stop_render_thread(void);
+static void wait_render_thread(void);
+static int num_cpus(void);
+
+#ifdef _WIN32
+static DWORD WINAPI worker(void *cls);
+
+static DWORD WINAPI render_thread(void *cls);
+
+static HANDLE thr[MAX_THREADS];
+static HANDLE ev_start[MAX_THREADS], ev_done;
+static CRITICAL_SECTION band_lock;
+static volatile LONG num_busy, quit;
+
+static HANDLE rthr, ev_submit, ev_idle;
+static volatile LONG render_busy, render_quit;
+#else
+static void *worker(void *cls);
+static void *render_thread(void *cls);
+
+static pthread_t thr[MAX_THREADS];
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond_start = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t cond_done = PTHREAD_COND_INITIALIZER;
+static int num_busy, job_gen, quit;
+
+static pthread_t rthr;
+static pthread_cond_t cond_submit = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t cond_idle = PTHREAD_COND_INITIALIZER;
+static int render_busy, render_quit;
+#endif
+
+
+static void stop_threads(void)
+{
+	int i;
+
+	if(num_thr <= 1) return;
+
+	polyfill_flush();
+
+#ifdef _WIN32
+	quit = 1;
+	for(i=1; i<num_thr; i++) {
+		SetEvent(ev_start[i]);
+	}
+	for(i=1; i<num_thr; i++) {
+		WaitForSingleObject(thr[i], INFINITE);
+		CloseHandle(thr[i]);
+		CloseHandle(ev_start[i]);
+	}
+	CloseHandle(ev_done);
+	DeleteCriticalSection(&band_lock);
+#else
+	pthread_mutex_lock(&mutex);
+	quit = 1;
+	pthread_cond_broadcast(&cond_start);
+	pthread_mutex_unlock(&mutex);
+
+	for(i=1; i<num_thr; i++) {
+		pthread_join(thr[i], 0);
+	}
+#endif
+
+	for(i=1; i<num_thr; i++) {
+		polyfill_ctx_destroy(thr_ctx + i);
+	}
+	num_thr = 1;
+	pfill_mt_active = pipeline;
+}
+
+int polyfill_threads(int nthr)
+{
+	int i;
+
+	if(nthr <= 0) {
+		nthr = num_cpus();
+	}
+	if(nthr > MAX_THREADS) nthr = MAX_THREADS;
+	if(nthr < 1) nthr = 1;
+
+	if(nthr == num_thr) {
+		return num_thr;
+	}
+	/* the pipeline render thread may be drawing from the bins we're about to
+	 * rebuild, even without workers to stop
+	 */
+	polyfill_flush();
+	stop_threads();
+
+	if(nthr <= 1) {
+		setup_bands();
+		return 1;
+	}
+
+	quit = 0;
+#ifdef _WIN32
+	InitializeCriticalSection(&band_lock);
+	ev_done = CreateEvent(0, FALSE, FALSE, 0);
+#else
+	job_gen = 0;	/* new workers start waiting for generation 0 */
+#endif
+
+	/* thread 0 is the caller, which also draws its share of bands */
+	for(i=1; i<nthr; i++) {
+#ifdef _WIN32
+		ev_start[i] = CreateEvent(0, FALSE, FALSE, 0);
+		if(!(thr[i] = CreateThread(0, 0, worker, thr_ctx + i, 0, 0))) {
+			CloseHandle(ev_start[i]);
+			break;
+		}
+#else
+		if(pthread_create(thr + i, 0, worker, thr_ctx + i) != 0) {
+			break;
+		}
+#endif
+	}
+	if(i < nthr) {
+		fprintf(stderr, "polyfill: failed to create rasterizer threads, using %d\n", i);
+	}
+	num_thr = i;
+	pfill_mt_active = num_thr > 1 || pipeline;
+
+	setup_bands();
+	return num_thr;
+}
+
+void polyfill_pipeline(int enable)
+{
+	if(!enable == !pipeline) return;
+
+	polyfill_flush();
+
+	if(enable) {
+		rec_pixels = pfill_fb.pixels;
+		start_render_thread();
+	} else {
+		stop_render_thread();
+	}
+	pfill_mt_active = num_thr > 1 || pipeline;
+	setup_bands();
+}
+
+void polyfill_mt_fbheight(int height)
+{
+	polyfill_flush();
+
+	fbheight = height;
+	setup_bands();
+}
+
+void polyfill_mt_stats(struct pfill_stats *st, int reset)
+{
+	int i, j, nfields = sizeof *st / sizeof(unsigned long);
+	unsigned long *dst, *src;
+
+	for(i=0; i<MAX_THREADS; i++) {
+		if(st) {
+			/* all the members are unsigned long counters */
+			dst = (unsigned long*)st;
+			src = (unsigned long*)&thr_ctx[i].stats;
+			for(j=0; j<nfields; j++) {
+				dst[j] += src[j];
+			}
+		}
+		if(reset) {
+			memset(&thr_ctx[i].stats, 0, sizeof thr_ctx[i].stats);
+		}
+	}
+}
+
+static void setup_bands(void)
+{
+	int i, j, y;
+	struct queue *q;
+
+	if(!pfill_mt_active || fbheight <= 0) return;
+
+	band_height = fbheight / (num_thr * BANDS_PER_THREAD);
+	band_height = (band_height + BAND_ALIGN - 1) & ~(BAND_ALIGN - 1);
+	if(band_height < BAND_ALIGN) band_height = BAND_ALIGN;
+
+	for(i=0; i<2; i++) {
+		q = queues + i;
+		for(j=0; j<num_bands; j++) {
+			free(q->bins[j].prims);
+		}
+		free(q->bins);
+	}
+	free(bands);
+
+	num_bands = (fbheight + band_height - 1) / band_height;
+	bands = calloc_nf(num_bands, sizeof *bands);
+	for(i=0; i<2; i++) {
+		queues[i].bins = calloc_nf(num_bands, sizeof *queues[i].bins);
+	}
+
+	y = 0;
+	for(i=0; i<num_bands; i++) {
+		bands[i].ytop = y;
+		y += band_height;
+		bands[i].ybot = (y > fbheight ? fbheight : y) - 1;
+	}
+
+	for(i=0; i<num_thr; i++) {
+		polyfill_ctx_height(thr_ctx + i, band_height);
+	}
+}
+
+void polyfill_mt_add(int mode, struct pvertex *verts, int nverts)
+{
+	int i, ymin, ymax;
+	struct prim *p;
+	struct queue *q;
+
+	ymin = ymax = verts[0].y;
+	for(i=1; i<nverts; i++) {
+		if(verts[i].y < ymin) ymin = verts[i].y;
+		if(verts[i].y > ymax) ymax = verts[i].y;
+	}
+	ymin >>= 8;
+	ymax >>= 8;
+	if(ymin < pfill_clip.y0) ymin = pfill_clip.y0;
+	if(ymax >= pfill_clip.y1) ymax = pfill_clip.y1 - 1;
+	if(ymin > ymax) return;
+
+	if(recq->num_prims >= MAX_QUEUED) {
+		polyfill_submit();
+	}
+	q = recq;
+
+	if(q->num_verts + nverts > q->max_verts) {
+		q->max_verts = q->max_verts ? q->max_verts * 2 : 4096;
+		q->vpool = realloc_nf(q->vpool, q->max_verts * sizeof *q->vpool);
+	}
+
+	p = add_prim(ymin, ymax);
+	p->mode = mode;
+	p->vidx = q->num_verts;
+	p->nverts = nverts;
+	p->tex = pfill_tex;
+	p->tex_lod = pfill_tex_lod;
+	p->clip = pfill_clip;
+
+	memcpy(q->vpool + q->num_verts, verts, nverts * sizeof *q->vpool);
+	q->num_verts += nverts;
+}
+
+void polyfill_mt_clear(const struct pfill_clear *clr)
+{
+	struct prim *p;
+
+	if(recq->num_prims >= MAX_QUEUED) {
+		polyfill_submit();
+	}
+
+	p = add_prim(0, fbheight - 1);
+	p->mode = PRIM_CLEAR;
+	p->clr = *clr;
+}
+
+/* append a prim to the record queue, in the bins of the bands it touches */
+static struct prim *add_prim(int ymin, int ymax)
+{
+	int i, b0, b1, pidx;
+	struct queue *q = recq;
+	struct bin *bin;
+
+	if(q->num_prims >= q->max_prims) {
+		q->max_prims = q->max_prims ? q->max_prims * 2 : 1024;
+		q->prims = realloc_nf(q->prims, q->max_prims * sizeof *q->prims);
+	}
+	pidx = q->num_prims++;
+
+	b0 = ymin / band_height;
+	b1 = ymax / band_height;
+	bin = q->bins + b0;
+	for(i=b0; i<=b1; i++) {
+		if(bin->num_prims >= bin->max_prims) {
+			bin->max_prims = bin->max_prims ? bin->max_prims * 2 : 256;
+			bin->prims = realloc_nf(bin->prims, bin->max_prims * sizeof *bin->prims);
+		}
+		bin->prims[bin->num_prims++] = pidx;
+		bin++;
+	}
+	return q->prims + pidx;
+}
+
+void polyfill_flush(void)
+{
+	if(!pipeline) {
+		if(recq->num_prims) {
+			draw_queue(recq);
+		}
+		return;
+	}
+
+	polyfill_submit();
+	wait_render_thread();
+	pfill_fb.pixels = rec_pixels;
+}
+
+void polyfill_submit(void)
+{
+	if(!pipeline) {
+		polyfill_flush();
+		return;
+	}
+	if(!recq->num_prims) return;
+
+	wait_render_thread();
+
+	recq->pixels = rec_pixels;
+	drawq = recq;
+	recq = recq == queues ? queues + 1 : queues;
+
+#ifdef _WIN32
+	render_busy = 1;
+	SetEvent(ev_submit);
+#else
+	pthread_mutex_lock(&mutex);
+	render_busy = 1;
+	pthread_cond_signal(&cond_submit);
+	pthread_mutex_unlock(&mutex);
+#endif
+}
+
+void polyfill_target(gaw_pixel *pixels)
+{
+	polyfill_submit();
+	rec_pixels = pixels;
+	if(!pipeline) {
+		pfill_fb.pixels = pixels;
+	}
+}
+
+/* draw a queue with all the rasterizer threads, and empty it */
+static void draw_queue(struct queue *q)
+{
+	int i;
+
+	drawq = q;
+	next_band = 0;
+	num_busy = num_thr - 1;
+
+#ifdef _WIN32
+	for(i=1; i<num_thr; i++) {
+		SetEvent(ev_start[i]);
+	}
+	draw_bands(thr_ctx);
+	if(num_thr > 1) {
+		WaitForSingleObject(ev_done, INFINITE);
+	}
+#else
+	pthread_mutex_lock(&mutex);
+	job_gen++;
+	pthread_cond_broadcast(&cond_start);
+	pthread_mutex_unlock(&mutex);
+
+	draw_bands(thr_ctx);
+
+	pthread_mutex_lock(&mutex);
+	while(num_busy > 0) {
+		pthread_cond_wait(&cond_done, &mutex);
+	}
+	pthread_mutex_unlock(&mutex);
+#endif
+
+	for(i=0; i<num_bands; i++) {
+		q->bins[i].num_prims = 0;
+	}
+	q->num_prims = 0;
+	q->num_verts = 0;
+}
+
+static int grab_band(void)
+{
+	int b;
+#ifdef _WIN32
+	EnterCriticalSection(&band_lock);
+	b = next_band++;
+	LeaveCriticalSection(&band_lock);
+#else
+	pthread_mutex_lock(&mutex);
+	b = next_band++;
+	pthread_mutex_unlock(&mutex);
+#endif
+	return b;
+}
+
+static void draw_bands(struct pfill_ctx *ctx)
+{
+	int i, b;
+	struct band *band;
+	struct bin *bin;
+	struct prim *p;
+	struct queue *q = drawq;
+
+	while((b = grab_band()) < num_bands) {
+		band = bands + b;
+		bin = q->bins + b;
+
+		for(i=0; i<bin->num_prims; i++) {
+			p = q->prims + bin->prims[i];
+			if(p->mode == PRIM_CLEAR) {
+				polyfill_clear_rows(&p->clr, band->ytop, band->ybot);
+				continue;
+			}
+			/* scanlines of the band within the clip rectangle of the polygon */
+			ctx->ytop = band->ytop > p->clip.y0 ? band->ytop : p->clip.y0;
+			ctx->ybot = band->ybot < p->clip.y1 - 1 ? band->ybot : p->clip.y1 - 1;
+			ctx->xmin = p->clip.x0;
+			ctx->xmax = p->clip.x1;
+			ctx->tex = &p->tex;
+			ctx->tex_lod = p->tex_lod;
+			ctx->sbuf = p->mode & POLYFILL_SBUF_BIT;
+			fillfunc[p->mode & ~POLYFILL_SBUF_BIT](ctx, q->vpool + p->vidx, p->nverts);
+		}
+	}
+}
+
+#ifdef _WIN32
+static DWORD WINAPI worker(void *cls)
+{
+	struct pfill_ctx *ctx = cls;
+	int id = ctx - thr_ctx;
+
+	for(;;) {
+		WaitForSingleObject(ev_start[id], INFINITE);
+		if(quit) break;
+
+		draw_bands(ctx);
+
+		if(InterlockedDecrement(&num_busy) == 0) {
+			SetEvent(ev_done);
+		}
+	}
+	return 0;
+}
+#else
+static void *worker(void *cls)
+{
+	struct pfill_ctx *ctx = cls;
+	int gen = 0;
+
+	pthread_mutex_lock(&mutex);
+	for(;;) {
+		while(job_gen == gen && !quit) {
+			pthread_cond_wait(&cond_start, &mutex);
+		}
+		if(quit) break;
+		gen = job_gen;
+		pthread_mutex_unlock(&mutex);
+
+		draw_bands(ctx);
+
+		pthread_mutex_lock(&mutex);
+		if(--num_busy == 0) {
+			pthread_cond_signal(&cond_done);
+		}
+	}
+	pthread_mutex_unlock(&mutex);
+	return 0;
+}
+#endif
+
+#ifdef _WIN32
+static void start_render_thread(void)
+{
+	render_quit = 0;
+	render_busy = 0;
+	ev_submit = CreateEvent(0, FALSE, FALSE, 0);
+	ev_idle = CreateEvent(0, FALSE, FALSE, 0);
+	if(!(rthr = CreateThread(0, 0, render_thread, 0, 0, 0))) {
+		fprintf(stderr, "polyfill: failed to create render thread\n");
+		CloseHandle(ev_submit);
+		CloseHandle(ev_idle);
+		return;
+	}
+	pipeline = 1;
+}
+
+static void stop_render_thread(void)
+{
+	render_quit = 1;
+	SetEvent(ev_submit);
+	WaitForSingleObject(rthr, INFINITE);
+	CloseHandle(rthr);
+	CloseHandle(ev_submit);
+	CloseHandle(ev_idle);
+	pipeline = 0;
+	recq = drawq = queues;
+}
+
+static void wait_render_thread(void)
+{
+	while(render_busy) {
+		WaitForSingleObject(ev_idle, INFINITE);
+	}
+}
+
+static DWORD WINAPI render_thread(void *cls)
+{
+	for(;;) {
+		WaitForSingleObject(ev_submit, INFINITE);
+		if(render_quit) break;
+
+		pfill_fb.pixels = drawq->pixels;
+		draw_queue(drawq);
+
+		render_busy = 0;
+		SetEvent(ev_idle);
+	}
+	return 0;
+}
+#else
+static void start_render_thread(void)
+{
+	render_quit = 0;
+	render_busy = 0;
+	if(pthread_create(&rthr, 0, render_thread, 0) != 0) {
+		fprintf(stderr, "polyfill: failed to create render thread\n");
+		return;
+	}
+	pipeline = 1;
+}
+
+static void stop_render_thread(void)
+{
+	pthread_mutex_lock(&mutex);
+	render_quit = 1;
+	pthread_cond_signal(&cond_submit);
+	pthread_mutex_unlock(&mutex);
+
+	pthread_join(rthr, 0);
+	pipeline = 0;
+	recq = drawq = queues;
+}
+
+static void wait_render_thread(void)
+{
+	pthread_mutex_lock(&mutex);
+	while(render_busy) {
+		pthread_cond_wait(&cond_idle, &mutex);
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+static void *render_thread(void *cls)
+{
+	pthread_mutex_lock(&mutex);
+	for(;;) {
+		while(!render_busy && !render_quit) {
+			pthread_cond_wait(&cond_submit, &mutex);
+		}
+		if(render_quit) break;
+		pthread_mutex_unlock(&mutex);
+
+		pfill_fb.pixels = drawq->pixels;
+		draw_queue(drawq);
+
+		pthread_mutex_lock(&mutex);
+		render_busy = 0;
+		pthread_cond_signal(&cond_idle);
+	}
+	pthread_mutex_unlock(&mutex);
+	return 0;
+}
+#endif
+
+static int num_cpus(void)
+{
+#if defined(_WIN32)
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors;
+#elif defined(_SC_NPROCESSORS_ONLN)
+	return sysconf(_SC_NPROCESSORS_ONLN);
+#elif defined(_SC_NPROC_ONLN)
+	return sysconf(_SC_NPROC_ONLN);
+#else
+	return 1;
+#endif
+}
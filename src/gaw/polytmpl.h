@@ -6,12 +6,37 @@
 #define NOLERP
 #endif
 
-void POLYFILL(struct pvertex *varr, int vnum)
+#ifndef ZSLOPE
+/* (dz << 8) / d, without overflowing when z spans more than half the depth
+ * range. Same result as the plain expression whenever that doesn't overflow.
+ */
+#define ZSLOPE(dz, d)	(((dz) / (d)) * 256 + (((dz) % (d)) << 8) / (d))
+#endif
+
+#ifndef PERSP_SUBSPAN
+/* start a perspective sub-span of at most count pixels: calculate the correct
+ * u,v at its end, and interpolate linearly to it from the current ones
+ */
+#define PERSP_SUBSPAN(count) \
+	do { \
+		tu = u1; \
+		tv = v1; \
+		seg = (count) < pfill_persp_span ? (count) : pfill_persp_span; \
+		spos += seg; \
+		rw = 1.0f / (lv->iw + spos * iwslope); \
+		u1 = (int32_t)((lv->iu + spos * iuslope) * rw); \
+		v1 = (int32_t)((lv->iv + spos * ivslope) * rw); \
+		uslope = (u1 - tu) / seg; \
+		vslope = (v1 - tv) / seg; \
+	} while(0)
+#endif
+
+void POLYFILL(struct pfill_ctx *ctx, struct pvertex *varr, int vnum)
 {
-	int i, line, top, bot;
-	struct pvertex *vlast, *v, *vn, *tab;
+	int i, line, top, bot, ytop, ybot, nskip;
+	struct pvertex *vlast, *v, *vn, *tab, *left, *right, *lv, *rv;
 	int32_t x, y0, y1, dx, dy, slope, fx, fy;
-	int start, len;
+	int start, len, xskip;
 	gaw_pixel *fbptr, *pptr, color;
 #ifdef GOURAUD
 	int32_t r, g, b, dr, dg, db, rslope, gslope, bslope;
@@ -20,13 +45,32 @@ void POLYFILL(struct pvertex *varr, int vnum)
 #endif
 #endif	/* GOURAUD */
 #ifdef TEXMAP
-	int32_t tu, tv, du, dv, uslope, vslope;
+	int32_t tu, tv, uslope, vslope;
 	int tx, ty;
 	gaw_pixel texel;
+	const struct pimage *tex = ctx->tex;
+#ifdef PERSPECTIVE
+	float fy0, fdy, rw, iwslope, iuslope, ivslope;
+	float mid, dudx, dvdx, lod, lodx;
+	int32_t u1, v1;
+	int seg, spos, lvl;
+#else
+	int32_t du, dv;
+#endif
 #endif
 #ifdef ZBUF
 	int32_t z, dz, zslope;
 	uint32_t *zptr;
+	int hizrun, hizn;
+#ifdef PERSPECTIVE
+	int rem, step;
+#endif
+#endif
+#ifdef SPAN_SIMD
+	struct pfill_span span;
+#if !defined(PERSPECTIVE)
+	int seg;
+#endif
 #endif
 
 #if !defined(GOURAUD)
@@ -34,9 +78,20 @@ void POLYFILL(struct pvertex *varr, int vnum)
 	color = PACK_RGB(varr[0].r, varr[0].g, varr[0].b);
 #endif
 
+#ifdef ZBUF
+	if(pfill_hiz_enable && pfill_hiz_reject(ctx, varr, vnum)) {
+		return;
+	}
+#endif
+
+	left = ctx->left;
+	right = ctx->right;
+	ytop = ctx->ytop;
+	ybot = ctx->ybot;
+
 	vlast = varr + vnum - 1;
-	top = pfill_fb.height;
-	bot = 0;
+	top = ybot + 1;
+	bot = ytop - 1;
 
 	for(i=0; i<vnum; i++) {
 		/* scan the edge between the current and next vertex */
@@ -77,17 +132,28 @@ void POLYFILL(struct pvertex *varr, int vnum)
 #endif	/* BLEND_ALPHA */
 #endif	/* GOURAUD */
 #ifdef TEXMAP
+#ifdef PERSPECTIVE
+		/* 1/w, u/w, v/w slopes per 24.8 unit of y. These are evaluated directly
+		 * at every scanline instead of accumulated, so the result doesn't
+		 * depend on where we start scanning the edge.
+		 */
+		fdy = 1.0f / (float)dy;
+		iwslope = (vn->iw - v->iw) * fdy;
+		iuslope = (vn->iu - v->iu) * fdy;
+		ivslope = (vn->iv - v->iv) * fdy;
+#else
 		tu = v->u;
 		tv = v->v;
 		du = vn->u - tu;
 		dv = vn->v - tv;
 		uslope = (du << 8) / dy;
 		vslope = (dv << 8) / dy;
+#endif	/* PERSPECTIVE */
 #endif	/* TEXMAP */
 #ifdef ZBUF
 		z = v->z;
 		dz = vn->z - z;
-		zslope = (dz << 8) / dy;
+		zslope = ZSLOPE(dz, dy);
 #endif	/* ZBUF */
 
 		y0 = (v->y + 0x100) & 0xffffff00;	/* start from the next scanline */
@@ -105,41 +171,73 @@ void POLYFILL(struct pvertex *varr, int vnum)
 		a += (fy * aslope) >> 8;
 #endif	/* BLEND_ALPHA */
 #endif	/* GOURAUD */
-#ifdef TEXMAP
+#if defined(TEXMAP) && !defined(PERSPECTIVE)
 		tu += (fy * uslope) >> 8;
 		tv += (fy * vslope) >> 8;
 #endif
 #ifdef ZBUF
-		z += (fy * zslope) >> 8;
+		/* not from zslope, which overflows for edges shorter than a scanline.
+		 * Interpolated depths must never leave the range of the vertices, or
+		 * they'd spill into the epoch tag bits.
+		 */
+		z += (int32_t)((double)dz * fy / dy);
 #endif
 
 		line = y0 >> 8;
 		if(line < top) top = line;
 		if((y1 >> 8) > bot) bot = y1 >> 8;
 
-		if(line > 0) tab += line;
+		if(line < ytop) {
+			if((y1 >> 8) < ytop) continue;
+
+			/* edge starts above the scanlines we're drawing, skip ahead */
+			nskip = ytop - line;
+			x += nskip * slope;
+#ifdef GOURAUD
+			r += nskip * rslope;
+			g += nskip * gslope;
+			b += nskip * bslope;
+#ifdef BLEND_ALPHA
+			a += nskip * aslope;
+#endif	/* BLEND_ALPHA */
+#endif	/* GOURAUD */
+#if defined(TEXMAP) && !defined(PERSPECTIVE)
+			tu += nskip * uslope;
+			tv += nskip * vslope;
+#endif	/* TEXMAP */
+#ifdef ZBUF
+			z += nskip * zslope;
+#endif	/* ZBUF */
+			line = ytop;
+		}
+		tab += line - ytop;
 
-		while(line <= (y1 >> 8) && line < pfill_fb.height) {
-			if(line >= 0) {
-				int val = x < 0 ? 0 : x >> 8;
-				tab->x = val < pfill_fb.width ? val : pfill_fb.width - 1;
+		while(line <= (y1 >> 8) && line <= ybot) {
+			tab->x = x >> 8;	/* might be off-screen, spans are clipped below */
 #ifdef GOURAUD
-				tab->r = r;
-				tab->g = g;
-				tab->b = b;
+			tab->r = r;
+			tab->g = g;
+			tab->b = b;
 #ifdef BLEND_ALPHA
-				tab->a = a;
+			tab->a = a;
 #endif	/* BLEND_ALPHA */
 #endif	/* GOURAUD */
 #ifdef TEXMAP
-				tab->u = tu;
-				tab->v = tv;
+#ifdef PERSPECTIVE
+			fy0 = (float)((line << 8) - v->y);
+			tab->iw = v->iw + fy0 * iwslope;
+			tab->iu = v->iu + fy0 * iuslope;
+			tab->iv = v->iv + fy0 * ivslope;
+#else
+			tab->u = tu;
+			tab->v = tv;
+#endif
 #endif
 #ifdef ZBUF
-				tab->z = z;
+			tab->z = z;
 #endif
-				tab++;
-			}
+			tab++;
+
 			x += slope;
 #ifdef GOURAUD
 			r += rslope;
@@ -149,7 +247,7 @@ void POLYFILL(struct pvertex *varr, int vnum)
 			a += aslope;
 #endif	/* BLEND_ALPHA */
 #endif	/* GOURAUD */
-#ifdef TEXMAP
+#if defined(TEXMAP) && !defined(PERSPECTIVE)
 			tu += uslope;
 			tv += vslope;
 #endif	/* TEXMAP */
@@ -160,50 +258,179 @@ void POLYFILL(struct pvertex *varr, int vnum)
 		}
 	}
 
-	if(top < 0) top = 0;
-	if(bot >= pfill_fb.height) bot = pfill_fb.height - 1;
+	if(top < ytop) top = ytop;
+	if(bot > ybot) bot = ybot;
 
-	fbptr = pfill_fb.pixels + top * pfill_fb.width;
+	lv = left + (top - ytop);
+	rv = right + (top - ytop);
+
+	fbptr = pfill_fb.pixels + top * pfill_fb.pitch;
 	for(i=top; i<=bot; i++) {
-		start = left[i].x;
-		len = right[i].x - start;
+		start = lv->x;
+		len = rv->x - start;
 		/* XXX we probably need more precision in left/right.x */
 
 #ifndef NOLERP
 		dx = len == 0 ? 256 : (len << 8);
 #endif
 
+		/* clip the span to the columns of the context. Slopes are still
+		 * calculated over the whole span, and the attributes are advanced by
+		 * xskip below.
+		 */
+		xskip = 0;
+		if(start < ctx->xmin) {
+			xskip = ctx->xmin - start;
+			start = ctx->xmin;
+		}
+		len = (rv->x < ctx->xmax ? rv->x : ctx->xmax) - start;
+		if(len > 0) ctx->stats.pixels += len;
+
 #ifdef GOURAUD
-		r = left[i].r;
-		g = left[i].g;
-		b = left[i].b;
-		dr = right[i].r - r;
-		dg = right[i].g - g;
-		db = right[i].b - b;
+		r = lv->r;
+		g = lv->g;
+		b = lv->b;
+		dr = rv->r - r;
+		dg = rv->g - g;
+		db = rv->b - b;
 		rslope = (dr << 8) / dx;
 		gslope = (dg << 8) / dx;
 		bslope = (db << 8) / dx;
 #ifdef BLEND_ALPHA
-		a = left[i].a;
-		da = right[i].a - a;
+		a = lv->a;
+		da = rv->a - a;
 		aslope = (da << 8) / dx;
 #endif	/* BLEND_ALPHA */
 #endif	/* GOURAUD */
 #ifdef TEXMAP
-		tu = left[i].u;
-		tv = left[i].v;
-		du = right[i].u - tu;
-		dv = right[i].v - tv;
+#ifdef PERSPECTIVE
+		fdy = 256.0f / (float)dx;
+		iwslope = (rv->iw - lv->iw) * fdy;
+		iuslope = (rv->iu - lv->iu) * fdy;
+		ivslope = (rv->iv - lv->iv) * fdy;
+		spos = xskip;
+		rw = 1.0f / (lv->iw + spos * iwslope);
+		u1 = (int32_t)((lv->iu + spos * iuslope) * rw);
+		v1 = (int32_t)((lv->iv + spos * ivslope) * rw);
+		seg = 0;
+		if(ctx->tex->levels) {
+			/* mip level from the texel footprint at the middle of the span: the
+			 * larger of its horizontal extent, and the vertical extent implied
+			 * by the texel/pixel area ratio (2^(2 * lod) at this w)
+			 */
+			mid = (float)(xskip + (len >> 1));
+			rw = 1.0f / (lv->iw + mid * iwslope);
+			dudx = (iuslope - (lv->iu + mid * iuslope) * rw * iwslope) * rw;
+			dvdx = (ivslope - (lv->iv + mid * ivslope) * rw * iwslope) * rw;
+			dudx *= (float)ctx->tex->width * (1.0f / 65536.0f);
+			dvdx *= (float)ctx->tex->height * (1.0f / 65536.0f);
+			lodx = 0.5f * pfill_log2(dudx * dudx + dvdx * dvdx + 1e-6f);
+			lod = 2.0f * (ctx->tex_lod + 1.5f * pfill_log2(rw)) - lodx;
+			if(lodx > lod) lod = lodx;
+			lod += 0.5f;
+			lvl = lod < 1.0f ? 0 : (int)lod;
+			if(lvl >= ctx->tex->num_levels) lvl = ctx->tex->num_levels - 1;
+			tex = ctx->tex->levels + lvl;
+		}
+#else
+		tu = lv->u;
+		tv = lv->v;
+		du = rv->u - tu;
+		dv = rv->v - tv;
 		uslope = (du << 8) / dx;
 		vslope = (dv << 8) / dx;
+#endif	/* PERSPECTIVE */
 #endif	/* TEXMAP */
 #ifdef ZBUF
-		z = left[i].z;
-		dz = right[i].z - z;
-		zslope = (dz << 8) / dx;
+		z = lv->z;
+		dz = rv->z - z;
+		zslope = ZSLOPE(dz, dx);
 		zptr = pfill_zbuf + i * pfill_fb.width + start;
+		hizrun = 0;
 #endif	/* ZBUF */
 
+		if(xskip) {
+#ifdef GOURAUD
+			r += xskip * rslope;
+			g += xskip * gslope;
+			b += xskip * bslope;
+#ifdef BLEND_ALPHA
+			a += xskip * aslope;
+#endif
+#endif	/* GOURAUD */
+#if defined(TEXMAP) && !defined(PERSPECTIVE)
+			tu += xskip * uslope;
+			tv += xskip * vslope;
+#endif
+#ifdef ZBUF
+			z += xskip * zslope;
+#endif
+		}
+
+#ifdef SPAN_SIMD
+		if(pfill_simd) {
+			span.pptr = fbptr + start;
+			span.zptr = zptr;
+#ifdef GOURAUD
+			span.r = r;
+			span.g = g;
+			span.b = b;
+			span.rslope = rslope;
+			span.gslope = gslope;
+			span.bslope = bslope;
+#ifdef BLEND_ALPHA
+			span.a = a;
+			span.aslope = aslope;
+#endif
+#else
+			/* flat: the gouraud span fillers with constant colors */
+			span.r = varr[0].r << COLOR_SHIFT;
+			span.g = varr[0].g << COLOR_SHIFT;
+			span.b = varr[0].b << COLOR_SHIFT;
+			span.a = varr[0].a << COLOR_SHIFT;
+			span.rslope = span.gslope = span.bslope = span.aslope = 0;
+#endif	/* GOURAUD */
+			span.z = z;
+			span.zslope = zslope;
+#ifdef DBG_PROFILE
+			span.zfail = 0;
+#endif
+#ifdef TEXMAP
+			span.tex = tex;
+#endif
+			while(len > 0) {
+#ifdef PERSPECTIVE
+				PERSP_SUBSPAN(len);
+#else
+				seg = len;
+#endif
+#ifdef TEXMAP
+				span.u = tu;
+				span.v = tv;
+				span.uslope = uslope;
+				span.vslope = vslope;
+#endif
+				while(seg > 0) {
+					hizn = seg;
+					if(pfill_hiz_enable || ctx->sbuf) {
+						hizn = pfill_zrun(ctx, span.pptr - fbptr, i, seg, span.z, zslope);
+					}
+					if(hizn < 0) {
+						hizn = -hizn;
+						pfill_span_skip(&span, hizn);
+					} else {
+						SPAN_SIMD(&span, hizn);
+					}
+					seg -= hizn;
+					len -= hizn;
+				}
+			}
+#ifdef DBG_PROFILE
+			ctx->stats.zfail += span.zfail;
+#endif
+		}
+#endif	/* SPAN_SIMD */
+
 		pptr = fbptr + start;
 		while(len-- > 0) {
 #if defined(GOURAUD) || defined(TEXMAP) || defined(BLEND_ALPHA) || defined(BLEND_ADD)
@@ -219,13 +446,71 @@ void POLYFILL(struct pvertex *varr, int vnum)
 			int inv_alpha;
 #endif
 #ifdef ZBUF
-			uint32_t cz = z;
+			uint32_t cz;
+#endif
+#ifdef ZBUF
+			if(pfill_hiz_enable || ctx->sbuf) {
+				if(!hizrun) {
+					hizrun = pfill_zrun(ctx, pptr - fbptr, i, len + 1, z, zslope);
+					if(hizrun < 0) {
+						/* all hidden behind the hi-z tiles or span buffer, skip
+						 * the whole run
+						 */
+						hizn = -hizrun;
+						hizrun = 0;
+#ifdef GOURAUD
+						r += hizn * rslope;
+						g += hizn * gslope;
+						b += hizn * bslope;
+#ifdef BLEND_ALPHA
+						a += hizn * aslope;
+#endif
+#endif	/* GOURAUD */
+#ifdef PERSPECTIVE
+						/* step through the sub-spans exactly as drawing would */
+						rem = len + 1;
+						while(rem > len + 1 - hizn) {
+							if(!seg) {
+								PERSP_SUBSPAN(rem);
+							}
+							step = rem - (len + 1 - hizn);
+							if(step > seg) step = seg;
+							tu += step * uslope;
+							tv += step * vslope;
+							seg -= step;
+							rem -= step;
+						}
+#elif defined(TEXMAP)
+						tu += hizn * uslope;
+						tv += hizn * vslope;
+#endif
+						z += hizn * zslope;
+						pptr += hizn;
+						zptr += hizn;
+						len -= hizn - 1;
+						continue;
+					}
+				}
+				hizrun--;
+			}
+#endif	/* ZBUF */
+#ifdef PERSPECTIVE
+			if(!seg) {
+				PERSP_SUBSPAN(len + 1);
+			}
+			seg--;
+#endif
+#ifdef ZBUF
+			cz = z;
 			z += zslope;
 
 			if(cz <= *zptr) {
 				*zptr++ = cz;
 			} else {
 				/* ZFAIL: advance all attributes and continue */
+#ifdef DBG_PROFILE
+				ctx->stats.zfail++;
+#endif
 #ifdef GOURAUD
 				r += rslope;
 				g += gslope;
@@ -244,6 +529,10 @@ void POLYFILL(struct pvertex *varr, int vnum)
 				continue;
 			}
 #endif	/* ZBUF */
+#ifdef ZONLY
+			pptr++;
+			continue;
+#endif
 
 #ifdef GOURAUD
 			/* we upped the color precision to while interpolating the
@@ -260,14 +549,32 @@ void POLYFILL(struct pvertex *varr, int vnum)
 			a += aslope;
 #endif	/* BLEND_ALPHA */
 #endif	/* GOURAUD */
+#if !defined(GOURAUD) && !defined(TEXMAP) && (defined(BLEND_ALPHA) || defined(BLEND_ADD))
+			/* flat blended, start from the polygon color */
+			cr = varr[0].r;
+			cg = varr[0].g;
+			cb = varr[0].b;
+#ifdef BLEND_ALPHA
+			ca = varr[0].a;
+#endif
+#endif
 #ifdef TEXMAP
-			tx = (tu >> (16 - pfill_tex.xshift)) & pfill_tex.xmask;
-			ty = (tv >> (16 - pfill_tex.yshift)) & pfill_tex.ymask;
-			texel = pfill_tex.pixels[(ty << pfill_tex.xshift) + tx];
+			tx =(tu >> (16 - tex->xshift)) & tex->xmask;
+			ty = (tv >> (16 - tex->yshift)) & tex->ymask;
+			texel = tex->pixels[(ty << tex->xshift) + tx];
 
 			tu += uslope;
 			tv += vslope;
 
+#ifdef TEX_REPLACE
+			/* vertex colors are all white, no need to modulate */
+			cr = UNPACK_R(texel);
+			cg = UNPACK_G(texel);
+			cb = UNPACK_B(texel);
+#ifdef BLEND_ALPHA
+			ca = UNPACK_A(texel);
+#endif
+#else	/* !TEX_REPLACE */
 #ifndef GOURAUD
 			/* for flat textured, cr,cg,cb would not be initialized */
 			cr = varr[0].r;
@@ -286,6 +593,7 @@ void POLYFILL(struct pvertex *varr, int vnum)
 #ifdef BLEND_ALPHA
 			ca = (ca * UNPACK_A(texel)) >> 8;
 #endif
+#endif	/* TEX_REPLACE */
 #endif	/* TEXMAP */
 
 #ifdef BLEND_ALPHA
@@ -314,7 +622,9 @@ void POLYFILL(struct pvertex *varr, int vnum)
 			*pptr++ = color;
 #endif
 		}
-		fbptr += pfill_fb.width;
+		fbptr += pfill_fb.pitch;
+		lv++;
+		rv++;
 	}
 }
 
@@ -0,0 +1,118 @@
+/*
+Deep Runner - 6dof shooter game for the SGI O2.
+Copyright (C) 2023  John Tsiombikas <nuclear@mutantstargoat.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+/* SSE2 span fillers, drawing 4 pixels per iteration.
+ *
+ * These must produce exactly the same pixels as the scalar loop in
+ * polytmpl.h, which remains the reference. The one assumption they make is
+ * that interpolated colors stay within 0-255 (vertex colors are clamped by
+ * the T&L), which lets all the color arithmetic happen in 16bit lanes.
+ */
+#include "polyfill.h"
+
+#ifdef PFILL_SSE2
+#include <emmintrin.h>
+
+#if defined(__GNUC__) && !defined(__SSE2__)
+/* 32bit x86 build without -msse2: compile just these functions for SSE2 */
+#define SSE2_FUNC	__attribute__((target("sse2")))
+#else
+#define SSE2_FUNC
+#endif
+
+#if defined(_MSC_VER) && !defined(_M_X64)
+#include <intrin.h>
+#endif
+
+int pfill_cpu_sse2(void)
+{
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__)
+	return 1;
+#elif defined(__GNUC__)
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("sse2");
+#else
+	int regs[4];
+	__cpuid(regs, 1);
+	return (regs[3] >> 26) & 1;		/* edx bit 26: SSE2 */
+#endif
+}
+
+/* 4 lanes with the values of an attribute at 4 consecutive pixels. Unsigned
+ * arithmetic to wrap around exactly like the scalar loop stepping 1 at a time
+ */
+#define LANES(x, slope) \
+	_mm_set_epi32((int32_t)((uint32_t)(x) + 3 * (uint32_t)(slope)), \
+			(int32_t)((uint32_t)(x) + 2 * (uint32_t)(slope)), \
+			(int32_t)((uint32_t)(x) + (uint32_t)(slope)), (int32_t)(x))
+#define STEP4(slope)	_mm_set1_epi32((int32_t)((uint32_t)(slope) << 2))
+#define ADVANCE(x, slope, n) \
+	((x) = (int32_t)((uint32_t)(x) + (uint32_t)(slope) * (uint32_t)(n)))
+
+/* PACK_RGB puts red in the 3rd byte, while UNPACK_R reads the 1st, so the
+ * scalar fillers combine the 1st byte of texels and framebuffer pixels with
+ * the red, and write it out as the 3rd. Swapping the 1st and 3rd 16bit lane of
+ * each unpacked pixel lines them up with the colors in output order.
+ */
+#define SWAP_RB(x) \
+	_mm_shufflehi_epi16(_mm_shufflelo_epi16(x, _MM_SHUFFLE(3, 0, 1, 2)), \
+			_MM_SHUFFLE(3, 0, 1, 2))
+#define BCAST_A(x) \
+	_mm_shufflehi_epi16(_mm_shufflelo_epi16(x, _MM_SHUFFLE(3, 3, 3, 3)), \
+			_MM_SHUFFLE(3, 3, 3, 3))
+
+#ifdef DBG_PROFILE
+/* number of set bits in a 4 lane mask */
+static const int lane_count[] = {0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4};
+#endif
+
+
+#define SPANFUNC	pfill_span_gouraud_zbuf_sse2
+#undef TEXMAP
+#undef BLEND_ALPHA
+#include "spansse.h"
+#undef SPANFUNC
+
+#define SPANFUNC	pfill_span_tex_gouraud_zbuf_sse2
+#define TEXMAP
+#undef BLEND_ALPHA
+#include "spansse.h"
+#undef SPANFUNC
+
+#define SPANFUNC	pfill_span_alpha_tex_gouraud_zbuf_sse2
+#define TEXMAP
+#define BLEND_ALPHA
+#include "spansse.h"
+#undef SPANFUNC
+
+#define TEX_REPLACE
+
+#define SPANFUNC	pfill_span_tex_replace_zbuf_sse2
+#define TEXMAP
+#undef BLEND_ALPHA
+#include "spansse.h"
+#undef SPANFUNC
+
+#define SPANFUNC	pfill_span_alpha_tex_replace_zbuf_sse2
+#define TEXMAP
+#define BLEND_ALPHA
+#include "spansse.h"
+#undef SPANFUNC
+
+#undef TEX_REPLACE
+
+#endif	/* PFILL_SSE2 */
@@ -0,0 +1,193 @@
+/* SSE2 span filler template, see spansse.c */
+
+SSE2_FUNC void SPANFUNC(struct pfill_span *span, int len)
+{
+	int i, count = len;
+	gaw_pixel *pptr, *fb, tmpfb[4];
+	uint32_t *zptr, *zb, tmpz[4];
+	__m128i zero, zsign, vz, zstep, zval, zfail;
+#ifndef TEX_REPLACE
+	__m128i vr, vg, vb, rstep, gstep, bstep;
+	__m128i bg, ra, lo, hi;
+#endif
+	__m128i c01, c23, col, fbcol;
+#ifdef TEXMAP
+	const struct pimage *tex = span->tex;
+	__m128i vu, vv, ustep, vstep, ushift, vshift, xshift, xmask, ymask, idx, texel;
+	int32_t tidx[4];
+#endif
+#if (defined(TEXMAP) && !defined(TEX_REPLACE)) || defined(BLEND_ALPHA)
+	__m128i c255;
+#endif
+#ifdef BLEND_ALPHA
+	__m128i alpha;
+#ifndef TEX_REPLACE
+	__m128i va, astep;
+#endif
+#endif
+
+	pptr = span->pptr;
+	zptr = span->zptr;
+
+	zero = _mm_setzero_si128();
+	zsign = _mm_set1_epi32(-0x7fffffff - 1);
+
+	vz = LANES(span->z, span->zslope);
+	zstep = STEP4(span->zslope);
+#ifndef TEX_REPLACE
+	vr = LANES(span->r, span->rslope);
+	vg = LANES(span->g, span->gslope);
+	vb = LANES(span->b, span->bslope);
+	rstep = STEP4(span->rslope);
+	gstep = STEP4(span->gslope);
+	bstep = STEP4(span->bslope);
+#ifdef BLEND_ALPHA
+	va = LANES(span->a, span->aslope);
+	astep = STEP4(span->aslope);
+#endif
+#endif	/* !TEX_REPLACE */
+#ifdef TEXMAP
+	vu = LANES(span->u, span->uslope);
+	vv = LANES(span->v, span->vslope);
+	ustep = STEP4(span->uslope);
+	vstep = STEP4(span->vslope);
+	ushift = _mm_cvtsi32_si128(16 - tex->xshift);
+	vshift = _mm_cvtsi32_si128(16 - tex->yshift);
+	xshift = _mm_cvtsi32_si128(tex->xshift);
+	xmask = _mm_set1_epi32(tex->xmask);
+	ymask = _mm_set1_epi32(tex->ymask);
+#endif
+#if (defined(TEXMAP) && !defined(TEX_REPLACE)) || defined(BLEND_ALPHA)
+	c255 = _mm_set1_epi16(255);
+#endif
+
+	while(len > 0) {
+		if(len >= 4) {
+			fb = pptr;
+			zb = zptr;
+		} else {
+			/* last few pixels: work on a copy, to avoid touching anything
+			 * past the end of the span
+			 */
+			for(i=0; i<4; i++) {
+				tmpfb[i] = i < len ? pptr[i] : 0;
+				tmpz[i] = i < len ? zptr[i] : 0;
+			}
+			fb = tmpfb;
+			zb = tmpz;
+		}
+
+		/* z test: pass if z <= zbuffer value, compared as unsigned */
+		zval = _mm_loadu_si128((__m128i*)zb);
+		zfail = _mm_cmpgt_epi32(_mm_xor_si128(vz, zsign), _mm_xor_si128(zval, zsign));
+#ifdef DBG_PROFILE
+		i = _mm_movemask_ps(_mm_castsi128_ps(zfail));
+		span->zfail += lane_count[len < 4 ? i & ((1 << len) - 1) : i];
+#endif
+
+		if(_mm_movemask_epi8(zfail) != 0xffff) {
+			_mm_storeu_si128((__m128i*)zb, _mm_or_si128(_mm_and_si128(zfail, zval),
+						_mm_andnot_si128(zfail, vz)));
+
+#ifndef TEX_REPLACE
+			/* drop the extra color precision, and rearrange into 16bit b,g,r,a
+			 * lanes for pixels 0,1 (c01) and 2,3 (c23)
+			 */
+			bg = _mm_packs_epi32(_mm_srai_epi32(vb, COLOR_SHIFT), _mm_srai_epi32(vg, COLOR_SHIFT));
+#ifdef BLEND_ALPHA
+			ra = _mm_packs_epi32(_mm_srai_epi32(vr, COLOR_SHIFT), _mm_srai_epi32(va, COLOR_SHIFT));
+#else
+			ra = _mm_packs_epi32(_mm_srai_epi32(vr, COLOR_SHIFT), zero);
+#endif
+			lo = _mm_unpacklo_epi16(bg, ra);
+			hi = _mm_unpackhi_epi16(bg, ra);
+			c01 = _mm_unpacklo_epi16(lo, hi);
+			c23 = _mm_unpackhi_epi16(lo, hi);
+#endif	/* !TEX_REPLACE */
+
+#ifdef TEXMAP
+#ifndef TEX_REPLACE
+			c01 = _mm_min_epi16(_mm_max_epi16(c01, zero), c255);
+			c23 = _mm_min_epi16(_mm_max_epi16(c23, zero), c255);
+#endif
+
+			idx = _mm_and_si128(_mm_sra_epi32(vv, vshift), ymask);
+			idx = _mm_add_epi32(_mm_sll_epi32(idx, xshift),
+					_mm_and_si128(_mm_sra_epi32(vu, ushift), xmask));
+			_mm_storeu_si128((__m128i*)tidx, idx);
+			texel = _mm_set_epi32(tex->pixels[tidx[3]], tex->pixels[tidx[2]],
+					tex->pixels[tidx[1]], tex->pixels[tidx[0]]);
+
+#ifdef TEX_REPLACE
+			/* white vertex colors: the texels as they are */
+			c01 = SWAP_RB(_mm_unpacklo_epi8(texel, zero));
+			c23 = SWAP_RB(_mm_unpackhi_epi8(texel, zero));
+#else
+			/* modulate: (color * texel) >> 8 */
+			c01 = _mm_srli_epi16(_mm_mullo_epi16(c01, SWAP_RB(_mm_unpacklo_epi8(texel, zero))), 8);
+			c23 = _mm_srli_epi16(_mm_mullo_epi16(c23, SWAP_RB(_mm_unpackhi_epi8(texel, zero))), 8);
+#endif
+#endif	/* TEXMAP */
+
+			fbcol = _mm_loadu_si128((__m128i*)fb);
+#ifdef BLEND_ALPHA
+			/* (color * alpha + fbcolor * (255 - alpha)) >> 8 */
+			alpha = BCAST_A(c01);
+			c01 = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(c01, alpha),
+						_mm_mullo_epi16(SWAP_RB(_mm_unpacklo_epi8(fbcol, zero)),
+							_mm_sub_epi16(c255, alpha))), 8);
+			alpha = BCAST_A(c23);
+			c23 = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(c23, alpha),
+						_mm_mullo_epi16(SWAP_RB(_mm_unpackhi_epi8(fbcol, zero)),
+							_mm_sub_epi16(c255, alpha))), 8);
+#endif	/* BLEND_ALPHA */
+
+			/* saturate to 0-255 and pack, written pixels have 0 alpha */
+			col = _mm_packus_epi16(c01, c23);
+#if defined(BLEND_ALPHA) || defined(TEX_REPLACE)
+			col = _mm_and_si128(col, _mm_set1_epi32(0xffffff));
+#endif
+			_mm_storeu_si128((__m128i*)fb, _mm_or_si128(_mm_and_si128(zfail, fbcol),
+						_mm_andnot_si128(zfail, col)));
+		}
+
+		if(len < 4) {
+			for(i=0; i<len; i++) {
+				pptr[i] = tmpfb[i];
+				zptr[i] = tmpz[i];
+			}
+			break;
+		}
+
+		vz = _mm_add_epi32(vz, zstep);
+#ifndef TEX_REPLACE
+		vr = _mm_add_epi32(vr, rstep);
+		vg = _mm_add_epi32(vg, gstep);
+		vb = _mm_add_epi32(vb, bstep);
+#ifdef BLEND_ALPHA
+		va = _mm_add_epi32(va, astep);
+#endif
+#endif
+#ifdef TEXMAP
+		vu = _mm_add_epi32(vu, ustep);
+		vv = _mm_add_epi32(vv, vstep);
+#endif
+		pptr += 4;
+		zptr += 4;
+		len -= 4;
+	}
+
+	span->pptr += count;
+	span->zptr += count;
+	ADVANCE(span->z, span->zslope, count);
+	ADVANCE(span->r, span->rslope, count);
+	ADVANCE(span->g, span->gslope, count);
+	ADVANCE(span->b, span->bslope, count);
+#ifdef BLEND_ALPHA
+	ADVANCE(span->a, span->aslope, count);
+#endif
+#ifdef TEXMAP
+	ADVANCE(span->u, span->uslope, count);
+	ADVANCE(span->v, span->vslope, count);
+#endif
+}
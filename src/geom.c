@@ -173,6 +173,138 @@ int ray_triangle(const cgm_ray *ray, const struct triangle *tri, float tmax, str
 	return 1;
 }
 
+/* smallest root of at^2 + bt + c = 0, if it's in [0, tmax]. The larger root
+ * is where the sphere would leave the vertex or edge again, and doesn't count.
+ */
+static int lowest_root(float a, float b, float c, float tmax, float *root)
+{
+	float d, r1, r2;
+
+	if(fabs(a) < 1e-8f || (d = b * b - 4.0f * a * c) < 0.0f) {
+		return 0;
+	}
+	d = sqrt(d);
+	r1 = (-b - d) / (2.0f * a);
+	r2 = (-b + d) / (2.0f * a);
+	if(r2 < r1) r1 = r2;
+
+	if(r1 >= 0.0f && r1 <= tmax) {
+		*root = r1;
+		return 1;
+	}
+	return 0;
+}
+
+/* Swept sphere against triangle, after "Improved Collision detection and
+ * Response" by Kasper Fauerby: the sphere first touches either the inside of
+ * the triangle, or one of its vertices or edges.
+ */
+int tri_sweep_sphere(const struct triangle *tri, const cgm_vec3 *pos, const cgm_vec3 *vel,
+		float rad, float tmax, struct trihit *hit)
+{
+	int i, found = 0;
+	float dist, ndotv, side, t, a, b, c, f, vlensq, elensq, edotv, edotp;
+	cgm_vec3 pt, bc, edge, vdir;
+	const cgm_vec3 *v0, *v1;
+
+	/* already touching at the start. If it's moving away from the nearest
+	 * point, it can't run into the triangle later either.
+	 */
+	if(tri_sphere_test(tri, pos, rad, 0)) {
+		tri_proj_pt(&pt, tri, pos);
+		vdir = *pos;
+		cgm_vsub(&vdir, &pt);
+		if(cgm_vdot(&vdir, vel) >= 0.0f) {
+			return 0;
+		}
+		if(hit) {
+			hit->t = 0.0f;
+			hit->pt = pt;
+			hit->tri = tri;
+		}
+		return 1;
+	}
+
+	dist = tri_plane_dist(tri, pos);
+	ndotv = cgm_vdot(&tri->norm, vel);
+
+	/* first contact with the plane, if it's inside the triangle nothing else
+	 * can come before it. If the sphere already cuts through the plane, it can
+	 * only run into the edges.
+	 */
+	if(fabs(dist) >= rad) {
+		if(fabs(ndotv) <= 1e-6f) {
+			return 0;	/* moving parallel to the plane, and not touching it */
+		}
+		side = dist > 0.0f ? rad : -rad;
+		t = (side - dist) / ndotv;
+		if(t >= 0.0f && t <= tmax) {
+			pt = *pos;
+			cgm_vadd_scaled(&pt, vel, t);
+			cgm_vadd_scaled(&pt, &tri->norm, -side);
+
+			cgm_bary(&bc, tri->v, tri->v + 1, tri->v + 2, &pt);
+			if(bc.x >= 0.0f && bc.y >= 0.0f && bc.z >= 0.0f) {
+				if(hit) {
+					hit->t = t;
+					hit->pt = pt;
+					hit->tri = tri;
+				}
+				return 1;
+			}
+		}
+	}
+
+	vlensq = cgm_vlength_sq(vel);
+
+	/* vertices: |pos + vel t - v|^2 = rad^2 */
+	for(i=0; i<3; i++) {
+		vdir = *pos;
+		cgm_vsub(&vdir, tri->v + i);
+		b = 2.0f * cgm_vdot(vel, &vdir);
+		c = cgm_vlength_sq(&vdir) - rad * rad;
+		if(lowest_root(vlensq, b, c, tmax, &t)) {
+			tmax = t;
+			pt = tri->v[i];
+			found = 1;
+		}
+	}
+
+	/* edges: the same against an infinite cylinder around the edge, and then
+	 * check that the contact point falls within the edge.
+	 */
+	for(i=0; i<3; i++) {
+		v0 = tri->v + i;
+		v1 = tri->v + (i + 1) % 3;
+		edge = *v1; cgm_vsub(&edge, v0);
+		vdir = *v0; cgm_vsub(&vdir, pos);
+
+		elensq = cgm_vlength_sq(&edge);
+		edotv = cgm_vdot(&edge, vel);
+		edotp = cgm_vdot(&edge, &vdir);
+
+		a = elensq * -vlensq + edotv * edotv;
+		b = elensq * 2.0f * cgm_vdot(vel, &vdir) - 2.0f * edotv * edotp;
+		c = elensq * (rad * rad - cgm_vlength_sq(&vdir)) + edotp * edotp;
+		if(lowest_root(a, b, c, tmax, &t)) {
+			f = (edotv * t - edotp) / elensq;
+			if(f >= 0.0f && f <= 1.0f) {
+				tmax = t;
+				pt = *v0;
+				cgm_vadd_scaled(&pt, &edge, f);
+				found = 1;
+			}
+		}
+	}
+
+	if(found && hit) {
+		hit->t = tmax;
+		hit->pt = pt;
+		hit->tri = tri;
+	}
+	return found;
+}
+
 #define SLABCHECK(dim)	\
 	do { \
 		if(ray->dir.dim != 0.0f) { \
@@ -316,8 +448,7 @@ int aabox_tri_test(const struct aabox *box, const struct triangle *tri)
 			p0 = cgm_vdot(&v0, &ax);
 			p1 = cgm_vdot(&v1, &ax);
 			p2 = cgm_vdot(&v2, &ax);
-			r = e0 * fabs(cgm_vdot(f, &ax)) + e1 * fabs(cgm_vdot(f + 1, &ax)) +
-				e2 * fabs(cgm_vdot(f + 2, &ax));
+			r = e0 * fabs(ax.x) + e1 * fabs(ax.y) + e2 * fabs(ax.z);
 
 			minp = fltmin3(p0, p1, p2);
 			maxp = fltmax3(p0, p1, p2);
@@ -332,8 +463,8 @@ int aabox_tri_test(const struct aabox *box, const struct triangle *tri)
 
 	/*plane.norm = tri->norm;*/
 	cgm_vcross(&plane.norm, f, f + 1);
-	/*plane.d = cgm_vdot(&tri->norm, &v0);*/
-	plane.d = cgm_vdot(&plane.norm, &v0);
+	/* the box isn't translated, so the plane has to stay in world space */
+	plane.d = cgm_vdot(&plane.norm, tri->v);
 	return aabox_plane_test(box, &plane);
 }
 
@@ -49,6 +49,9 @@ void tri_proj_pt(cgm_vec3 *res, const struct triangle *tri, const cgm_vec3 *pt);
 int tri_sphere_test(const struct triangle *tri, const cgm_vec3 *cent, float rad, float *distret);
 
 int ray_triangle(const cgm_ray *ray, const struct triangle *tri, float tmax, struct trihit *hit);
+/* first contact up to tmax of a sphere moving from pos to pos + vel * t */
+int tri_sweep_sphere(const struct triangle *tri, const cgm_vec3 *pos, const cgm_vec3 *vel,
+		float rad, float tmax, struct trihit *hit);
 int ray_aabox_any(const cgm_ray *ray, const struct aabox *box, float tmax);
 
 void aabox_init(struct aabox *box);
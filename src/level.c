@@ -27,6 +27,7 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include "options.h"
 #include "loading.h"
 #include "enemy.h"
+#include "prof.h"
 
 #define MAX_HIT_DEPTH	2
 
@@ -36,7 +37,8 @@ static int read_action(struct action *act, struct ts_node *tsn);
 static int add_dynmesh(struct level *lvl, struct ts_node *tsn);
 static int proc_dynobj(struct level *lvl, struct ts_node *tsn);
 static struct room *find_portal_link(struct level *lvl, struct portal *portal);
-static void build_room_octree(struct room *room);
+static void build_room_bvh(struct room *room);
+static void build_room_grid(struct level *lvl);
 
 static int check_collision(const struct level *lvl, const struct room *room,
 		const cgm_vec3 *pos, const cgm_vec3 *vel, struct collision *col,
@@ -89,6 +91,7 @@ void free_room(struct room *room)
 	count = darr_size(room->objects);
 	for(i=0; i<count; i++) {
 		free(room->objects[i]->name);
+		bvh_free(room->objects[i]->bvh);
 		free(room->objects[i]);
 	}
 	darr_free(room->objects);
@@ -103,7 +106,8 @@ void free_room(struct room *room)
 
 	free(room->name);
 
-	oct_free(room->octree);
+	sdf_free(room->sdf);
+	bvh_free(room->bvh);
 	free(room);
 }
 
@@ -126,6 +130,7 @@ void lvl_destroy(struct level *lvl)
 		free_room(lvl->rooms[i]);
 	}
 	darr_free(lvl->rooms);
+	free(lvl->grid.cells);
 
 	for(i=0; i<darr_size(lvl->textures); i++) {
 		tex_free(lvl->textures[i]);
@@ -229,6 +234,11 @@ int lvl_load(struct level *lvl, const char *fname)
 
 	lvl->max_enemies = ts_lookup_int(ts, "level.enemies.spawn", 0);
 
+	/* distance fields are optional, unless they were requested before loading */
+	if(lvl->sdf_voxsz <= 0.0f) {
+		lvl->sdf_voxsz = ts_lookup_num(ts, "level.sdf", 0);
+	}
+
 	if(!(gscn = goat3d_create()) || goat3d_load(gscn, scnfile) == -1) {
 		fprintf(stderr, "lvl_load(%s): failed to load scene file: %s\n", fname, scnfile);
 		ts_free_tree(ts);
@@ -274,12 +284,15 @@ int lvl_load(struct level *lvl, const char *fname)
 			room->colmesh = room->meshes;
 		}
 
-		/* construct octree for ray-tests with this room's collision mesh
+		/* construct bvh for ray-tests with this room's collision mesh
 		 * this also destroys the colmesh array if it's not the same as the
-		 * renderable meshes array, because it's not needed any more. The octree
+		 * renderable meshes array, because it's not needed any more. The bvh
 		 * replaces it completely.
 		 */
-		build_room_octree(room);
+		build_room_bvh(room);
+		if(lvl->sdf_voxsz > 0.0f) {
+			room->sdf = sdf_create(room->bvh, lvl->sdf_voxsz);
+		}
 
 		darr_push(lvl->rooms, &room);
 
@@ -360,6 +373,8 @@ int lvl_load(struct level *lvl, const char *fname)
 	}
 	printf("level diameter: %g\n", lvl->maxdist);
 
+	build_room_grid(lvl);
+
 	/* cache missile mesh for easy access */
 	if(!(lvl->missile_mesh = lvl_find_dynmesh(lvl, "missile"))) {
 		return -1;
@@ -478,9 +493,12 @@ struct texture *lvl_texture(struct level *lvl, const char *fname)
 }
 
 #define NUM_ROOM_RAYS	3
-struct room *lvl_room_at(const struct level *lvl, float x, float y, float z)
+/* slow path of the room lookups: out of a set of candidate rooms, pick the one
+ * whose walls surround the point in the most directions.
+ */
+static struct room *room_at_rays(struct room **rooms, int num_rooms, float x, float y, float z)
 {
-	int i, j, num_rooms;
+	int i, j;
 	cgm_ray ray;
 	struct room *room;
 	int *roomhits, maxhits = 0;
@@ -490,12 +508,11 @@ struct room *lvl_room_at(const struct level *lvl, float x, float y, float z)
 
 	cgm_vcons(&ray.origin, x, y, z);
 
-	num_rooms = darr_size(lvl->rooms);
 	roomhits = alloca(num_rooms * sizeof *roomhits);
 	memset(roomhits, 0, num_rooms * sizeof *roomhits);
 
 	for(i=0; i<num_rooms; i++) {
-		room = lvl->rooms[i];
+		room = rooms[i];
 
 		if(!aabox_contains(&room->aabb, x, y, z)) {
 			continue;
@@ -503,7 +520,7 @@ struct room *lvl_room_at(const struct level *lvl, float x, float y, float z)
 
 		for(j=0; j<NUM_ROOM_RAYS; j++) {
 			ray.dir = rdir[j];
-			if(oct_raytest(room->octree, &ray, FLT_MAX, 0)) {
+			if(bvh_raytest(room->bvh, &ray, FLT_MAX, 0)) {
 				roomhits[i]++;
 				if(roomhits[i] > maxhits) maxhits = roomhits[i];
 			}
@@ -513,13 +530,90 @@ struct room *lvl_room_at(const struct level *lvl, float x, float y, float z)
 	if(maxhits) {
 		for(i=0; i<num_rooms; i++) {
 			if(roomhits[i] == maxhits) {
-				return lvl->rooms[i];
+				return rooms[i];
 			}
 		}
 	}
 	return 0;
 }
 
+static struct room *grid_room_at(const struct level *lvl, float x, float y, float z)
+{
+	int cx, cy, cz, idx;
+	const struct room_grid *grid = &lvl->grid;
+
+	if(!grid->cells) return 0;
+
+	x = (x - grid->org.x) * grid->inv_cellsz;
+	y = (y - grid->org.y) * grid->inv_cellsz;
+	z = (z - grid->org.z) * grid->inv_cellsz;
+	if(x < 0.0f || y < 0.0f || z < 0.0f) return 0;
+
+	cx = (int)x;
+	cy = (int)y;
+	cz = (int)z;
+	if(cx >= grid->size[0] || cy >= grid->size[1] || cz >= grid->size[2]) return 0;
+
+	idx = (cz * grid->size[1] + cy) * grid->size[0] + cx;
+	return grid->cells[idx] ? lvl->rooms[grid->cells[idx] - 1] : 0;
+}
+
+struct room *lvl_room_at(const struct level *lvl, float x, float y, float z)
+{
+	struct room *room;
+
+	if((room = grid_room_at(lvl, x, y, z))) {
+		return room;
+	}
+	return room_at_rays(lvl->rooms, darr_size(lvl->rooms), x, y, z);
+}
+
+struct room *lvl_track_room(const struct level *lvl, struct room *room,
+		const cgm_vec3 *from, const cgm_vec3 *to)
+{
+	int i, num_portals, num_cand;
+	cgm_ray ray;
+	struct room *res, **cand;
+
+	if((res = grid_room_at(lvl, to->x, to->y, to->z))) {
+		return res;
+	}
+	if(!room) {
+		return room_at_rays(lvl->rooms, darr_size(lvl->rooms), to->x, to->y, to->z);
+	}
+
+	ray.origin = *from;
+	cgm_vcons(&ray.dir, to->x - from->x, to->y - from->y, to->z - from->z);
+	if(cgm_vlength_sq(&ray.dir) <= 0.0f) {
+		return room;
+	}
+
+	/* rooms only meet at portals, so if we haven't come near any of them,
+	 * we're still in the same room
+	 */
+	num_portals = darr_size(room->portals);
+	cand = alloca((num_portals + 1) * sizeof *cand);
+	cand[0] = room;
+	num_cand = 1;
+	for(i=0; i<num_portals; i++) {
+		struct portal *port = room->portals + i;
+		if(port->link && ray_sphere(&ray, &port->pos, port->rad, 0)) {
+			cand[num_cand++] = port->link;
+		}
+	}
+
+	if(num_cand == 1 && aabox_contains(&room->aabb, to->x, to->y, to->z)) {
+		return room;
+	}
+
+	/* otherwise it has to be this room or one of the rooms next to it, unless
+	 * we've been moved a long way (teleported)
+	 */
+	if((res = room_at_rays(cand, num_cand, to->x, to->y, to->z))) {
+		return res;
+	}
+	return room_at_rays(lvl->rooms, darr_size(lvl->rooms), to->x, to->y, to->z);
+}
 
 #ifdef DBG_SHOW_COLPOLY
 extern const struct triangle *dbg_hitpoly;
@@ -556,7 +650,7 @@ static int check_collision(const struct level *lvl, const struct room *room,
 	ray.origin = *pos;
 	ray.dir = *vel;
 
-	if(oct_raytest(room->octree, &ray, 1.0f, &hit)) {
+	if(bvh_raytest(room->bvh, &ray, 1.0f, &hit)) {
 #ifdef DBG_SHOW_COLPOLY
 		dbg_hitpoly = hit.tri;
 #endif
@@ -606,7 +700,24 @@ int lvl_collision_rad(const struct level *lvl, const struct room *room, const cg
 
 	sphcent = *pos; cgm_vadd(&sphcent, vel);
 
-	if(oct_sphtest(room->octree, &sphcent, rad, &hit)) {
+	if(room->sdf) {
+		switch(sdf_sphtest(room->sdf, &sphcent, rad, &col->norm)) {
+		case SDF_MISS:
+			PROF_COUNT(PROF_SDFQ, 1);
+			return 0;
+		case SDF_HIT:
+			PROF_COUNT(PROF_SDFQ, 1);
+#ifdef DBG_SHOW_COLPOLY
+			/* the field doesn't know which triangle it was, look it up for show */
+			dbg_hitpoly = bvh_sphtest(room->bvh, &sphcent, rad, &hit) ? hit.tri : 0;
+#endif
+			return 1;
+		default:
+			break;
+		}
+	}
+
+	if(bvh_sphtest(room->bvh, &sphcent, rad, &hit)) {
 #ifdef DBG_SHOW_COLPOLY
 		dbg_hitpoly = hit.tri;
 #endif
@@ -616,6 +727,113 @@ int lvl_collision_rad(const struct level *lvl, const struct room *room, const cg
 	return 0;
 }
 
+#define MAX_SWEEP_ROOMS	8
+/* stay this far away from walls, so that sliding along them doesn't start
+ * with the sphere already touching them
+ */
+#define SWEEP_SKIN		1e-3f
+
+int lvl_sweep(const struct level *lvl, const struct room *room, const cgm_vec3 *pos,
+		const cgm_vec3 *vel, float rad, struct collision *col)
+{
+	int i, j, k, num_rooms, num_portals;
+	const struct room *rooms[MAX_SWEEP_ROOMS];
+	struct portal *port;
+	struct trihit hit, hit0;
+	cgm_ray ray;
+	float dist, vlen;
+
+	if((vlen = cgm_vlength(vel)) <= 0.0f) {
+		return 0;
+	}
+	if(!room) {
+		if(!(room = lvl_room_at(lvl, pos->x, pos->y, pos->z))) {
+			return 0;
+		}
+	}
+
+	ray.origin = *pos;
+	ray.dir = *vel;
+
+	hit0.t = FLT_MAX;
+	hit0.tri = 0;
+	cgm_vcons(&hit0.pt, 0, 0, 0);
+
+	rooms[0] = room;
+	num_rooms = 1;
+	for(i=0; i<num_rooms; i++) {
+		/* skip the triangles if the distance field shows the sphere can't reach
+		 * any of them during the move
+		 */
+		if(rooms[i]->sdf && sdf_sphtest(rooms[i]->sdf, pos, rad + vlen, 0) == SDF_MISS) {
+			PROF_COUNT(PROF_SDFQ, 1);
+		} else if(bvh_sweeptest(rooms[i]->bvh, pos, vel, rad, &hit) && hit.t < hit0.t) {
+			hit0 = hit;
+		}
+
+		/* carry on into the rooms behind any portals the sphere goes through */
+		num_portals = darr_size(rooms[i]->portals);
+		for(j=0; j<num_portals && num_rooms < MAX_SWEEP_ROOMS; j++) {
+			port = rooms[i]->portals + j;
+			if(!port->link) continue;
+
+			for(k=0; k<num_rooms; k++) {
+				if(rooms[k] == port->link) break;
+			}
+			if(k >= num_rooms && ray_sphere(&ray, &port->pos, port->rad + rad, 0)) {
+				rooms[num_rooms++] = port->link;
+			}
+		}
+	}
+
+	if(!hit0.tri) {
+		return 0;
+	}
+
+#ifdef DBG_SHOW_COLPOLY
+	dbg_hitpoly = hit0.tri;
+#endif
+	col->t = hit0.t;
+	col->pos = *pos;
+	cgm_vadd_scaled(&col->pos, vel, hit0.t);
+	col->norm = col->pos;
+	cgm_vsub(&col->norm, &hit0.pt);
+	if((dist = cgm_vlength(&col->norm)) > 1e-6f) {
+		cgm_vscale(&col->norm, 1.0f / dist);
+	} else {
+		col->norm = hit0.tri->norm;
+	}
+	col->depth = rad - dist;
+	return 1;
+}
+
+int lvl_move_sphere(const struct level *lvl, const struct room *room, cgm_vec3 *pos,
+		const cgm_vec3 *vel, float rad, int max_sweeps)
+{
+	int i;
+	cgm_vec3 v = *vel;
+	struct collision col;
+
+	for(i=0; i<max_sweeps; i++) {
+		if(cgm_vlength_sq(&v) <= 1e-5) {
+			break;
+		}
+		if(!lvl_sweep(lvl, room, pos, &v, rad, &col)) {
+			cgm_vadd(pos, &v);
+			return i + 1;
+		}
+
+		/* move up to the contact, and back off from the wall by the skin */
+		*pos = col.pos;
+		cgm_vadd_scaled(pos, &col.norm, SWEEP_SKIN);
+
+		/* and slide the rest of the way along the contact plane */
+		cgm_vscale(&v, 1.0f - col.t);
+		cgm_vadd_scaled(&v, &col.norm, -cgm_vdot(&v, &col.norm));
+	}
+	return i;
+}
+
 static void make_portal(struct portal *portal, struct goat3d_node *gnode)
 {
 	int i, vcount;
@@ -964,18 +1182,16 @@ static int proc_dynobj(struct level *lvl, struct ts_node *tsn)
 		}
 		obj->colmesh = mesh;
 		obj->aabb = mesh->aabb;
-		obj->octree = oct_create();
+		obj->bvh = bvh_create();
 
 		ntri = mesh_num_triangles(mesh);
 		for(i=0; i<ntri; i++) {
 			struct triangle tri;
 			mesh_get_triangle(mesh, i, &tri);
-			oct_addtri(obj->octree, &tri);
+			bvh_addtri(obj->bvh, &tri);
 		}
-		/* TODO: move octrees to meshes */
-#ifndef DBG_NO_OCTREE
-		oct_build(obj->octree, MAX_OCT_DEPTH, MAX_OCT_TRIS);
-#endif
+		/* TODO: move bvhs to meshes */
+		bvh_build(obj->bvh);
 	}
 
 	if((vec = ts_get_attr_vec(tsn, "rotaxis", 0))) {
@@ -1019,21 +1235,18 @@ static struct room *find_portal_link(struct level *lvl, struct portal *portal)
 }
 
 
-#define MAX_OCT_DEPTH	8
-#define MAX_OCT_TRIS	16
-
 #ifdef _MSC_VER
 #define isnan _isnan
 #endif
 
-static void build_room_octree(struct room *room)
+static void build_room_bvh(struct room *room)
 {
 	int i, j, num_meshes, num_tris;
 	struct triangle tri;
 
 	if(!room->colmesh) return;
 
-	room->octree = oct_create();
+	room->bvh = bvh_create();
 
 	num_meshes = darr_size(room->colmesh);
 	for(i=0; i<num_meshes; i++) {
@@ -1044,13 +1257,11 @@ static void build_room_octree(struct room *room)
 			assert(!isnan(tri.v[1].x) && !isnan(tri.v[1].y) && !isnan(tri.v[1].z));
 			assert(!isnan(tri.v[2].x) && !isnan(tri.v[2].y) && !isnan(tri.v[2].z));
 			tri.data = room;
-			oct_addtri(room->octree, &tri);
+			bvh_addtri(room->bvh, &tri);
 		}
 	}
 
-#ifndef DBG_NO_OCTREE
-	oct_build(room->octree, MAX_OCT_DEPTH, MAX_OCT_TRIS);
-#endif
+	bvh_build(room->bvh);
 
 	if(room->colmesh != room->meshes) {
 		/* we don't need the collision meshes any more */
@@ -1063,6 +1274,136 @@ static void build_room_octree(struct room *room)
 	}
 }
 
+#define GRID_MAX_CELLS	32768
+#define GRID_UNKNOWN	0xffff
+
+/* index + 1 of the room found by the slow lookup, or 0 */
+static unsigned short room_id_at(struct level *lvl, float x, float y, float z)
+{
+	int i, num_rooms = darr_size(lvl->rooms);
+	struct room *room;
+
+	if((room = room_at_rays(lvl->rooms, num_rooms, x, y, z))) {
+		for(i=0; i<num_rooms; i++) {
+			if(lvl->rooms[i] == room) return i + 1;
+		}
+	}
+	return 0;
+}
+
+/* cells which don't touch any walls or portals can't be crossed by the
+ * boundary between two rooms
+ */
+static int grid_cell_clear(struct level *lvl, const struct aabox *box)
+{
+	int i, j, num_rooms, num_portals;
+	struct room *room;
+
+	num_rooms = darr_size(lvl->rooms);
+	for(i=0; i<num_rooms; i++) {
+		room = lvl->rooms[i];
+
+		num_portals = darr_size(room->portals);
+		for(j=0; j<num_portals; j++) {
+			if(aabox_sph_test(box, &room->portals[j].pos, room->portals[j].rad)) {
+				return 0;
+			}
+		}
+
+		if(aabox_aabox_test(&room->aabb, box) && bvh_boxtest(room->bvh, box)) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static void build_room_grid(struct level *lvl)
+{
+	int i, x, y, z, lx, ly, num_rooms, num_cells, num_known;
+	cgm_vec3 ext;
+	float vol;
+	struct aabox box;
+	struct room_grid *grid = &lvl->grid;
+	unsigned short *lattice, *cell, *lptr, id;
+	static const int corner[8][3] = {{0, 0, 0}, {1, 0, 0}, {0, 1, 0}, {1, 1, 0},
+		{0, 0, 1}, {1, 0, 1}, {0, 1, 1}, {1, 1, 1}};
+
+	num_rooms = darr_size(lvl->rooms);
+	if(!num_rooms || num_rooms >= GRID_UNKNOWN || lvl->aabb.vmin.x >= lvl->aabb.vmax.x) {
+		return;
+	}
+
+	ext = lvl->aabb.vmax;
+	cgm_vsub(&ext, &lvl->aabb.vmin);
+	if((vol = ext.x * ext.y * ext.z) <= 0.0f) {
+		return;
+	}
+
+	grid->org = lvl->aabb.vmin;
+	grid->cellsz = pow(vol / GRID_MAX_CELLS, 1.0 / 3.0);
+	grid->inv_cellsz = 1.0f / grid->cellsz;
+	grid->size[0] = (int)ceil(ext.x * grid->inv_cellsz);
+	grid->size[1] = (int)ceil(ext.y * grid->inv_cellsz);
+	grid->size[2] = (int)ceil(ext.z * grid->inv_cellsz);
+	for(i=0; i<3; i++) {
+		if(grid->size[i] < 1) grid->size[i] = 1;
+	}
+	num_cells = grid->size[0] * grid->size[1] * grid->size[2];
+	grid->cells = calloc_nf(num_cells, sizeof *grid->cells);
+
+	/* room of each cell corner, shared between neighbouring cells */
+	lx = grid->size[0] + 1;
+	ly = grid->size[1] + 1;
+	lattice = malloc_nf(lx * ly * (grid->size[2] + 1) * sizeof *lattice);
+	for(i=0; i<lx * ly * (grid->size[2] + 1); i++) {
+		lattice[i] = GRID_UNKNOWN;
+	}
+
+	/* a cell belongs to a room if nothing crosses it, and its center and all of
+	 * its corners are in that room
+	 */
+	num_known = 0;
+	cell = grid->cells;
+	for(z=0; z<grid->size[2]; z++) {
+		for(y=0; y<grid->size[1]; y++) {
+			for(x=0; x<grid->size[0]; x++) {
+				box.vmin.x = grid->org.x + x * grid->cellsz;
+				box.vmin.y = grid->org.y + y * grid->cellsz;
+				box.vmin.z = grid->org.z + z * grid->cellsz;
+				box.vmax.x = box.vmin.x + grid->cellsz;
+				box.vmax.y = box.vmin.y + grid->cellsz;
+				box.vmax.z = box.vmin.z + grid->cellsz;
+
+				if(grid_cell_clear(lvl, &box)) {
+					id = room_id_at(lvl, (box.vmin.x + box.vmax.x) * 0.5f,
+							(box.vmin.y + box.vmax.y) * 0.5f, (box.vmin.z + box.vmax.z) * 0.5f);
+
+					for(i=0; i<8 && id; i++) {
+						lptr = lattice + ((z + corner[i][2]) * ly + y + corner[i][1]) * lx +
+							x + corner[i][0];
+						if(*lptr == GRID_UNKNOWN) {
+							*lptr = room_id_at(lvl, corner[i][0] ? box.vmax.x : box.vmin.x,
+									corner[i][1] ? box.vmax.y : box.vmin.y,
+									corner[i][2] ? box.vmax.z : box.vmin.z);
+						}
+						if(*lptr != id) id = 0;
+					}
+
+					if(id) {
+						*cell = id;
+						num_known++;
+					}
+				}
+				cell++;
+			}
+		}
+	}
+
+	free(lattice);
+	printf("room grid: %dx%dx%d, %d/%d cells inside a single room\n", grid->size[0],
+			grid->size[1], grid->size[2], num_known, num_cells);
+}
+
 
 void lvl_spawn_enemies(struct level *lvl)
 {
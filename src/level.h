@@ -21,7 +21,8 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include "config.h"
 
 #include "mesh.h"
-#include "octree.h"
+#include "bvh.h"
+#include "sdf.h"
 #include "enemy.h"
 #include "psys/psys.h"
 
@@ -51,7 +52,7 @@ struct object {
 	char *name;
 	struct mesh *mesh;
 	struct mesh *colmesh;
-	struct octnode *octree;
+	struct bvh *bvh;
 	struct aabox aabb;
 	cgm_vec3 pos;
 	cgm_quat rot;
@@ -86,7 +87,8 @@ struct room {
 	struct mesh *meshes;	/* darr */
 	struct mesh *colmesh;	/* darr */
 	struct aabox aabb;		/* axis-aligned bounding box of this room */
-	struct octnode *octree;	/* octree for collision poly intersections */
+	struct bvh *bvh;		/* bvh for collision poly intersections */
+	struct sdf *sdf;		/* optional distance field of the same polygons */
 
 	struct portal *portals;		/* darr */
 	struct trigger *triggers;	/* darr */
@@ -100,6 +102,8 @@ struct room {
 	struct psys_emitter **emitters;
 
 	unsigned int vis_frm, rendered;
+	cgm_vec4 vis_frust[6];	/* frustum reduced by the portals it was seen through */
+	float vis_rect[4];		/* screen rectangle of those portals (NDC xmin, ymin, xmax, ymax) */
 };
 
 struct portal {
@@ -109,6 +113,17 @@ struct portal {
 	float rad;
 };
 
+/* uniform grid over the level bounds, for constant time room lookups. Each
+ * cell holds the room it's entirely inside of, or 0 for cells which touch
+ * collision geometry or portals, where the room has to be found the slow way.
+ */
+struct room_grid {
+	int size[3];
+	cgm_vec3 org;				/* minimum corner */
+	float cellsz, inv_cellsz;
+	unsigned short *cells;		/* room index + 1 */
+};
+
 struct level {
 	struct room **rooms;		/* darr */
 	struct texture **textures;	/* darr */
@@ -125,6 +140,8 @@ struct level {
 
 	struct aabox aabb;			/* bounding box of the entire level */
 	float maxdist;				/* maximum distance in the level */
+	struct room_grid grid;
+	float sdf_voxsz;			/* voxel size of the room distance fields, 0 for none */
 
 	int max_enemies;
 	struct enemy **enemies;		/* darr */
@@ -136,6 +153,7 @@ struct collision {
 	cgm_vec3 pos;
 	cgm_vec3 norm;
 	float depth;
+	float t;		/* fraction of the velocity travelled, for sweeps */
 };
 
 struct room *alloc_room(void);
@@ -155,6 +173,13 @@ struct mesh *lvl_find_dynmesh(const struct level *lvl, const char *name);
 struct texture *lvl_texture(struct level *lvl, const char *fname);
 
 struct room *lvl_room_at(const struct level *lvl, float x, float y, float z);
+/* room containing "to", given the room containing "from", for things which
+ * move a short distance each frame. Cheaper than lvl_room_at, since it only
+ * has to cast rays when the path comes near one of the portals of the room.
+ * Falls back to lvl_room_at if room is null.
+ */
+struct room *lvl_track_room(const struct level *lvl, struct room *room,
+		const cgm_vec3 *from, const cgm_vec3 *to);
 
 int lvl_collision(const struct level *lvl, const struct room *room, const cgm_vec3 *pos,
 		const cgm_vec3 *vel, struct collision *col);
@@ -162,6 +187,20 @@ int lvl_collision(const struct level *lvl, const struct room *room, const cgm_ve
 int lvl_collision_rad(const struct level *lvl, const struct room *room, const cgm_vec3 *pos,
 		const cgm_vec3 *vel, float rad, struct collision *col);
 
+/* first contact of a sphere moving from pos to pos + vel, through the room and
+ * any rooms it passes into through their portals. col->pos is the center of
+ * the sphere at the time of contact, and col->norm points from the contact
+ * point to the center.
+ */
+int lvl_sweep(const struct level *lvl, const struct room *room, const cgm_vec3 *pos,
+		const cgm_vec3 *vel, float rad, struct collision *col);
+
+/* move a sphere by vel, sliding along any walls it runs into, with at most
+ * max_sweeps sweeps. Returns the number of sweeps it took.
+ */
+int lvl_move_sphere(const struct level *lvl, const struct room *room, cgm_vec3 *pos,
+		const cgm_vec3 *vel, float rad, int max_sweeps);
+
 void lvl_spawn_enemies(struct level *lvl);
 struct enemy *lvl_check_enemy_hit(struct level *lvl, struct room *room, const cgm_ray *ray);
 
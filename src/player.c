@@ -29,9 +29,12 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #define MOUSE_SPEED		(opt.mouse_speed * 0.0002)
 #define SBALL_RSPEED	(opt.sball_speed * 0.00002)
 #define SBALL_TSPEED	(opt.sball_speed * 0.00004)
+#define MAX_SLIDES		3
 
 static void activate(struct player *p, struct action *act);
+#ifdef DBG_ITER_COLLISION
 static int check_collision(struct player *p, const cgm_vec3 *vel, struct collision *col);
+#endif
 
 void init_player(struct player *p)
 {
@@ -109,12 +112,17 @@ extern int dbg_max_col_iter;
 /* this is called in the timestep update at a constant rate */
 void update_player(struct player *p)
 {
-	int i, iter, count;
+	int i, count;
 	cgm_quat rollquat;
 	cgm_vec3 right, up;
 	cgm_vec3 vel;
+#if defined(DBG_ITER_COLLISION) || defined(DBG_SHOW_MAX_COL_ITER)
+	int iter;
+#endif
+#ifdef DBG_ITER_COLLISION
 	struct collision col;
 	float vnlen;
+#endif
 
 	if(p->roll != 0.0f) {
 		cgm_qrotation(&rollquat, p->roll, 0, 0, 1);
@@ -144,16 +152,27 @@ void update_player(struct player *p)
 	}
 #endif
 
-	if(!(p->room = lvl_room_at(p->lvl, p->pos.x, p->pos.y, p->pos.z))) {
+	p->room = lvl_track_room(p->lvl, p->room, &p->roompos, &p->pos);
+	p->roompos = p->pos;
+	if(!p->room) {
 		cgm_vadd(&p->pos, &vel);
 		return;
 	}
 
+#ifdef DBG_ITER_COLLISION
 	iter = 0;
 	while(cgm_vlength_sq(&vel) > 1e-5 && iter++ < 16 && check_collision(p, &vel, &col)) {
 		vnlen = -cgm_vdot(&vel, &col.norm);
 		cgm_vadd_scaled(&vel, &col.norm, vnlen);	/* vel += norm * vnlen */
 	}
+	if(iter < 16) {
+		cgm_vadd(&p->pos, &vel);
+	}
+#elif defined(DBG_SHOW_MAX_COL_ITER)
+	iter = lvl_move_sphere(p->lvl, p->room, &p->pos, &vel, COL_RADIUS, MAX_SLIDES);
+#else
+	lvl_move_sphere(p->lvl, p->room, &p->pos, &vel, COL_RADIUS, MAX_SLIDES);
+#endif
 
 #ifdef DBG_SHOW_MAX_COL_ITER
 	if(iter > dbg_max_col_iter) {
@@ -162,10 +181,6 @@ void update_player(struct player *p)
 	}
 #endif
 
-	if(iter < 16) {
-		cgm_vadd(&p->pos, &vel);
-	}
-
 	/* regenerate energy */
 	p->sp += SP_REGEN;
 	if(p->sp > MAX_SP) p->sp = MAX_SP;
@@ -190,7 +205,7 @@ void update_player(struct player *p)
 		cgm_vmul_m4v3(&localpos, obj->invmatrix);
 
 		if(aabox_sph_test(&obj->aabb, &localpos, COL_RADIUS)) {
-			if(obj->octree && !oct_sphtest(obj->octree, &localpos, COL_RADIUS, 0)) {
+			if(obj->bvh && !bvh_sphtest(obj->bvh, &localpos, COL_RADIUS, 0)) {
 				continue;
 			}
 			if(obj->act.type == ACT_PICKUP) {
@@ -267,6 +282,7 @@ static void activate(struct player *p, struct action *act)
 	}
 }
 
+#ifdef DBG_ITER_COLLISION
 static int check_collision(struct player *p, const cgm_vec3 *vel, struct collision *col)
 {
 	/*int i, nobj;*/
@@ -297,3 +313,4 @@ static int check_collision(struct player *p, const cgm_vec3 *vel, struct collisi
 
 	return 0;
 }
+#endif	/* DBG_ITER_COLLISION */
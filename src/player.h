@@ -40,6 +40,7 @@ struct player {
 	int num_missiles;
 
 	cgm_vec3 pos, prevpos;
+	cgm_vec3 roompos;	/* where room was last looked up */
 	cgm_quat rot;
 	cgm_vec3 fwd;	/* forward vector, derived from rot */
 
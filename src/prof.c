@@ -0,0 +1,241 @@
+/*
+Deep Runner - 6dof shooter game for the SGI O2.
+Copyright (C) 2023  John Tsiombikas <nuclear@mutantstargoat.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "prof.h"
+
+#ifdef DBG_PROFILE
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/time.h>
+#endif
+#include "gaw/gaw.h"
+#include "game.h"
+#include "font.h"
+#include "gfxutil.h"
+
+#define MAX_DEPTH	16
+
+unsigned long prof_count[PROF_NUM_COUNTERS];
+
+static const char *zone_names[] = {
+	"update", "vis", "render", "ui", "tnl", "clip", "rast", "swap"
+};
+static const char *count_names[] = {
+	"prims", "culled", "clipped", "pixels", "zfail", "rooms", "colq", "colnodes",
+	"coltris", "sdfq"
+};
+
+/* open zones: start time, and time spent in the zones nested in it */
+static struct {
+	int zone;
+	long start, inner;
+} stack[MAX_DEPTH];
+static int depth;
+
+static long zone_usec[PROF_NUM_ZONES];
+static long frame_start;
+
+/* results of the last complete frame, for the overlay */
+static long last_zone_usec[PROF_NUM_ZONES];
+static unsigned long last_count[PROF_NUM_COUNTERS];
+static long last_frame_usec;
+static long frame_num;
+
+static FILE *csv;
+static int overlay;
+
+static long get_usec(void);
+
+
+int prof_init(void)
+{
+	int i;
+	char *fname;
+
+	if(!(fname = getenv("PROF_CSV"))) {
+		fname = "prof.csv";
+	}
+	if(!(csv = fopen(fname, "wb"))) {
+		fprintf(stderr, "failed to open profiling output file: %s\n", fname);
+		return -1;
+	}
+	fprintf(csv, "frame,frame_ms");
+	for(i=0; i<PROF_NUM_ZONES; i++) {
+		fprintf(csv, ",%s_ms", zone_names[i]);
+	}
+	for(i=0; i<PROF_NUM_COUNTERS; i++) {
+		fprintf(csv, ",%s", count_names[i]);
+	}
+	fputc('\n', csv);
+
+	frame_start = get_usec();
+	return 0;
+}
+
+void prof_shutdown(void)
+{
+	if(csv) {
+		fclose(csv);
+		csv = 0;
+	}
+}
+
+void prof_begin(int zone)
+{
+	if(depth < MAX_DEPTH) {
+		stack[depth].zone = zone;
+		stack[depth].inner = 0;
+		stack[depth].start = get_usec();
+	}
+	depth++;
+}
+
+void prof_end(int zone)
+{
+	long dt;
+
+	if(--depth >= MAX_DEPTH) return;
+	if(depth < 0 || stack[depth].zone != zone) {
+		fprintf(stderr, "prof_end: unbalanced zone %s\n", zone_names[zone]);
+		depth = 0;
+		return;
+	}
+
+	dt = get_usec() - stack[depth].start;
+	zone_usec[zone] += dt - stack[depth].inner;
+	if(depth > 0) {
+		stack[depth - 1].inner += dt;
+	}
+}
+
+void prof_end_frame(void)
+{
+	int i;
+	long now = get_usec();
+
+	last_frame_usec = now - frame_start;
+	frame_start = now;
+
+	memcpy(last_zone_usec, zone_usec, sizeof last_zone_usec);
+	memcpy(last_count, prof_count, sizeof last_count);
+	memset(zone_usec, 0, sizeof zone_usec);
+	memset(prof_count, 0, sizeof prof_count);
+
+	if(csv) {
+		fprintf(csv, "%ld,%.3f", frame_num, last_frame_usec / 1000.0f);
+		for(i=0; i<PROF_NUM_ZONES; i++) {
+			fprintf(csv, ",%.3f", last_zone_usec[i] / 1000.0f);
+		}
+		for(i=0; i<PROF_NUM_COUNTERS; i++) {
+			fprintf(csv, ",%lu", last_count[i]);
+		}
+		fputc('\n', csv);
+	}
+	frame_num++;
+}
+
+void prof_overlay(int show)
+{
+	overlay = show >= 0 ? show : !overlay;
+}
+
+#define LINE_SPACING	14
+#define VALUE_XOFFS		60
+#define TEXT_SCALE		0.3f
+
+static void draw_row(float y, const char *name, const char *val)
+{
+	gaw_push_matrix();
+	gaw_translate(4, y, 0);
+	gaw_scale(TEXT_SCALE, -TEXT_SCALE, TEXT_SCALE);
+	dtx_string(name);
+	gaw_pop_matrix();
+
+	gaw_push_matrix();
+	gaw_translate(4 + VALUE_XOFFS, y, 0);
+	gaw_scale(TEXT_SCALE, -TEXT_SCALE, TEXT_SCALE);
+	dtx_string(val);
+	gaw_pop_matrix();
+}
+
+void prof_draw(void)
+{
+	int i;
+	float y;
+	char buf[64];
+
+	if(!overlay) return;
+
+	begin2d(480);
+	use_font(font_menu);
+	gaw_color3f(1, 1, 0.5);
+
+	y = LINE_SPACING;
+	sprintf(buf, "%.2f ms (%.1f fps)", last_frame_usec / 1000.0f,
+			last_frame_usec > 0 ? 1000000.0f / last_frame_usec : 0.0f);
+	draw_row(y, "frame", buf);
+	y += LINE_SPACING;
+
+	for(i=0; i<PROF_NUM_ZONES; i++) {
+		sprintf(buf, "%.2f ms", last_zone_usec[i] / 1000.0f);
+		draw_row(y, zone_names[i], buf);
+		y += LINE_SPACING;
+	}
+	for(i=0; i<PROF_NUM_COUNTERS; i++) {
+		sprintf(buf, "%lu", last_count[i]);
+		draw_row(y, count_names[i], buf);
+		y += LINE_SPACING;
+	}
+	if(last_count[PROF_COLQ]) {
+		sprintf(buf, "%.1f nodes, %.1f tris",
+				(float)last_count[PROF_COLNODES] / last_count[PROF_COLQ],
+				(float)last_count[PROF_COLTRIS] / last_count[PROF_COLQ]);
+		draw_row(y, "per colq", buf);
+	}
+	dtx_flush();
+
+	end2d();
+}
+
+static long get_usec(void)
+{
+#ifdef _WIN32
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER cnt;
+
+	if(!freq.QuadPart) {
+		QueryPerformanceFrequency(&freq);
+	}
+	QueryPerformanceCounter(&cnt);
+	return (long)(cnt.QuadPart * 1000000 / freq.QuadPart);
+#else
+	static struct timeval tv0;
+	struct timeval tv;
+
+	if(!tv0.tv_sec) {
+		gettimeofday(&tv0, 0);
+	}
+	gettimeofday(&tv, 0);
+	return (tv.tv_sec - tv0.tv_sec) * 1000000 + tv.tv_usec - tv0.tv_usec;
+#endif
+}
+
+#endif	/* DBG_PROFILE */
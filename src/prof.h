@@ -0,0 +1,88 @@
+/*
+Deep Runner - 6dof shooter game for the SGI O2.
+Copyright (C) 2023  John Tsiombikas <nuclear@mutantstargoat.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef PROF_H_
+#define PROF_H_
+
+#include "config.h"
+
+/* Per-frame profiling, enabled by defining DBG_PROFILE in config.h. Without
+ * it all the PROF_ macros expand to nothing.
+ *
+ * Zones are timed between PROF_BEGIN and PROF_END, and may nest: the time of
+ * inner zones is subtracted from the enclosing one, so each reports only its
+ * own time. Timing is done on the calling thread; with rasterizer threads the
+ * rast zone is the time spent queueing polygons, and waiting for them to be
+ * drawn is part of swap.
+ *
+ * Every frame is written as a line to a CSV file (prof.csv, or PROF_CSV in
+ * the environment), and F9 toggles an overlay with the last frame's results.
+ */
+enum {
+	PROF_UPDATE,	/* game logic (gupdate) */
+	PROF_VIS,		/* portal visibility (rendlvl_update) */
+	PROF_RENDER,	/* render_level */
+	PROF_UI,		/* draw_ui */
+	PROF_TNL,		/* software transform, lighting, and culling */
+	PROF_CLIP,		/* software polygon clipping */
+	PROF_RAST,		/* software rasterizer (polyfill) */
+	PROF_SWAP,		/* game_swap_buffers */
+
+	PROF_NUM_ZONES
+};
+
+enum {
+	PROF_PRIMS,		/* primitives submitted to the software T&L */
+	PROF_CULLED,	/* ... culled: outside the frustum/scissor, or back-facing */
+	PROF_CLIPPED,	/* ... clipped against the frustum */
+	PROF_PIXELS,	/* pixels written by the software rasterizer */
+	PROF_ZFAIL,		/* pixels failing the depth test */
+	PROF_ROOMS,		/* rooms visited through portals */
+	PROF_COLQ,		/* collision queries against room/object bvhs */
+	PROF_COLNODES,	/* bvh nodes visited */
+	PROF_COLTRIS,	/* triangles tested for collisions */
+	PROF_SDFQ,		/* collision queries answered by the distance fields alone */
+
+	PROF_NUM_COUNTERS
+};
+
+#ifdef DBG_PROFILE
+extern unsigned long prof_count[PROF_NUM_COUNTERS];
+
+int prof_init(void);
+void prof_shutdown(void);
+
+void prof_begin(int zone);
+void prof_end(int zone);
+
+/* finish the frame, write it to the CSV file, and start counting the next */
+void prof_end_frame(void);
+
+void prof_overlay(int show);	/* -1 toggles */
+void prof_draw(void);
+
+#define PROF_BEGIN(zone)	prof_begin(zone)
+#define PROF_END(zone)		prof_end(zone)
+#define PROF_COUNT(cnt, n)	(prof_count[cnt] += (n))
+
+#else	/* !DBG_PROFILE */
+#define PROF_BEGIN(zone)
+#define PROF_END(zone)
+#define PROF_COUNT(cnt, n)
+#endif
+
+#endif	/* PROF_H_ */
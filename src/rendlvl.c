@@ -17,6 +17,9 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 #include "config.h"
 
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
 #include "gaw/gaw.h"
 #include "game.h"
 #include "rendlvl.h"
@@ -24,11 +27,17 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include "enemy.h"
 #include "gfxutil.h"
 #include "psys/psys.h"
+#include "util.h"
+#include "prof.h"
 
 static struct level *lvl;
 static struct room *cur_room;
 static cgm_vec4 frust[6];	/* frustum planes */
 static cgm_vec3 view_pos;
+static float view_proj[16];
+
+static const float full_rect[] = {-1, -1, 1, 1};
+static const struct room *scissor_room;
 
 #ifdef DBG_SHOW_FRUST
 #define MAX_FRUST	32
@@ -48,6 +57,32 @@ extern int dbg_freezevis;
 
 static struct texture *tex_shield, *tex_expl;
 
+/* per-frame draw lists of everything in the visible rooms */
+enum { DRAW_MESH, DRAW_DYNOBJ, DRAW_ENEMY, DRAW_MISSILE };
+
+struct drawitem {
+	int type;
+	void *obj;
+	struct room *room;
+	float dist;		/* sort key, distance from the viewer */
+};
+
+struct drawlist {
+	struct drawitem *items;
+	int num, max;
+};
+
+static struct drawlist opaque_list, blend_list;
+
+/* frustum planes in structure-of-arrays form, so that the culling tests can
+ * run through all six planes in one straight loop
+ */
+struct cull_frustum {
+	float nx[6], ny[6], nz[6], d[6];
+};
+
+static struct rendlvl_stats stats;
+
 #define MAX_EXPLOSIONS	16
 static struct explosion explosions[MAX_EXPLOSIONS];
 
@@ -60,8 +95,10 @@ static long expl_psys_start[MAX_EXPL_PSYS];
 #endif
 
 
+static void update_room(struct room *room, const cgm_vec4 *frust, const float *rect);
 static int portal_frustum_test(struct portal *portal, const cgm_vec4 *frust);
 static void reduce_frustum(cgm_vec4 *np, const cgm_vec4 *p, const struct portal *portal);
+static int portal_rect(const struct portal *portal, const float *prect, float *rect);
 
 
 int rendlvl_init(struct level *level)
@@ -116,6 +153,11 @@ void rendlvl_destroy(void)
 	tex_free(tex_shield);
 	tex_free(tex_expl);
 
+	free(opaque_list.items);
+	free(blend_list.items);
+	memset(&opaque_list, 0, sizeof opaque_list);
+	memset(&blend_list, 0, sizeof blend_list);
+
 #ifndef DBG_NOPSYS
 	psys_destroy_attr(&psys_expl_attr);
 	psys_destroy_attr(&psys_trail_attr);
@@ -131,6 +173,7 @@ void rendlvl_setup(struct room *room, const cgm_vec3 *ppos, float *vp_matrix)
 	}
 	cur_room = room;
 	view_pos = *ppos;
+	cgm_mcopy(view_proj, vp_matrix);
 
 	for(i=0; i<6; i++) {
 		cgm_mget_frustum_plane(vp_matrix, i, frust + i);
@@ -138,13 +181,58 @@ void rendlvl_setup(struct room *room, const cgm_vec3 *ppos, float *vp_matrix)
 	}
 }
 
-static void update_room(struct room *room, const cgm_vec4 *frust)
+/* a room already visited this frame is also visible through another portal.
+ * Grow its rectangle to cover both, and cull its contents against the whole
+ * view frustum, since the planes reduced through two portals don't combine.
+ * Rooms seen through it were narrowed by the first path alone, so whenever
+ * anything grows, its portals are traversed again to widen them too.
+ */
+static void widen_room_vis(struct room *room, const float *rect)
+{
+	int i, nportals, grown = 0;
+	float *r = room->vis_rect;
+	cgm_vec4 newfrust[6];
+	float newrect[4];
+
+	if(rect[0] < r[0]) { r[0] = rect[0]; grown = 1; }
+	if(rect[1] < r[1]) { r[1] = rect[1]; grown = 1; }
+	if(rect[2] > r[2]) { r[2] = rect[2]; grown = 1; }
+	if(rect[3] > r[3]) { r[3] = rect[3]; grown = 1; }
+
+	if(memcmp(room->vis_frust, frust, sizeof room->vis_frust) != 0) {
+		memcpy(room->vis_frust, frust, sizeof room->vis_frust);
+		grown = 1;
+	}
+	/* rectangles only ever grow, and the frustum resets once, so this ends */
+	if(!grown) return;
+
+	nportals = darr_size(room->portals);
+	for(i=0; i<nportals; i++) {
+		struct portal *portal = room->portals + i;
+
+		if(!portal->link) continue;
+		if(!portal_frustum_test(portal, frust)) continue;
+		if(!portal_rect(portal, r, newrect)) continue;
+
+		if(portal->link->vis_frm != updateno) {
+			reduce_frustum(newfrust, frust, portal);
+			update_room(portal->link, newfrust, newrect);
+		} else {
+			widen_room_vis(portal->link, newrect);
+		}
+	}
+}
+
+/* rect: screen rectangle through which this room is visible */
+static void update_room(struct room *room, const cgm_vec4 *frust, const float *rect)
 {
 	static float tm;
 	int i, nmeshes, nobj, nportals;
 	cgm_vec4 newfrust[6];
+	float newrect[4];
 
 	tm += TSTEP;
+	PROF_COUNT(PROF_ROOMS, 1);
 
 	nmeshes = darr_size(room->meshes);
 	for(i=0; i<nmeshes; i++) {
@@ -171,6 +259,12 @@ static void update_room(struct room *room, const cgm_vec4 *frust)
 		cgm_minverse(obj->invmatrix);
 	}
 
+	/* keep the frustum and screen rectangle this room is seen through, for
+	 * culling and scissoring its contents
+	 */
+	memcpy(room->vis_frust, frust, sizeof room->vis_frust);
+	memcpy(room->vis_rect, rect, sizeof room->vis_rect);
+
 #if !defined(DBG_ONLY_CUR_ROOM) && !defined(DBG_ALL_ROOMS)
 	/* recursively visit all rooms reachable through visible portals */
 	room->vis_frm = updateno;
@@ -185,9 +279,15 @@ static void update_room(struct room *room, const cgm_vec4 *frust)
 
 		if(!portal->link) continue;	/* unlinked portals */
 
-		if(portal_frustum_test(portal, frust) && portal->link->vis_frm != updateno) {
+		if(!portal_frustum_test(portal, frust)) continue;
+		/* the portal as seen through the portals leading to this room */
+		if(!portal_rect(portal, rect, newrect)) continue;
+
+		if(portal->link->vis_frm != updateno) {
 			reduce_frustum(newfrust, frust, portal);
-			update_room(portal->link, newfrust);
+			update_room(portal->link, newfrust, newrect);
+		} else {
+			widen_room_vis(portal->link, newrect);
 		}
 	}
 #endif
@@ -198,7 +298,7 @@ void rendlvl_update(void)
 	int i;
 
 #ifdef DBG_ONLY_CUR_ROOM
-	if(cur_room) update_room(cur_room, frust);
+	if(cur_room) update_room(cur_room, frust, full_rect);
 #elif defined(DBG_ALL_ROOMS)
 	int nrooms;
 	struct room *room;
@@ -207,7 +307,7 @@ void rendlvl_update(void)
 	for(i=0; i<nrooms; i++) {
 		room = lvl->rooms[i];
 
-		update_room(room, frust);
+		update_room(room, frust, full_rect);
 	}
 #else
 
@@ -220,7 +320,7 @@ void rendlvl_update(void)
 #endif
 
 	updateno++;
-	if(cur_room) update_room(cur_room, frust);
+	if(cur_room) update_room(cur_room, frust, full_rect);
 #endif
 
 	/* update explosions */
@@ -255,36 +355,174 @@ void rendlvl_update(void)
 }
 
 
-static void render_room(struct room *room)
+/* load frustum planes, optionally moving them to the local space of an
+ * object with the given matrix: n' = n * M
+ */
+static void load_frustum(struct cull_frustum *cf, const cgm_vec4 *p, const float *xform)
 {
-	int i, nmeshes, nportals, nobj;
+	int i;
+
+	for(i=0; i<6; i++) {
+		if(xform) {
+			cf->nx[i] = p[i].x * xform[0] + p[i].y * xform[1] + p[i].z * xform[2] + p[i].w * xform[3];
+			cf->ny[i] = p[i].x * xform[4] + p[i].y * xform[5] + p[i].z * xform[6] + p[i].w * xform[7];
+			cf->nz[i] = p[i].x * xform[8] + p[i].y * xform[9] + p[i].z * xform[10] + p[i].w * xform[11];
+			cf->d[i] = p[i].x * xform[12] + p[i].y * xform[13] + p[i].z * xform[14] + p[i].w * xform[15];
+		} else {
+			cf->nx[i] = p[i].x;
+			cf->ny[i] = p[i].y;
+			cf->nz[i] = p[i].z;
+			cf->d[i] = p[i].w;
+		}
+	}
+}
+
+static int cull_sphere(const struct cull_frustum *cf, const cgm_vec3 *cent, float rad)
+{
+	int i, out = 0;
+
+	for(i=0; i<6; i++) {
+		out |= cf->nx[i] * cent->x + cf->ny[i] * cent->y + cf->nz[i] * cent->z + cf->d[i] < -rad;
+	}
+	return out;
+}
+
+/* sphere and box together, outside of any plane by either of them is culled */
+static int cull_mesh(const struct cull_frustum *cf, const struct mesh *mesh)
+{
+	int i, out = 0;
+	float cx, cy, cz, ex, ey, ez, r, s;
+	const cgm_vec3 *sc = &mesh->bsph_cent;
+
+	cx = (mesh->aabb.vmin.x + mesh->aabb.vmax.x) * 0.5f;
+	cy = (mesh->aabb.vmin.y + mesh->aabb.vmax.y) * 0.5f;
+	cz = (mesh->aabb.vmin.z + mesh->aabb.vmax.z) * 0.5f;
+	ex = mesh->aabb.vmax.x - cx;
+	ey = mesh->aabb.vmax.y - cy;
+	ez = mesh->aabb.vmax.z - cz;
+
+	for(i=0; i<6; i++) {
+		/* projection radius of the box on the plane normal */
+		r = ex * fabs(cf->nx[i]) + ey * fabs(cf->ny[i]) + ez * fabs(cf->nz[i]);
+		s = cf->nx[i] * cx + cf->ny[i] * cy + cf->nz[i] * cz + cf->d[i];
+		out |= s < -r;
+
+		s = cf->nx[i] * sc->x + cf->ny[i] * sc->y + cf->nz[i] * sc->z + cf->d[i];
+		out |= s < -mesh->bsph_rad;
+	}
+	return out;
+}
+
+static float sphere_dist(const cgm_vec3 *cent, const float *xform)
+{
+	cgm_vec3 pos = *cent;
+	if(xform) {
+		cgm_vmul_m4v3(&pos, xform);
+	}
+	return cgm_vdist(&pos, &view_pos);
+}
+
+static void add_draw(int type, void *obj, struct room *room, float dist, float rad, int blend)
+{
+	struct drawlist *list = blend ? &blend_list : &opaque_list;
+	struct drawitem *item;
+
+	/* the lists keep their storage across frames */
+	if(list->num >= list->max) {
+		list->max = list->max ? list->max * 2 : 64;
+		list->items = realloc_nf(list->items, list->max * sizeof *list->items);
+	}
+	item = list->items + list->num++;
+
+	item->type = type;
+	item->obj = obj;
+	item->room = room;
+	/* translucent items are drawn back to front by their centers, opaque
+	 * items front to back by the nearest point of their bounding sphere
+	 */
+	item->dist = blend ? dist : dist - rad;
+}
+
+static int mesh_blended(const struct mesh *mesh)
+{
+	/* multipass materials blend the envmap pass over the first one */
+	return mesh->mtl.texmap && mesh->mtl.envmap;
+}
+
+static void collect_room(struct room *room)
+{
+	int i, nmeshes, nportals, nobj, overlay;
+	struct mesh *mesh;
+	struct object *obj;
 	struct enemy *mob;
+	struct missile *mis;
+	struct cull_frustum cf, objcf, viewcf;
+	cgm_vec3 pos;
+
+	stats.rooms++;
+	load_frustum(&cf, room->vis_frust, 0);
+	/* enemies and missiles can stick out through the portals of their room, so
+	 * they are culled against the whole view frustum instead
+	 */
+	load_frustum(&viewcf, frust, 0);
 
 	nmeshes = darr_size(room->meshes);
 	for(i=0; i<nmeshes; i++) {
-		render_level_mesh(room->meshes + i);
+		mesh = room->meshes + i;
+		if(cull_mesh(&cf, mesh)) {
+			stats.meshes_culled++;
+			continue;
+		}
+		stats.meshes++;
+		add_draw(DRAW_MESH, mesh, room, sphere_dist(&mesh->bsph_cent, 0),
+				mesh->bsph_rad, mesh_blended(mesh));
 	}
 
-	/* render dynamic objects */
+	/* dynamic objects */
 	nobj = darr_size(room->objects);
 	for(i=0; i<nobj; i++) {
-		if(room->objects[i]->mesh) {
-			render_dynobj(room->objects[i]);
+		obj = room->objects[i];
+		if(!(mesh = obj->mesh)) continue;
+		/* test the object-space bounds against the frustum in object space */
+		load_frustum(&objcf, room->vis_frust, obj->matrix);
+		if(cull_mesh(&objcf, mesh)) {
+			stats.objects_culled++;
+			continue;
 		}
+		stats.objects++;
+		add_draw(DRAW_DYNOBJ, obj, room, sphere_dist(&mesh->bsph_cent, obj->matrix),
+				mesh->bsph_rad, mesh_blended(mesh));
 	}
 
-	/* render enemies */
+	/* enemies, with a hit overlay billboard they go with the translucent stuff */
 	nobj = darr_size(room->enemies);
 	for(i=0; i<nobj; i++) {
 		mob = room->enemies[i];
-		if(mob->hp > 0.0f) {
-			render_enemy(mob);
+		if(mob->hp <= 0.0f) continue;
+		if(cull_sphere(&viewcf, &mob->pos, mob->rad)) {
+			stats.enemies_culled++;
+			continue;
 		}
+		stats.enemies++;
+		overlay = time_msec - mob->last_dmg_hit < EXPL_DUR ||
+			time_msec - mob->last_shield_hit < SHIELD_OVERLAY_DUR;
+		add_draw(DRAW_ENEMY, mob, room, sphere_dist(&mob->pos, 0), mob->rad,
+				overlay || mesh_blended(mob->mesh));
 	}
 
-	/* render missiles */
+	/* missiles */
 	for(i=0; i<room->num_missiles; i++) {
-		render_missile(room->missiles[i]);
+		mis = room->missiles[i];
+		mesh = mis->mesh;
+		pos = mesh->bsph_cent;
+		cgm_vmul_m4v3(&pos, mis->matrix);
+		if(cull_sphere(&viewcf, &pos, mesh->bsph_rad)) {
+			stats.missiles_culled++;
+			continue;
+		}
+		stats.missiles++;
+		add_draw(DRAW_MISSILE, mis, room, cgm_vdist(&pos, &view_pos),
+				mesh->bsph_rad, mesh_blended(mesh));
 	}
 
 	/* mark this room as visited in the current frame */
@@ -293,14 +531,14 @@ static void render_room(struct room *room)
 	nportals = darr_size(room->portals);
 	for(i=0; i<nportals; i++) {
 #if !defined(DBG_ONLY_CUR_ROOM) && !defined(DBG_ALL_ROOMS)
-		/* recursively draw visible rooms */
+		/* recursively collect visible rooms */
 		struct room *link = room->portals[i].link;
-		/* skip unlinked and those rendered this frame */
+		/* skip unlinked and those visited this frame */
 		if(!link || link->rendered) continue;
 
 		/* recurse if the next room is visible in the current frame */
 		if(link->vis_frm == updateno) {
-			render_room(link);
+			collect_room(link);
 		}
 #endif
 #ifdef DBG_SHOW_PORTALS
@@ -316,35 +554,145 @@ static void render_room(struct room *room)
 	}
 }
 
+static int cmp_front_to_back(const void *a, const void *b)
+{
+	float da = ((const struct drawitem*)a)->dist;
+	float db = ((const struct drawitem*)b)->dist;
+	return da < db ? -1 : (da > db ? 1 : 0);
+}
+
+static int cmp_back_to_front(const void *a, const void *b)
+{
+	return cmp_front_to_back(b, a);
+}
+
+/* scissor to the screen rectangle of the portals a room is visible through,
+ * or disable scissoring for a null room
+ */
+static void set_scissor(const struct room *room)
+{
+	int x0, y0, x1, y1;
+	const float *r = 0;
+
+#ifdef DBG_FREEZEVIS
+	/* the rectangles are from the frozen viewpoint, useless for this one */
+	if(dbg_freezevis) room = 0;
+#endif
+	if(room) {
+		r = room->vis_rect;
+		if(r[0] <= -1.0f && r[1] <= -1.0f && r[2] >= 1.0f && r[3] >= 1.0f) {
+			room = 0;
+		}
+	}
+	if(room == scissor_room) return;
+
+	if(room) {
+		x0 = (int)floor((r[0] * 0.5f + 0.5f) * win_width);
+		y0 = (int)floor((r[1] * 0.5f + 0.5f) * win_height);
+		x1 = (int)ceil((r[2] * 0.5f + 0.5f) * win_width);
+		y1 = (int)ceil((r[3] * 0.5f + 0.5f) * win_height);
+		gaw_scissor(x0, y0, x1 - x0, y1 - y0);
+		if(!scissor_room) {
+			gaw_enable(GAW_SCISSOR_TEST);
+		}
+	} else {
+		gaw_disable(GAW_SCISSOR_TEST);
+	}
+	scissor_room = room;
+}
+
+static void draw_list(struct drawlist *dlist)
+{
+	int i, spanbuf = 0;
+	struct drawitem *list = dlist->items;
+
+	for(i=0; i<dlist->num; i++) {
+#ifdef DBG_SHOW_CUR_ROOM
+		dbg_cur_room = list[i].room == cur_room;
+#endif
+		/* room geometry is opaque and static, let the renderer draw it front
+		 * to back with hidden surface removal, if it can
+		 */
+		if((list[i].type == DRAW_MESH) != spanbuf) {
+			spanbuf = !spanbuf;
+			if(spanbuf) {
+				gaw_enable(GAW_SPANBUF);
+			} else {
+				gaw_disable(GAW_SPANBUF);
+			}
+		}
+
+		/* room meshes and the objects placed in them can only be seen through
+		 * the portals leading to their room. Enemies and missiles move
+		 * between rooms, and might stick out through a portal.
+		 */
+		if(list[i].type == DRAW_MESH || list[i].type == DRAW_DYNOBJ) {
+			set_scissor(list[i].room);
+		} else {
+			set_scissor(0);
+		}
+
+		switch(list[i].type) {
+		case DRAW_MESH:
+			render_level_mesh(list[i].obj);
+			break;
+		case DRAW_DYNOBJ:
+			render_dynobj(list[i].obj);
+			break;
+		case DRAW_ENEMY:
+			render_enemy(list[i].obj);
+			break;
+		case DRAW_MISSILE:
+			render_missile(list[i].obj);
+			break;
+		}
+	}
+
+	if(spanbuf) gaw_disable(GAW_SPANBUF);
+}
+
 void render_level(void)
 {
-#ifdef DBG_ONLY_CUR_ROOM
-	render_room(cur_room);
-#else
-	int i, nrooms;
+	int i;
+#ifndef DBG_ONLY_CUR_ROOM
+	int nrooms;
 	struct room *room;
+#endif
 
+	opaque_list.num = blend_list.num = 0;
+	memset(&stats, 0, sizeof stats);
+
+#ifdef DBG_ONLY_CUR_ROOM
+	collect_room(cur_room);
+#else
 	nrooms = darr_size(lvl->rooms);
 	for(i=0; i<nrooms; i++) {
 		room = lvl->rooms[i];
 
-#ifdef DBG_SHOW_CUR_ROOM
-		dbg_cur_room = room == cur_room;
-#endif
-
 #ifdef DBG_ALL_ROOMS
-		render_room(room);
+		collect_room(room);
 #else
 		room->rendered = 0;
 #endif
 	}
 
 #ifndef DBG_ALL_ROOMS
-	/* render only the current room, and those linked by visible portals */
-	render_room(cur_room);
+	/* draw only the current room, and those linked by visible portals */
+	collect_room(cur_room);
 #endif	/* !def DBG_ALL_ROOMS */
 #endif	/* else of DBG_ONLY_CUR_ROOM */
 
+	/* opaque stuff front to back to get the most out of early depth
+	 * rejection, then everything which blends back to front over it
+	 */
+	qsort(opaque_list.items, opaque_list.num, sizeof *opaque_list.items, cmp_front_to_back);
+	qsort(blend_list.items, blend_list.num, sizeof *blend_list.items, cmp_back_to_front);
+
+	scissor_room = 0;
+	draw_list(&opaque_list);
+	draw_list(&blend_list);
+	set_scissor(0);
+
 	/* render explosions */
 	for(i=0; i<MAX_EXPLOSIONS; i++) {
 		if(explosions[i].start_time >= 0) {
@@ -366,6 +714,11 @@ void render_level(void)
 	gaw_matrix_mode(GAW_MODELVIEW);
 }
 
+void rendlvl_stats(struct rendlvl_stats *st)
+{
+	*st = stats;
+}
+
 void render_level_mesh(struct mesh *mesh)
 {
 	int pass, more;
@@ -520,6 +873,46 @@ int add_explosion(const cgm_vec3 *pos, float sz, long start_tm)
 	return 0;
 }
 
+/* screen rectangle of a portal, intersected with the rectangle of the portals
+ * leading to it (prect). Returns 0 if the intersection is empty.
+ */
+static int portal_rect(const struct portal *portal, const float *prect, float *rect)
+{
+	int i;
+	cgm_vec4 v;
+	float x, y;
+
+	rect[0] = rect[1] = 1.0f;
+	rect[2] = rect[3] = -1.0f;
+
+	/* project the corners of the box around the portal sphere */
+	for(i=0; i<8; i++) {
+		v.x = portal->pos.x + (i & 1 ? portal->rad : -portal->rad);
+		v.y = portal->pos.y + (i & 2 ? portal->rad : -portal->rad);
+		v.z = portal->pos.z + (i & 4 ? portal->rad : -portal->rad);
+		v.w = 1.0f;
+		cgm_wmul_m4v4(&v, view_proj);
+
+		if(v.w < 1e-4f) {
+			/* reaches behind the viewer, can't narrow it down */
+			memcpy(rect, prect, 4 * sizeof *rect);
+			return 1;
+		}
+		x = v.x / v.w;
+		y = v.y / v.w;
+		if(x < rect[0]) rect[0] = x;
+		if(y < rect[1]) rect[1] = y;
+		if(x > rect[2]) rect[2] = x;
+		if(y > rect[3]) rect[3] = y;
+	}
+
+	if(rect[0] < prect[0]) rect[0] = prect[0];
+	if(rect[1] < prect[1]) rect[1] = prect[1];
+	if(rect[2] > prect[2]) rect[2] = prect[2];
+	if(rect[3] > prect[3]) rect[3] = prect[3];
+	return rect[0] < rect[2] && rect[1] < rect[3];
+}
+
 static int portal_frustum_test(struct portal *portal, const cgm_vec4 *frust)
 {
 	int i;
@@ -26,12 +26,22 @@ struct explosion {
 	float sz;
 };
 
+/* visibility counts of the last rendered frame */
+struct rendlvl_stats {
+	int rooms;
+	int meshes, meshes_culled;
+	int objects, objects_culled;
+	int enemies, enemies_culled;
+	int missiles, missiles_culled;
+};
+
 int rendlvl_init(struct level *lvl);
 void rendlvl_destroy(void);
 
 void rendlvl_setup(struct room *room, const cgm_vec3 *ppos, float *view_matrix);
 
 void rendlvl_update(void);
+void rendlvl_stats(struct rendlvl_stats *st);
 
 void render_level(void);
 void render_level_mesh(struct mesh *mesh);
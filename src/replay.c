@@ -0,0 +1,278 @@
+/*
+Deep Runner - 6dof shooter game for the SGI O2.
+Copyright (C) 2023  John Tsiombikas <nuclear@mutantstargoat.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "gaw/gaw.h"
+#include "imago2.h"
+#include "replay.h"
+#include "game.h"
+#include "input.h"
+#include "player.h"
+#include "options.h"
+#include "util.h"
+
+#define REPLAY_MAGIC	"deeprunner replay 1"
+
+static void end_replay(void);
+static void dump_frame(void);
+
+int replay_mode;
+
+static const char *fname;
+static FILE *fp;
+static int active, fast;
+
+static unsigned int seed;
+static long start_msec;
+static long num_ticks, num_frames, wall_start;
+static int prev_mouse_speed, prev_sball_speed;
+
+static const char *dump_prefix;
+static char *dump_fname;
+static unsigned char *dump_pix;
+static int dump_size;
+
+
+int replay_init(void)
+{
+	char *env;
+
+	if((env = getenv("GAME_REPLAY"))) {
+		replay_mode = REPLAY_PLAY;
+		fname = env;
+	} else if((env = getenv("GAME_RECORD"))) {
+		replay_mode = REPLAY_RECORD;
+		fname = env;
+	} else {
+		return 0;
+	}
+
+	if(replay_mode == REPLAY_PLAY) {
+		if(!(fp = fopen(fname, "rb"))) {
+			fprintf(stderr, "failed to open replay: %s\n", fname);
+			return -1;
+		}
+		fclose(fp);
+		fp = 0;
+
+		if((env = getenv("GAME_REPLAY_FAST"))) {
+			fast = atoi(env);
+		}
+		if((env = getenv("GAME_DUMP")) && *env) {
+			dump_prefix = env;
+			dump_fname = malloc_nf(strlen(env) + 16);
+			fast = 1;
+		}
+	}
+	return 0;
+}
+
+void replay_shutdown(void)
+{
+	replay_stop();
+	free(dump_pix);
+	dump_pix = 0;
+	dump_size = 0;
+	free(dump_fname);
+	dump_fname = 0;
+}
+
+static int read_header(void)
+{
+	char buf[256];
+	int ival;
+
+	if(!fgets(buf, sizeof buf, fp) || memcmp(buf, REPLAY_MAGIC, strlen(REPLAY_MAGIC)) != 0) {
+		fprintf(stderr, "invalid replay file: %s\n", fname);
+		return -1;
+	}
+
+	while(fgets(buf, sizeof buf, fp)) {
+		if(memcmp(buf, "ticks", 5) == 0) {
+			return 0;
+		}
+		if(sscanf(buf, "seed %u", &seed) == 1) continue;
+		if(sscanf(buf, "start %ld", &start_msec) == 1) continue;
+		if(sscanf(buf, "mousespeed %d", &ival) == 1) {
+			opt.mouse_speed = ival;
+			continue;
+		}
+		if(sscanf(buf, "sballspeed %d", &ival) == 1) {
+			opt.sball_speed = ival;
+			continue;
+		}
+		fprintf(stderr, "replay: ignoring unknown header line: %s", buf);
+	}
+
+	fprintf(stderr, "replay %s has no input data\n", fname);
+	return -1;
+}
+
+int replay_start(void)
+{
+	if(!replay_mode) return 0;
+
+	prev_mouse_speed = opt.mouse_speed;
+	prev_sball_speed = opt.sball_speed;
+
+	if(replay_mode == REPLAY_RECORD) {
+		if(!(fp = fopen(fname, "wb"))) {
+			fprintf(stderr, "failed to open %s for writing, not recording\n", fname);
+			replay_mode = REPLAY_OFF;
+			return 0;
+		}
+		seed = (unsigned int)time(0);
+		start_msec = time_msec;
+
+		fprintf(fp, "%s\n", REPLAY_MAGIC);
+		fprintf(fp, "seed %u\n", seed);
+		fprintf(fp, "start %ld\n", start_msec);
+		fprintf(fp, "mousespeed %d\n", opt.mouse_speed);
+		fprintf(fp, "sballspeed %d\n", opt.sball_speed);
+		fprintf(fp, "ticks\n");
+		printf("recording game to: %s\n", fname);
+	} else {
+		if(!(fp = fopen(fname, "rb"))) {
+			fprintf(stderr, "failed to open replay: %s\n", fname);
+			return -1;
+		}
+		if(read_header() == -1) {
+			fclose(fp);
+			fp = 0;
+			return -1;
+		}
+		printf("replaying game from: %s\n", fname);
+
+		if(fast) {
+			game_vsync(0);
+		}
+	}
+
+	srand(seed);
+	time_msec = start_msec;
+
+	num_ticks = num_frames = 0;
+	wall_start = game_getmsec();
+	active = 1;
+	return 0;
+}
+
+void replay_stop(void)
+{
+	if(!replay_mode) return;
+
+	if(active && replay_mode == REPLAY_RECORD) {
+		printf("\nrecorded %ld updates to: %s\n", num_ticks, fname);
+	}
+	active = 0;
+
+	if(fp) {
+		fclose(fp);
+		fp = 0;
+	}
+
+	/* don't let the recorded options end up in the config file */
+	if(replay_mode == REPLAY_PLAY) {
+		opt.mouse_speed = prev_mouse_speed;
+		opt.sball_speed = prev_sball_speed;
+	}
+}
+
+int replay_fixed_step(void)
+{
+	return active && fast;
+}
+
+long replay_time(void)
+{
+	return start_msec + (long)((double)num_ticks * TSTEP * 1000.0);
+}
+
+int replay_tick(struct player *p)
+{
+	char buf[256];
+	int res;
+
+	if(!active) return -1;
+
+	if(replay_mode == REPLAY_RECORD) {
+		fprintf(fp, "%x %.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g\n", inpstate,
+				p->mouse_input.x, p->mouse_input.y, p->sball_rot.x, p->sball_rot.y,
+				p->sball_rot.z, p->sball_mov.x, p->sball_mov.y, p->sball_mov.z);
+	} else {
+		res = 0;
+		if(fgets(buf, sizeof buf, fp)) {
+			res = sscanf(buf, "%x %f %f %f %f %f %f %f %f", &inpstate,
+					&p->mouse_input.x, &p->mouse_input.y, &p->sball_rot.x,
+					&p->sball_rot.y, &p->sball_rot.z, &p->sball_mov.x,
+					&p->sball_mov.y, &p->sball_mov.z);
+		}
+		if(res != 9) {
+			end_replay();
+			return -1;
+		}
+	}
+
+	num_ticks++;
+	return 0;
+}
+
+void replay_end_frame(void)
+{
+	if(!active) return;
+
+	if(dump_prefix) {
+		dump_frame();
+	}
+	num_frames++;
+}
+
+static void end_replay(void)
+{
+	long msec = game_getmsec() - wall_start;
+
+	printf("\nreplay finished: %ld updates, %ld frames in %ld ms", num_ticks,
+			num_frames, msec);
+	if(msec > 0) {
+		printf(" (%.2f fps)", (float)num_frames * 1000.0f / (float)msec);
+	}
+	putchar('\n');
+
+	inpstate = 0;
+	active = 0;
+	game_quit();
+}
+
+static void dump_frame(void)
+{
+	int size = win_width * win_height * 3;
+
+	if(size > dump_size) {
+		free(dump_pix);
+		dump_pix = malloc_nf(size);
+		dump_size = size;
+	}
+	gaw_read_pixels(0, 0, win_width, win_height, dump_pix);
+
+	sprintf(dump_fname, "%s%05ld.png", dump_prefix, num_frames);
+	if(img_save_pixels(dump_fname, dump_pix, win_width, win_height, IMG_FMT_RGB24) == -1) {
+		fprintf(stderr, "failed to save frame: %s\n", dump_fname);
+	}
+}
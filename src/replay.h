@@ -0,0 +1,63 @@
+/*
+Deep Runner - 6dof shooter game for the SGI O2.
+Copyright (C) 2023  John Tsiombikas <nuclear@mutantstargoat.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef REPLAY_H_
+#define REPLAY_H_
+
+/* Gameplay recording and replay.
+ *
+ * GAME_RECORD=file records a game session: the random seed and start time,
+ * followed by the input state (inpstate, mouse and spaceball deltas) of every
+ * TSTEP game update.
+ * GAME_REPLAY=file plays it back, ignoring live input, and quits at the end.
+ * GAME_REPLAY_FAST=1 runs exactly one update per frame as fast as possible,
+ * instead of at the original rate.
+ * GAME_DUMP=prefix saves every frame of a replay as <prefix>NNNNN.png, and
+ * implies a fast replay, so frame N always shows the state after update N.
+ *
+ * While recording or replaying, time_msec in the game screen follows the
+ * update count instead of the wall clock. Replays are only repeatable with the
+ * same binary, level data, and START_ROOM.
+ */
+
+enum { REPLAY_OFF, REPLAY_RECORD, REPLAY_PLAY };
+
+struct player;
+
+extern int replay_mode;
+
+int replay_init(void);
+void replay_shutdown(void);
+
+/* called by the game screen when a game starts/stops. replay_start seeds the
+ * random number generator and sets the game clock.
+ */
+int replay_start(void);
+void replay_stop(void);
+
+/* non-zero if updates should run once per frame, regardless of time */
+int replay_fixed_step(void);
+/* game time of the next update */
+long replay_time(void);
+
+/* record or play back the input for the next update, -1 at end of replay */
+int replay_tick(struct player *p);
+
+/* called at the end of every frame, before swapping buffers */
+void replay_end_frame(void);
+
+#endif	/* REPLAY_H_ */
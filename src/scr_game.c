@@ -37,6 +37,8 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include "loading.h"
 #include "enemy.h"
 #include "darray.h"
+#include "replay.h"
+#include "prof.h"
 
 static int ginit(void);
 static void gdestroy(void);
@@ -228,6 +230,11 @@ static int gstart(void)
 	init_player(player);
 	player->lvl = &lvl;
 
+	/* seeds the RNG and sets the game clock when recording or replaying */
+	if(replay_start() == -1) {
+		return -1;
+	}
+
 	lvl_spawn_enemies(&lvl);
 
 	gameover = 0;
@@ -283,6 +290,8 @@ static void gstop(void)
 		mod = 0;
 	}
 
+	replay_stop();
+
 	rendlvl_destroy();
 	lvl_destroy(&lvl);
 
@@ -439,7 +448,7 @@ static void gupdate(void)
 				lvl_despawn_missile(mis);
 				add_explosion(&mis->pos, 1, time_msec);
 			}
-			if(lvl_collision(&lvl, player->room, &mis->pos, &mis->vel, &missile_hit)) {
+			if(lvl_sweep(&lvl, mis->room, &mis->pos, &mis->vel, MISSILE_RAD, &missile_hit)) {
 				lvl_despawn_missile(mis);
 				add_explosion(&mis->pos, 1, time_msec);
 			}
@@ -468,7 +477,9 @@ end:
 	}
 #endif
 
+	PROF_BEGIN(PROF_VIS);
 	rendlvl_update();
+	PROF_END(PROF_VIS);
 }
 
 static void gdisplay(void)
@@ -488,14 +499,34 @@ static void gdisplay(void)
 	tm_acc += (float)(msec - prev_msec) / 1000.0f;
 	prev_msec = msec;
 
-	/* updating mouse input every frame feels more fluid */
-	update_player_mouse(player);
+	if(replay_mode) {
+		/* recorded input is per timestep, so mouse input has to go with it */
+		time_msec = replay_time();
+		if(replay_fixed_step()) {
+			tm_acc = TSTEP;
+		}
+	} else {
+		/* updating mouse input every frame feels more fluid */
+		update_player_mouse(player);
+	}
 
 	/* update all other game logic once per timestep */
 	upd_iter = 16;
 	while(tm_acc >= TSTEP && --upd_iter > 0) {
+		if(replay_mode) {
+			if(replay_tick(player) == -1) {
+				tm_acc = 0;
+				break;
+			}
+			update_player_mouse(player);
+		}
+		PROF_BEGIN(PROF_UPDATE);
 		gupdate();
+		PROF_END(PROF_UPDATE);
 		tm_acc -= TSTEP;
+		if(replay_mode) {
+			time_msec = replay_time();
+		}
 	}
 
 	gaw_matrix_mode(GAW_MODELVIEW);
@@ -507,7 +538,9 @@ static void gdisplay(void)
 
 	gaw_enable(GAW_FOG);
 
+	PROF_BEGIN(PROF_RENDER);
 	render_level();
+	PROF_END(PROF_RENDER);
 
 	gaw_disable(GAW_FOG);
 
@@ -622,6 +655,7 @@ static void draw_ui(void)
 	float x, vwidth = win_aspect * 480.0f;
 	float timer_xoffs = vwidth - 125;
 
+	PROF_BEGIN(PROF_UI);
 	begin2d(480);
 
 	if(opt.gfx.blendui) {
@@ -749,6 +783,7 @@ static void draw_ui(void)
 	}
 
 	end2d();
+	PROF_END(PROF_UI);
 }
 
 static void greshape(int x, int y)
@@ -810,6 +845,15 @@ static void gkeyb(int key, int press)
 
 		case GKEY_F1:
 			printf("player: %g %g %g\n", player->pos.x, player->pos.y, player->pos.z);
+			{
+				struct rendlvl_stats st;
+				rendlvl_stats(&st);
+				printf("visible rooms: %d\n", st.rooms);
+				printf("  meshes: %d drawn, %d culled\n", st.meshes, st.meshes_culled);
+				printf("  objects: %d drawn, %d culled\n", st.objects, st.objects_culled);
+				printf("  enemies: %d drawn, %d culled\n", st.enemies, st.enemies_culled);
+				printf("  missiles: %d drawn, %d culled\n", st.missiles, st.missiles_culled);
+			}
 			break;
 
 #ifdef DBG_SHOW_FRUST
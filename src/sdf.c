@@ -0,0 +1,273 @@
+/*
+Deep Runner - 6dof shooter game for the SGI O2.
+Copyright (C) 2023  John Tsiombikas <nuclear@mutantstargoat.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "sdf.h"
+#include "util.h"
+
+#define BRICK_DIM		(SDF_BRICK + 1)		/* samples along each side of a brick */
+#define BRICK_SAMPLES	(BRICK_DIM * BRICK_DIM * BRICK_DIM)
+#define MAX_BRICKS		(1 << 20)
+#define QMAX			65535
+
+#define VELEM(v, i)		((&(v)->x)[i])
+
+static int fetch_voxel(const struct sdf *sdf, const cgm_vec3 *pt, float *c, float *f);
+
+
+struct sdf *sdf_create(const struct bvh *bvh, float voxsz)
+{
+	int i, j, k, m, bx, by, bz, total;
+	struct sdf *sdf;
+	struct aabox box;
+	struct trihit hit;
+	cgm_vec3 pt;
+	float bsz, dist;
+	unsigned short *sptr;
+
+	if(!bvh || !bvh->num_nodes || voxsz <= 0.0f) {
+		return 0;
+	}
+
+	sdf = calloc_nf(1, sizeof *sdf);
+	sdf->aabb = bvh->nodes[0].aabb;
+	sdf->voxsz = voxsz;
+	sdf->inv_voxsz = 1.0f / voxsz;
+	sdf->band = voxsz * SDF_BRICK;
+	sdf->qscale = sdf->band / QMAX;
+
+	/* cover the triangles and the band around them */
+	bsz = voxsz * SDF_BRICK;
+	sdf->org = sdf->aabb.vmin;
+	total = 1;
+	for(i=0; i<3; i++) {
+		VELEM(&sdf->org, i) -= sdf->band;
+		sdf->size[i] = (int)ceil((VELEM(&sdf->aabb.vmax, i) - VELEM(&sdf->aabb.vmin, i) +
+					sdf->band * 2.0f) / bsz);
+		if(sdf->size[i] < 1) sdf->size[i] = 1;
+		total *= sdf->size[i];
+	}
+	if(total > MAX_BRICKS) {
+		fprintf(stderr, "sdf_create: voxel size %g too small (%dx%dx%d bricks)\n", voxsz,
+				sdf->size[0], sdf->size[1], sdf->size[2]);
+		free(sdf);
+		return 0;
+	}
+	sdf->bricks = malloc_nf(total * sizeof *sdf->bricks);
+
+	/* bricks with no triangles within band of them stay empty */
+	sdf->num_bricks = 0;
+	i = 0;
+	for(bz=0; bz<sdf->size[2]; bz++) {
+		for(by=0; by<sdf->size[1]; by++) {
+			for(bx=0; bx<sdf->size[0]; bx++) {
+				box.vmin.x = sdf->org.x + bx * bsz - sdf->band;
+				box.vmin.y = sdf->org.y + by * bsz - sdf->band;
+				box.vmin.z = sdf->org.z + bz * bsz - sdf->band;
+				box.vmax.x = box.vmin.x + bsz + sdf->band * 2.0f;
+				box.vmax.y = box.vmin.y + bsz + sdf->band * 2.0f;
+				box.vmax.z = box.vmin.z + bsz + sdf->band * 2.0f;
+
+				if(bvh_boxtest(bvh, &box)) {
+					sdf->bricks[i] = sdf->num_bricks++ * BRICK_SAMPLES;
+				} else {
+					sdf->bricks[i] = -1;
+				}
+				i++;
+			}
+		}
+	}
+
+	sdf->samples = malloc_nf(sdf->num_bricks * BRICK_SAMPLES * sizeof *sdf->samples);
+
+	i = 0;
+	for(bz=0; bz<sdf->size[2]; bz++) {
+		for(by=0; by<sdf->size[1]; by++) {
+			for(bx=0; bx<sdf->size[0]; bx++) {
+				if(sdf->bricks[i] < 0) {
+					i++;
+					continue;
+				}
+				sptr = sdf->samples + sdf->bricks[i++];
+
+				for(k=0; k<BRICK_DIM; k++) {
+					pt.z = sdf->org.z + (bz * SDF_BRICK + k) * voxsz;
+					for(j=0; j<BRICK_DIM; j++) {
+						pt.y = sdf->org.y + (by * SDF_BRICK + j) * voxsz;
+						for(m=0; m<BRICK_DIM; m++) {
+							pt.x = sdf->org.x + (bx * SDF_BRICK + m) * voxsz;
+							if(bvh_sphtest(bvh, &pt, sdf->band, &hit)) {
+								dist = sqrt(hit.t);
+							} else {
+								dist = sdf->band;
+							}
+							*sptr++ = (unsigned short)(dist / sdf->qscale + 0.5f);
+						}
+					}
+				}
+			}
+		}
+	}
+
+	printf("sdf: %dx%dx%d bricks, %d used (%lu kb)\n", sdf->size[0], sdf->size[1],
+			sdf->size[2], sdf->num_bricks,
+			(unsigned long)(sdf->num_bricks * BRICK_SAMPLES * sizeof *sdf->samples) >> 10);
+	return sdf;
+}
+
+void sdf_free(struct sdf *sdf)
+{
+	if(!sdf) return;
+	free(sdf->bricks);
+	free(sdf->samples);
+	free(sdf);
+}
+
+/* finds the voxel containing pt, returns its corner distances in c (x fastest)
+ * and the position of pt in the voxel in f. Returns 0 outside of the field,
+ * -1 in empty bricks, and 1 otherwise.
+ */
+static int fetch_voxel(const struct sdf *sdf, const cgm_vec3 *pt, float *c, float *f)
+{
+	int i, vox[3], bidx;
+	float x;
+	const unsigned short *sptr;
+
+	for(i=0; i<3; i++) {
+		x = (VELEM(pt, i) - VELEM(&sdf->org, i)) * sdf->inv_voxsz;
+		if(x < 0.0f || x >= sdf->size[i] * SDF_BRICK) {
+			return 0;
+		}
+		vox[i] = (int)x;
+		f[i] = x - vox[i];
+	}
+
+	bidx = ((vox[2] / SDF_BRICK) * sdf->size[1] + vox[1] / SDF_BRICK) * sdf->size[0] +
+		vox[0] / SDF_BRICK;
+	if(sdf->bricks[bidx] < 0) {
+		return -1;
+	}
+
+	sptr = sdf->samples + sdf->bricks[bidx] + ((vox[2] % SDF_BRICK) * BRICK_DIM +
+			vox[1] % SDF_BRICK) * BRICK_DIM + vox[0] % SDF_BRICK;
+
+	c[0] = sptr[0] * sdf->qscale;
+	c[1] = sptr[1] * sdf->qscale;
+	c[2] = sptr[BRICK_DIM] * sdf->qscale;
+	c[3] = sptr[BRICK_DIM + 1] * sdf->qscale;
+	sptr += BRICK_DIM * BRICK_DIM;
+	c[4] = sptr[0] * sdf->qscale;
+	c[5] = sptr[1] * sdf->qscale;
+	c[6] = sptr[BRICK_DIM] * sdf->qscale;
+	c[7] = sptr[BRICK_DIM + 1] * sdf->qscale;
+	return 1;
+}
+
+static float trilinear(const float *c, const float *f, cgm_vec3 *grad)
+{
+	float x00, x10, x01, x11, y0, y1;
+
+	x00 = c[0] + (c[1] - c[0]) * f[0];
+	x10 = c[2] + (c[3] - c[2]) * f[0];
+	x01 = c[4] + (c[5] - c[4]) * f[0];
+	x11 = c[6] + (c[7] - c[6]) * f[0];
+	y0 = x00 + (x10 - x00) * f[1];
+	y1 = x01 + (x11 - x01) * f[1];
+
+	if(grad) {
+		grad->x = ((c[1] - c[0]) * (1.0f - f[1]) + (c[3] - c[2]) * f[1]) * (1.0f - f[2]) +
+			((c[5] - c[4]) * (1.0f - f[1]) + (c[7] - c[6]) * f[1]) * f[2];
+		grad->y = (x10 - x00) * (1.0f - f[2]) + (x11 - x01) * f[2];
+		grad->z = y1 - y0;
+	}
+	return y0 + (y1 - y0) * f[2];
+}
+
+float sdf_dist(const struct sdf *sdf, const cgm_vec3 *pt, cgm_vec3 *grad)
+{
+	float c[8], f[3], d;
+
+	if(fetch_voxel(sdf, pt, c, f) <= 0) {
+		return -1.0f;
+	}
+	d = trilinear(c, f, grad);
+	if(grad) {
+		cgm_vscale(grad, sdf->inv_voxsz);
+	}
+	return d;
+}
+
+int sdf_sphtest(const struct sdf *sdf, const cgm_vec3 *pt, float rad, cgm_vec3 *norm)
+{
+	int i, near;
+	float c[8], f[3], offs[3], d, dnear, lim, glen;
+	cgm_vec3 grad;
+
+	switch(fetch_voxel(sdf, pt, c, f)) {
+	case 0:
+		/* nothing can be closer than the bounds of the triangles */
+		return aabox_distsq(&sdf->aabb, pt) > rad * rad ? SDF_MISS : SDF_UNSURE;
+	case -1:
+		/* empty bricks are further than band from every triangle */
+		return sdf->band > rad ? SDF_MISS : SDF_UNSURE;
+	default:
+		break;
+	}
+
+	/* the distance can't change faster than the distance we move away from
+	 * where it was sampled, so the nearest corner bounds it both ways. Samples
+	 * are rounded to the nearest step, and clamped to the band.
+	 */
+	near = 0;
+	for(i=0; i<3; i++) {
+		if(f[i] >= 0.5f) {
+			near |= 1 << i;
+			offs[i] = 1.0f - f[i];
+		} else {
+			offs[i] = f[i];
+		}
+	}
+	dnear = c[near];
+	lim = sqrt(offs[0] * offs[0] + offs[1] * offs[1] + offs[2] * offs[2]) * sdf->voxsz +
+		sdf->qscale;
+
+	if(dnear - lim > rad) {
+		return SDF_MISS;
+	}
+	if(dnear >= sdf->band - sdf->qscale || dnear + lim >= rad) {
+		return SDF_UNSURE;
+	}
+
+	if(!norm) return SDF_HIT;
+
+	/* close to the surface the unsigned distance has a crease, and its gradient
+	 * doesn't point anywhere useful.
+	 */
+	d = trilinear(c, f, &grad);
+	if(d < sdf->voxsz) {
+		return SDF_UNSURE;
+	}
+	glen = cgm_vlength(&grad) * sdf->inv_voxsz;
+	if(glen < 0.5f) {
+		return SDF_UNSURE;
+	}
+	*norm = grad;
+	cgm_vnormalize(norm);
+	return SDF_HIT;
+}
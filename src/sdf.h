@@ -0,0 +1,68 @@
+/*
+Deep Runner - 6dof shooter game for the SGI O2.
+Copyright (C) 2023  John Tsiombikas <nuclear@mutantstargoat.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef SDF_H_
+#define SDF_H_
+
+#include "bvh.h"
+
+/* Distance field of the triangles of a bvh, baked at load time, to answer
+ * most sphere tests without going through the triangles.
+ *
+ * The field is sampled on a regular lattice, split into bricks of
+ * SDF_BRICK^3 voxels. Only bricks within a band around the triangles store
+ * their samples; the rest are known to be further than that. The distance is
+ * unsigned, like the triangle tests it stands in for, since collision meshes
+ * aren't necessarily closed.
+ *
+ * Queries only give a definite answer when the samples leave no doubt. Near
+ * the surface, where the gradient of an unsigned field is unreliable, and
+ * around features thinner than a voxel, they return SDF_UNSURE and the caller
+ * has to fall back to the exact triangle tests.
+ */
+
+#define SDF_BRICK	8
+
+enum { SDF_MISS, SDF_HIT, SDF_UNSURE };
+
+struct sdf {
+	struct aabox aabb;		/* bounds of the triangles */
+	cgm_vec3 org;			/* lattice origin */
+	float voxsz, inv_voxsz;
+	float band;				/* distances further than this aren't stored */
+	float qscale;			/* sample value to distance */
+	int size[3];			/* in bricks */
+
+	int *bricks;			/* first sample of each brick, -1 for empty bricks */
+	unsigned short *samples;
+	int num_bricks;			/* number of non-empty bricks */
+};
+
+struct sdf *sdf_create(const struct bvh *bvh, float voxsz);
+void sdf_free(struct sdf *sdf);
+
+/* interpolated distance from pt, and its gradient if grad is not null. Returns
+ * -1 outside of the stored band.
+ */
+float sdf_dist(const struct sdf *sdf, const cgm_vec3 *pt, cgm_vec3 *grad);
+
+/* does a sphere touch any triangles? For SDF_HIT, norm (if not null) is the
+ * direction away from the nearest triangle.
+ */
+int sdf_sphtest(const struct sdf *sdf, const cgm_vec3 *pt, float rad, cgm_vec3 *norm);
+
+#endif	/* SDF_H_ */
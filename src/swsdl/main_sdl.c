@@ -23,16 +23,26 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include "gaw/gaw_sw.h"
 
 static int handle_event(SDL_Event *ev);
+static void print_sw_stats(void);
 static int translate_keysym(int sym);
+static void setup_framebuffer(void);
 
 static SDL_Surface *fbsurf;
 static int quit;
 
+/* without the rasterizer pipeline, frames are drawn straight into the video
+ * surface. Otherwise they're drawn into framebuf and the back buffer of the
+ * rasterizer in turn, and copied to the surface when complete.
+ */
+static int pipeline;
 static uint32_t *framebuf;
+static unsigned long num_frames;
 
 int main(int argc, char **argv)
 {
 	SDL_Event ev;
+	char *env;
+	int nthr;
 
 	if(SDL_Init(SDL_INIT_VIDEO | SDL_INIT_TIMER) == -1) {
 		fprintf(stderr, "failed to initialize SDL\n");
@@ -46,8 +56,45 @@ int main(int argc, char **argv)
 	}
 	SDL_WM_SetCaption("DeepRunner", 0);
 	gaw_sw_init();
+
+	/* GAW_SW_PIPELINE=1 rasterizes each frame while the next one is set up */
+	if((env = getenv("GAW_SW_PIPELINE")) && atoi(env)) {
+		pipeline = 1;
+	}
 	game_resize(640, 480);
 
+	nthr = (env = getenv("GAW_SW_THREADS")) ? atoi(env) : 0;
+	nthr = gaw_sw_threads(nthr);
+	printf("rasterizer threads: %d\n", nthr);
+
+	/* GAW_SW_SIMD=0 forces the scalar span fillers, for comparison */
+	if((env = getenv("GAW_SW_SIMD")) && !atoi(env)) {
+		gaw_sw_simd(0);
+	}
+	/* GAW_SW_ZEPOCH=0 goes back to clearing the whole depth buffer */
+	if((env = getenv("GAW_SW_ZEPOCH")) && !atoi(env)) {
+		gaw_sw_depth_epoch(0);
+	}
+	/* GAW_SW_HIZ=0 disables hierarchical z rejection */
+	if((env = getenv("GAW_SW_HIZ")) && !atoi(env)) {
+		gaw_sw_hiz(0);
+	}
+	/* GAW_SW_GUARDBAND=0 clips everything crossing the screen edges */
+	if((env = getenv("GAW_SW_GUARDBAND")) && !atoi(env)) {
+		gaw_sw_guard_band(0);
+	}
+	/* GAW_SW_SBUF=0 draws level geometry in any order with just the zbuffer */
+	if((env = getenv("GAW_SW_SBUF")) && !atoi(env)) {
+		gaw_sw_span_buffer(0);
+	}
+	/* GAW_SW_SPECIALIZE=0 always uses the fill mode requested by the state */
+	if((env = getenv("GAW_SW_SPECIALIZE")) && !atoi(env)) {
+		gaw_sw_specialize(0);
+	}
+	if(pipeline) {
+		gaw_sw_pipeline(1);
+	}
+
 	if(game_init() == -1) {
 		return 1;
 	}
@@ -63,6 +110,7 @@ int main(int argc, char **argv)
 	}
 
 end:
+	print_sw_stats();
 	game_shutdown();
 	SDL_Quit();
 	return 0;
@@ -76,19 +124,63 @@ long game_getmsec(void)
 
 void game_swap_buffers(void)
 {
-	uint32_t *fbptr;
+	int i;
+	unsigned char *fbptr;
+	uint32_t *pixels;
 
-	if(SDL_MUSTLOCK(fbsurf)) {
-		SDL_LockSurface(fbsurf);
-	}
+	pixels = gaw_sw_end_frame();
+	num_frames++;
 
-	fbptr = fbsurf->pixels;
-	memcpy(fbptr, framebuf, fbsurf->w * fbsurf->h * 4);
+	if(pipeline) {
+		if(SDL_MUSTLOCK(fbsurf)) {
+			SDL_LockSurface(fbsurf);
+		}
+		fbptr = fbsurf->pixels;
+		for(i=0; i<fbsurf->h; i++) {
+			memcpy(fbptr, pixels, fbsurf->w * 4);
+			fbptr += fbsurf->pitch;
+			pixels += fbsurf->w;
+		}
+	}
 
+	/* the surface stays locked while we draw into it, except to flip */
 	if(SDL_MUSTLOCK(fbsurf)) {
 		SDL_UnlockSurface(fbsurf);
 	}
 	SDL_Flip(fbsurf);
+
+	if(!pipeline && SDL_MUSTLOCK(fbsurf)) {
+		SDL_LockSurface(fbsurf);
+		/* it might move while unlocked */
+		if(fbsurf->pixels != (void*)pixels) {
+			gaw_sw_framebuffer_addr(fbsurf->pixels);
+		}
+	}
+}
+
+static void print_sw_stats(void)
+{
+	struct gaw_sw_stats st;
+	double nfr;
+
+	if(!num_frames) return;
+	nfr = (double)num_frames;
+
+	gaw_sw_stats(&st);
+	printf("rasterizer stats over %lu frames (per frame):\n", num_frames);
+	printf("  hi-z rejected polygons: %.1f of %.1f tested\n", st.hiz_polys / nfr,
+			st.hiz_tested / nfr);
+	printf("  hi-z rejected pixels: %.1f\n", st.hiz_pixels / nfr);
+	printf("  span buffer rejected pixels: %.1f\n", st.sbuf_pixels / nfr);
+	if(st.tris) {
+		printf("  indexed: %.1f tris, %.1f vertices transformed of %.1f referenced (ACMR %.3f)\n",
+				st.tris / nfr, st.vert_xform / nfr, st.vert_refs / nfr,
+				(double)st.vert_xform / (double)st.tris);
+	}
+	printf("  backface culled primitives: %.1f\n", st.culled / nfr);
+	printf("  fill specializations: %.1f flat, %.1f replace, %.1f opaque, %.1f z-only of %.1f polygons\n",
+			st.fill_flat / nfr, st.fill_replace / nfr, st.fill_opaque / nfr,
+			st.fill_zonly / nfr, st.fill_polys / nfr);
 }
 
 void game_quit(void)
@@ -98,21 +190,39 @@ void game_quit(void)
 
 void game_resize(int x, int y)
 {
-	int npix, nprevpix;
-
 	if(x == win_width && y == win_height) return;
 
-	SDL_SetVideoMode(x, y, 32, SDL_SWSURFACE | SDL_RESIZABLE);
+	/* don't pull the framebuffer from under the rasterizer */
+	gaw_sw_flush();
+	if(!pipeline && SDL_MUSTLOCK(fbsurf)) {
+		SDL_UnlockSurface(fbsurf);
+	}
 
-	npix = x * y;
-	nprevpix = win_width * win_height;
+	fbsurf = SDL_SetVideoMode(x, y, 32, SDL_SWSURFACE | SDL_RESIZABLE);
+	game_reshape(x, y);
 
-	if(npix > nprevpix) {
-		framebuf = realloc_nf(framebuf, npix * sizeof *framebuf);
+	setup_framebuffer();
+}
+
+static void setup_framebuffer(void)
+{
+	int npix = fbsurf->w * fbsurf->h;
+	static int max_npix;
+
+	if(!pipeline) {
+		if(SDL_MUSTLOCK(fbsurf)) {
+			SDL_LockSurface(fbsurf);
+		}
+		gaw_sw_framebuffer(fbsurf->w, fbsurf->h, fbsurf->pixels);
+		gaw_sw_framebuffer_pitch(fbsurf->pitch);
+		return;
 	}
-	game_reshape(x, y);
 
-	gaw_sw_framebuffer(x, y, framebuf);
+	if(npix > max_npix) {
+		framebuf = realloc_nf(framebuf, npix * sizeof *framebuf);
+		max_npix = npix;
+	}
+	gaw_sw_framebuffer(fbsurf->w, fbsurf->h, framebuf);
 }
 
 void game_fullscreen(int fs)
@@ -134,7 +244,6 @@ static int handle_event(SDL_Event *ev)
 	switch(ev->type) {
 	case SDL_VIDEORESIZE:
 		if(ev->resize.w != win_width || ev->resize.h != win_height) {
-			SDL_SetVideoMode(ev->resize.w, ev->resize.h, 32, SDL_SWSURFACE | SDL_RESIZABLE);
 			game_resize(ev->resize.w, ev->resize.h);
 		}
 		break;
@@ -0,0 +1,404 @@
+/*
+Deep Runner - 6dof shooter game for the SGI O2.
+Copyright (C) 2023  John Tsiombikas <nuclear@mutantstargoat.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include "tri4.h"
+
+#ifdef TRI4_SSE
+#include <xmmintrin.h>
+#endif
+
+#define DET_EPSILON		1e-8f
+
+#ifdef TRI4_SSE
+static int ray_sse(const struct tri4 *blk, const cgm_ray *ray, float *tmax);
+static int sphere_sse(const struct tri4 *blk, const cgm_vec3 *pt, float rad, float *dsq);
+static int use_simd = 1;
+#endif
+
+
+void tri4_init(struct tri4 *blk)
+{
+	int i;
+
+	memset(blk, 0, sizeof *blk);
+	for(i=0; i<TRI4_LANES; i++) {
+		blk->idx[i] = -1;
+	}
+}
+
+void tri4_set(struct tri4 *blk, int lane, const struct triangle *tri, int idx)
+{
+	blk->v0[0][lane] = tri->v[0].x;
+	blk->v0[1][lane] = tri->v[0].y;
+	blk->v0[2][lane] = tri->v[0].z;
+	blk->e1[0][lane] = tri->v[1].x - tri->v[0].x;
+	blk->e1[1][lane] = tri->v[1].y - tri->v[0].y;
+	blk->e1[2][lane] = tri->v[1].z - tri->v[0].z;
+	blk->e2[0][lane] = tri->v[2].x - tri->v[0].x;
+	blk->e2[1][lane] = tri->v[2].y - tri->v[0].y;
+	blk->e2[2][lane] = tri->v[2].z - tri->v[0].z;
+	blk->norm[0][lane] = tri->norm.x;
+	blk->norm[1][lane] = tri->norm.y;
+	blk->norm[2][lane] = tri->norm.z;
+	blk->d[lane] = cgm_vdot(&tri->norm, tri->v);
+	blk->idx[lane] = idx;
+	blk->lanes |= 1 << lane;
+}
+
+int tri4_simd(int enable)
+{
+#ifdef TRI4_SSE
+	use_simd = enable;
+	return use_simd;
+#else
+	return 0;
+#endif
+}
+
+int tri4_ray(const struct tri4 *blk, const cgm_ray *ray, float *tmax)
+{
+#ifdef TRI4_SSE
+	if(use_simd) {
+		return ray_sse(blk, ray, tmax);
+	}
+#endif
+	return tri4_ray_ref(blk, ray, tmax);
+}
+
+int tri4_sphere(const struct tri4 *blk, const cgm_vec3 *pt, float rad, float *dsq)
+{
+#ifdef TRI4_SSE
+	if(use_simd) {
+		return sphere_sse(blk, pt, rad, dsq);
+	}
+#endif
+	return tri4_sphere_ref(blk, pt, rad, dsq);
+}
+
+#define DOT(ax, ay, az, bx, by, bz)	((ax) * (bx) + (ay) * (by) + (az) * (bz))
+
+/* Moller-Trumbore ray-triangle intersection */
+int tri4_ray_ref(const struct tri4 *blk, const cgm_ray *ray, float *tmax)
+{
+	int i, lane = -1;
+	float px, py, pz, qx, qy, qz, sx, sy, sz, det, inv, u, v, t;
+	const cgm_vec3 *dir = &ray->dir;
+
+	for(i=0; i<TRI4_LANES; i++) {
+		if(!(blk->lanes & (1 << i))) continue;
+
+		/* p = dir x e2 */
+		px = dir->y * blk->e2[2][i] - dir->z * blk->e2[1][i];
+		py = dir->z * blk->e2[0][i] - dir->x * blk->e2[2][i];
+		pz = dir->x * blk->e2[1][i] - dir->y * blk->e2[0][i];
+
+		det = DOT(blk->e1[0][i], blk->e1[1][i], blk->e1[2][i], px, py, pz);
+		if(fabs(det) < DET_EPSILON) continue;	/* parallel to the plane */
+		inv = 1.0f / det;
+
+		sx = ray->origin.x - blk->v0[0][i];
+		sy = ray->origin.y - blk->v0[1][i];
+		sz = ray->origin.z - blk->v0[2][i];
+		u = DOT(sx, sy, sz, px, py, pz) * inv;
+		if(u < 0.0f || u > 1.0f) continue;
+
+		/* q = s x e1 */
+		qx = sy * blk->e1[2][i] - sz * blk->e1[1][i];
+		qy = sz * blk->e1[0][i] - sx * blk->e1[2][i];
+		qz = sx * blk->e1[1][i] - sy * blk->e1[0][i];
+		v = DOT(dir->x, dir->y, dir->z, qx, qy, qz) * inv;
+		if(v < 0.0f || u + v > 1.0f) continue;
+
+		t = DOT(blk->e2[0][i], blk->e2[1][i], blk->e2[2][i], qx, qy, qz) * inv;
+		if(t <= 0.0f || t > *tmax) continue;
+
+		if(lane == -1 || t < *tmax) {
+			*tmax = t;
+			lane = i;
+		}
+	}
+	return lane;
+}
+
+/* Closest point on the triangle, from "Realtime Collision Detection" by
+ * Christer Ericson, ch.5.1.5 p.141, the same as tri_proj_pt. The closest point
+ * is v0 + e1 * v + e2 * w, and each region only determines v and w.
+ */
+int tri4_sphere_ref(const struct tri4 *blk, const cgm_vec3 *pt, float rad, float *dsq)
+{
+	int i, lane = -1;
+	float apx, apy, apz, bpx, bpy, bpz, cpx, cpy, cpz, dx, dy, dz;
+	float d1, d2, d3, d4, d5, d6, d43, d56, va, vb, vc, v, w, denom, dist;
+
+	for(i=0; i<TRI4_LANES; i++) {
+		if(!(blk->lanes & (1 << i))) continue;
+
+		/* reject by the distance from the plane first */
+		dist = DOT(blk->norm[0][i], blk->norm[1][i], blk->norm[2][i], pt->x, pt->y, pt->z) - blk->d[i];
+		if(fabs(dist) > rad) continue;
+
+		apx = pt->x - blk->v0[0][i];
+		apy = pt->y - blk->v0[1][i];
+		apz = pt->z - blk->v0[2][i];
+		bpx = apx - blk->e1[0][i];
+		bpy = apy - blk->e1[1][i];
+		bpz = apz - blk->e1[2][i];
+		cpx = apx - blk->e2[0][i];
+		cpy = apy - blk->e2[1][i];
+		cpz = apz - blk->e2[2][i];
+
+		d1 = DOT(blk->e1[0][i], blk->e1[1][i], blk->e1[2][i], apx, apy, apz);
+		d2 = DOT(blk->e2[0][i], blk->e2[1][i], blk->e2[2][i], apx, apy, apz);
+		d3 = DOT(blk->e1[0][i], blk->e1[1][i], blk->e1[2][i], bpx, bpy, bpz);
+		d4 = DOT(blk->e2[0][i], blk->e2[1][i], blk->e2[2][i], bpx, bpy, bpz);
+		d5 = DOT(blk->e1[0][i], blk->e1[1][i], blk->e1[2][i], cpx, cpy, cpz);
+		d6 = DOT(blk->e2[0][i], blk->e2[1][i], blk->e2[2][i], cpx, cpy, cpz);
+		vc = d1 * d4 - d3 * d2;
+		vb = d5 * d2 - d1 * d6;
+		va = d3 * d6 - d5 * d4;
+		d43 = d4 - d3;
+		d56 = d5 - d6;
+
+		if(d1 <= 0.0f && d2 <= 0.0f) {
+			v = w = 0.0f;		/* vertex 0 */
+		} else if(d3 >= 0.0f && d4 <= d3) {
+			v = 1.0f;			/* vertex 1 */
+			w = 0.0f;
+		} else if(vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+			v = d1 / (d1 - d3);	/* edge 01 */
+			w = 0.0f;
+		} else if(d6 >= 0.0f && d5 <= d6) {
+			v = 0.0f;			/* vertex 2 */
+			w = 1.0f;
+		} else if(vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+			v = 0.0f;			/* edge 02 */
+			w = d2 / (d2 - d6);
+		} else if(va <= 0.0f && d43 >= 0.0f && d56 >= 0.0f) {
+			w = d43 / (d43 + d56);	/* edge 12 */
+			v = 1.0f - w;
+		} else {
+			denom = 1.0f / (va + vb + vc);	/* inside the face */
+			v = vb * denom;
+			w = vc * denom;
+		}
+
+		dx = blk->v0[0][i] + blk->e1[0][i] * v + blk->e2[0][i] * w - pt->x;
+		dy = blk->v0[1][i] + blk->e1[1][i] * v + blk->e2[1][i] * w - pt->y;
+		dz = blk->v0[2][i] + blk->e1[2][i] * v + blk->e2[2][i] * w - pt->z;
+		dist = DOT(dx, dy, dz, dx, dy, dz);
+
+		if(dist <= rad * rad && dist < *dsq) {
+			*dsq = dist;
+			lane = i;
+		}
+	}
+	return lane;
+}
+
+
+#ifdef TRI4_SSE
+
+#define LOAD(arr)			_mm_loadu_ps(arr)
+#define SEL(mask, a, b)		_mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b))
+#define DOT4(ax, ay, az, bx, by, bz) \
+	_mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)), _mm_mul_ps(az, bz))
+
+static __inline __m128 abs4(__m128 x)
+{
+	return _mm_andnot_ps(_mm_set1_ps(-0.0f), x);
+}
+
+static int ray_sse(const struct tri4 *blk, const cgm_ray *ray, float *tmax)
+{
+	int i, mask, lane = -1;
+	__m128 dx, dy, dz, e1x, e1y, e1z, e2x, e2y, e2z, px, py, pz, qx, qy, qz;
+	__m128 sx, sy, sz, det, inv, u, v, t, zero, one, valid;
+	float tres[TRI4_LANES];
+
+	zero = _mm_setzero_ps();
+	one = _mm_set1_ps(1.0f);
+
+	dx = _mm_set1_ps(ray->dir.x);
+	dy = _mm_set1_ps(ray->dir.y);
+	dz = _mm_set1_ps(ray->dir.z);
+	e1x = LOAD(blk->e1[0]);
+	e1y = LOAD(blk->e1[1]);
+	e1z = LOAD(blk->e1[2]);
+	e2x = LOAD(blk->e2[0]);
+	e2y = LOAD(blk->e2[1]);
+	e2z = LOAD(blk->e2[2]);
+
+	px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+	py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+	pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+
+	det = DOT4(e1x, e1y, e1z, px, py, pz);
+	valid = _mm_cmpge_ps(abs4(det), _mm_set1_ps(DET_EPSILON));
+	if(!(_mm_movemask_ps(valid) & blk->lanes)) {
+		return -1;
+	}
+	/* keep the unused and parallel lanes from dividing by zero */
+	inv = _mm_div_ps(one, SEL(valid, det, one));
+
+	sx = _mm_sub_ps(_mm_set1_ps(ray->origin.x), LOAD(blk->v0[0]));
+	sy = _mm_sub_ps(_mm_set1_ps(ray->origin.y), LOAD(blk->v0[1]));
+	sz = _mm_sub_ps(_mm_set1_ps(ray->origin.z), LOAD(blk->v0[2]));
+	u = _mm_mul_ps(DOT4(sx, sy, sz, px, py, pz), inv);
+	valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmple_ps(u, one)));
+
+	qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+	qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+	qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+	v = _mm_mul_ps(DOT4(dx, dy, dz, qx, qy, qz), inv);
+	valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(v, zero),
+				_mm_cmple_ps(_mm_add_ps(u, v), one)));
+
+	t = _mm_mul_ps(DOT4(e2x, e2y, e2z, qx, qy, qz), inv);
+	valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpgt_ps(t, zero),
+				_mm_cmple_ps(t, _mm_set1_ps(*tmax))));
+
+	if(!(mask = _mm_movemask_ps(valid) & blk->lanes)) {
+		return -1;
+	}
+	_mm_storeu_ps(tres, t);
+	for(i=0; i<TRI4_LANES; i++) {
+		if((mask & (1 << i)) && (lane == -1 || tres[i] < *tmax)) {
+			*tmax = tres[i];
+			lane = i;
+		}
+	}
+	return lane;
+}
+
+static int sphere_sse(const struct tri4 *blk, const cgm_vec3 *pt, float rad, float *dsq)
+{
+	int i, mask, lane = -1;
+	__m128 px, py, pz, e1x, e1y, e1z, e2x, e2y, e2z, apx, apy, apz, bpx, bpy, bpz;
+	__m128 cpx, cpy, cpz, d1, d2, d3, d4, d5, d6, d43, d56, va, vb, vc, v, w;
+	__m128 near, m1, m2, m3, m4, m5, m6, mface, dx, dy, dz, dist, zero, one;
+	float dres[TRI4_LANES];
+
+	px = _mm_set1_ps(pt->x);
+	py = _mm_set1_ps(pt->y);
+	pz = _mm_set1_ps(pt->z);
+
+	/* reject by the distance from the plane first. cmpngt instead of cmple, to
+	 * keep lanes with degenerate normals, like the scalar version.
+	 */
+	dist = _mm_sub_ps(DOT4(LOAD(blk->norm[0]), LOAD(blk->norm[1]), LOAD(blk->norm[2]),
+				px, py, pz), LOAD(blk->d));
+	near = _mm_cmpngt_ps(abs4(dist), _mm_set1_ps(rad));
+	if(!(_mm_movemask_ps(near) & blk->lanes)) {
+		return -1;
+	}
+
+	zero = _mm_setzero_ps();
+	one = _mm_set1_ps(1.0f);
+
+	e1x = LOAD(blk->e1[0]);
+	e1y = LOAD(blk->e1[1]);
+	e1z = LOAD(blk->e1[2]);
+	e2x = LOAD(blk->e2[0]);
+	e2y = LOAD(blk->e2[1]);
+	e2z = LOAD(blk->e2[2]);
+
+	apx = _mm_sub_ps(px, LOAD(blk->v0[0]));
+	apy = _mm_sub_ps(py, LOAD(blk->v0[1]));
+	apz = _mm_sub_ps(pz, LOAD(blk->v0[2]));
+	bpx = _mm_sub_ps(apx, e1x);
+	bpy = _mm_sub_ps(apy, e1y);
+	bpz = _mm_sub_ps(apz, e1z);
+	cpx = _mm_sub_ps(apx, e2x);
+	cpy = _mm_sub_ps(apy, e2y);
+	cpz = _mm_sub_ps(apz, e2z);
+
+	d1 = DOT4(e1x, e1y, e1z, apx, apy, apz);
+	d2 = DOT4(e2x, e2y, e2z, apx, apy, apz);
+	d3 = DOT4(e1x, e1y, e1z, bpx, bpy, bpz);
+	d4 = DOT4(e2x, e2y, e2z, bpx, bpy, bpz);
+	d5 = DOT4(e1x, e1y, e1z, cpx, cpy, cpz);
+	d6 = DOT4(e2x, e2y, e2z, cpx, cpy, cpz);
+	vc = _mm_sub_ps(_mm_mul_ps(d1, d4), _mm_mul_ps(d3, d2));
+	vb = _mm_sub_ps(_mm_mul_ps(d5, d2), _mm_mul_ps(d1, d6));
+	va = _mm_sub_ps(_mm_mul_ps(d3, d6), _mm_mul_ps(d5, d4));
+	d43 = _mm_sub_ps(d4, d3);
+	d56 = _mm_sub_ps(d5, d6);
+
+	/* the regions, in the order the scalar version checks them */
+	m1 = _mm_and_ps(_mm_cmple_ps(d1, zero), _mm_cmple_ps(d2, zero));
+	m2 = _mm_and_ps(_mm_cmpge_ps(d3, zero), _mm_cmple_ps(d4, d3));
+	m3 = _mm_and_ps(_mm_cmple_ps(vc, zero), _mm_and_ps(_mm_cmpge_ps(d1, zero),
+				_mm_cmple_ps(d3, zero)));
+	m4 = _mm_and_ps(_mm_cmpge_ps(d6, zero), _mm_cmple_ps(d5, d6));
+	m5 = _mm_and_ps(_mm_cmple_ps(vb, zero), _mm_and_ps(_mm_cmpge_ps(d2, zero),
+				_mm_cmple_ps(d6, zero)));
+	m6 = _mm_and_ps(_mm_cmple_ps(va, zero), _mm_and_ps(_mm_cmpge_ps(d43, zero),
+				_mm_cmpge_ps(d56, zero)));
+	mface = _mm_or_ps(_mm_or_ps(m1, m2), _mm_or_ps(_mm_or_ps(m3, m4), _mm_or_ps(m5, m6)));
+
+	/* compute every case, from the last to the first, so that the earlier
+	 * ones take precedence. Denominators of cases which don't apply are
+	 * replaced by 1, to avoid dividing by zero.
+	 */
+	v = _mm_div_ps(one, SEL(mface, one, _mm_add_ps(_mm_add_ps(va, vb), vc)));
+	w = _mm_mul_ps(vc, v);
+	v = _mm_mul_ps(vb, v);
+
+	d43 = _mm_div_ps(d43, SEL(m6, _mm_add_ps(d43, d56), one));
+	v = SEL(m6, _mm_sub_ps(one, d43), v);
+	w = SEL(m6, d43, w);
+
+	d2 = _mm_div_ps(d2, SEL(m5, _mm_sub_ps(d2, d6), one));
+	v = SEL(m5, zero, v);
+	w = SEL(m5, d2, w);
+
+	v = SEL(m4, zero, v);
+	w = SEL(m4, one, w);
+
+	d1 = _mm_div_ps(d1, SEL(m3, _mm_sub_ps(d1, d3), one));
+	v = SEL(m3, d1, v);
+	w = SEL(m3, zero, w);
+
+	v = SEL(m2, one, v);
+	w = SEL(m2, zero, w);
+
+	v = SEL(m1, zero, v);
+	w = SEL(m1, zero, w);
+
+	dx = _mm_sub_ps(_mm_add_ps(_mm_add_ps(LOAD(blk->v0[0]), _mm_mul_ps(e1x, v)), _mm_mul_ps(e2x, w)), px);
+	dy = _mm_sub_ps(_mm_add_ps(_mm_add_ps(LOAD(blk->v0[1]), _mm_mul_ps(e1y, v)), _mm_mul_ps(e2y, w)), py);
+	dz = _mm_sub_ps(_mm_add_ps(_mm_add_ps(LOAD(blk->v0[2]), _mm_mul_ps(e1z, v)), _mm_mul_ps(e2z, w)), pz);
+	dist = DOT4(dx, dy, dz, dx, dy, dz);
+
+	mask = _mm_movemask_ps(_mm_and_ps(near, _mm_cmple_ps(dist, _mm_set1_ps(rad * rad))));
+	mask &= blk->lanes;
+	if(!mask) return -1;
+
+	_mm_storeu_ps(dres, dist);
+	for(i=0; i<TRI4_LANES; i++) {
+		if((mask & (1 << i)) && dres[i] < *dsq) {
+			*dsq = dres[i];
+			lane = i;
+		}
+	}
+	return lane;
+}
+
+#endif	/* TRI4_SSE */
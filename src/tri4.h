@@ -0,0 +1,66 @@
+/*
+Deep Runner - 6dof shooter game for the SGI O2.
+Copyright (C) 2023  John Tsiombikas <nuclear@mutantstargoat.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef TRI4_H_
+#define TRI4_H_
+
+#include "geom.h"
+
+/* Blocks of 4 collision triangles, with everything the ray and sphere tests
+ * need precomputed once at load time, stored one array per coordinate so that
+ * a single ray or sphere can be tested against all 4 at once.
+ *
+ * The SSE versions are built on x86 with compilers which provide SSE
+ * intrinsics, and used while tri4_simd is enabled. The scalar versions do
+ * exactly the same arithmetic one lane at a time, and remain the reference.
+ */
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE__) || \
+	(defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define TRI4_SSE
+#endif
+
+#define TRI4_LANES	4
+
+struct tri4 {
+	float v0[3][TRI4_LANES];	/* first vertex */
+	float e1[3][TRI4_LANES];	/* v1 - v0 */
+	float e2[3][TRI4_LANES];	/* v2 - v0 */
+	float norm[3][TRI4_LANES];
+	float d[TRI4_LANES];		/* plane distance: dot(norm, v0) */
+	int idx[TRI4_LANES];		/* triangle index, -1 for unused lanes */
+	unsigned int lanes;			/* bitmask of the used lanes */
+};
+
+void tri4_init(struct tri4 *blk);
+void tri4_set(struct tri4 *blk, int lane, const struct triangle *tri, int idx);
+
+/* enable/disable the SSE versions. Returns whether they're actually enabled */
+int tri4_simd(int enable);
+
+/* nearest intersection in (0, *tmax] with the ray, returns its lane and
+ * updates *tmax, or -1 if there's none.
+ */
+int tri4_ray(const struct tri4 *blk, const cgm_ray *ray, float *tmax);
+int tri4_ray_ref(const struct tri4 *blk, const cgm_ray *ray, float *tmax);
+
+/* nearest triangle within rad of pt, and nearer than *dsq. Returns its lane
+ * and updates *dsq with the squared distance, or -1 if there's none.
+ */
+int tri4_sphere(const struct tri4 *blk, const cgm_vec3 *pt, float rad, float *dsq);
+int tri4_sphere_ref(const struct tri4 *blk, const cgm_vec3 *pt, float rad, float *dsq);
+
+#endif	/* TRI4_H_ */